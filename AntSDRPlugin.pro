@@ -41,33 +41,75 @@ SOURCES += Registration.cpp \
   AD9361SourcePage.cpp \
   AD9361SourcePageFactory.cpp \
   2rx_ad9361.c \
+  AutoSaveWriter.cpp \
+  ChannelAligner.cpp \
   CoherentChannelForwarder.cpp \
   CoherentDetector.cpp \
+  CoherentReplay.cpp \
+  DelayEstimator.cpp \
+  EventLogModel.cpp \
+  EventStore.cpp \
+  FractionalDelayFilter.cpp \
+  PairedChannelForwarder.cpp \
   PhaseComparator.cpp \
+  PhaseComparatorBank.cpp \
   PhaseComparatorFactory.cpp \
+  PhaseHistory.cpp \
+  PhasePrefixSums.cpp \
+  PhaseRecording.cpp \
+  PhasePyramid.cpp \
   PhasePlotPage.cpp \
   PhasePlotPageFactory.cpp \
   Polarimeter.cpp \
   PolarimeterFactory.cpp \
   PolarimetryPage.cpp \
   PolarimetryPageFactory.cpp \
+  PolyphaseChannelizer.cpp \
   RawChannelForwarder.cpp \
+  RecordingIndex.cpp \
+  SampleCodec.cpp \
+  SampleRing.cpp \
+  SharedChannelizer.cpp \
+  SigMFMetadata.cpp \
+  SignalKernels.cpp \
   SimplePhaseComparator.cpp
 
 HEADERS += 2rx_ad9361.h \
   AD9361SourcePage.h \
   AD9361SourcePageFactory.h \
+  AutoSaveWriter.h \
+  ChannelAligner.h \
+  ChannelCombiners.h \
+  ChannelPairEngine.h \
   CoherentChannelForwarder.h \
   CoherentDetector.h \
+  CoherentReplay.h \
+  DelayEstimator.h \
+  EventLogModel.h \
+  EventStore.h \
+  FractionalDelayFilter.h \
+  PairedChannelForwarder.h \
   PhaseComparator.h \
+  PhaseComparatorBank.h \
   PhaseComparatorFactory.h \
+  PhaseHistory.h \
+  PhasePrefixSums.h \
+  PhaseRecording.h \
+  PhasePyramid.h \
   PhasePlotPage.h \
   PhasePlotPageFactory.h \
   Polarimeter.h \
   PolarimeterFactory.h \
   PolarimetryPage.h \
   PolarimetryPageFactory.h \
+  PolyphaseChannelizer.h \
   RawChannelForwarder.h \
+  RecordingIndex.h \
+  SampleCodec.h \
+  SampleRing.h \
+  SharedChannelizer.h \
+  SigMFMetadata.h \
+  SignalKernels.h \
   SimplePhaseComparator.h
 
 INCLUDEPATH += $$SUWIDGETS_INSTALL_HEADERS $$SIGDIGGER_INSTALL_HEADERS
@@ -0,0 +1,645 @@
+//
+//    AutoSaveWriter.cpp: Asynchronous sample file writer
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "AutoSaveWriter.h"
+#include "SignalKernels.h"
+#include <QMutexLocker>
+#include <QRunnable>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+using namespace SigDigger;
+
+static bool
+writeAll(int fd, const char *data, size_t size)
+{
+  while (size > 0) {
+    ssize_t got = ::write(fd, data, size);
+
+    if (got < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+
+    data += got;
+    size -= static_cast<size_t>(got);
+  }
+
+  return true;
+}
+
+namespace {
+  class CompressTask : public QRunnable
+  {
+    const int16_t *m_samples;
+    size_t         m_count;
+    uint8_t       *m_out;
+    size_t        *m_size;
+
+  public:
+    CompressTask(
+        const int16_t *samples,
+        size_t count,
+        uint8_t *out,
+        size_t *size)
+      : m_samples(samples), m_count(count), m_out(out), m_size(size) {}
+
+    void
+    run() override
+    {
+      *m_size = SampleCodec::encode(m_out, m_samples, m_count);
+    }
+  };
+}
+
+AutoSaveWriter::AutoSaveWriter(
+    size_t bufferSize,
+    unsigned buffers,
+    QObject *parent)
+  : QObject(parent),
+    m_scheduled(false),
+    m_syncPolicy(AUTO_SAVE_SYNC_ON_CLOSE),
+    m_syncInterval(AUTO_SAVE_WRITER_DEFAULT_SYNC_INTERVAL),
+    m_written(0),
+    m_dropped(0),
+    m_freeBytes(std::numeric_limits<quint64>::max())
+{
+  // Direct I/O needs both the buffers and their sizes to be aligned
+  m_bufferSize = std::max<size_t>(
+        (bufferSize + AUTO_SAVE_WRITER_ALIGNMENT - 1)
+        / AUTO_SAVE_WRITER_ALIGNMENT * AUTO_SAVE_WRITER_ALIGNMENT,
+        AUTO_SAVE_WRITER_ALIGNMENT);
+
+  for (unsigned i = 0; i < buffers; ++i) {
+    void *mem = nullptr;
+
+    if (posix_memalign(&mem, AUTO_SAVE_WRITER_ALIGNMENT, m_bufferSize) == 0) {
+      m_buffers.push_back(static_cast<char *>(mem));
+      m_free.push_back(static_cast<char *>(mem));
+    }
+  }
+
+  m_clock.start();
+}
+
+AutoSaveWriter::~AutoSaveWriter()
+{
+  // The thread is gone by now: flush whatever it did not get to write
+  close();
+  process();
+
+  for (auto p : m_buffers)
+    free(p);
+}
+
+char *
+AutoSaveWriter::takeBuffer()
+{
+  QMutexLocker locker(&m_mutex);
+  char *buffer = nullptr;
+
+  if (!m_free.empty()) {
+    buffer = m_free.back();
+    m_free.pop_back();
+  }
+
+  return buffer;
+}
+
+AutoSaveWriter::File *
+AutoSaveWriter::newFile(QString const &path, quint64 preallocate)
+{
+  File *file = new File;
+
+  file->path        = path.toLocal8Bit();
+  file->preallocate = preallocate;
+  file->format      = m_format;
+  file->fullScale   = m_fullScale;
+
+  // Compressed blocks are not aligned
+  file->directIO    = m_directIO && m_format != AUTO_SAVE_FORMAT_ZCI16;
+
+  return file;
+}
+
+void
+AutoSaveWriter::submit(EntryType type, File *file, char *buffer, size_t size)
+{
+  {
+    QMutexLocker locker(&m_mutex);
+    m_queue.push_back(Entry {type, file, buffer, size});
+  }
+
+  if (!m_scheduled.exchange(true))
+    QMetaObject::invokeMethod(this, "process", Qt::QueuedConnection);
+}
+
+void
+AutoSaveWriter::flushCurrent(EntryType type)
+{
+  submit(type, m_file, m_current, m_used);
+
+  m_file    = nullptr;
+  m_current = nullptr;
+  m_used    = 0;
+}
+
+void
+AutoSaveWriter::setDirectIO(bool enabled)
+{
+  m_directIO = enabled;
+}
+
+void
+AutoSaveWriter::setSyncPolicy(AutoSaveSyncPolicy policy, int intervalMs)
+{
+  m_syncPolicy   = policy;
+  m_syncInterval = intervalMs;
+}
+
+void
+AutoSaveWriter::setFormat(AutoSaveFormat format, SUFLOAT fullScale)
+{
+  m_format    = format;
+  m_fullScale = fullScale > 0 ? fullScale : 1;
+}
+
+size_t
+AutoSaveWriter::sampleSize(AutoSaveFormat format)
+{
+  switch (format) {
+    case AUTO_SAVE_FORMAT_CI16:
+    case AUTO_SAVE_FORMAT_ZCI16:
+      return 2 * sizeof(int16_t);
+
+    case AUTO_SAVE_FORMAT_CF16:
+      return 2 * sizeof(uint16_t);
+
+    default:
+      return sizeof(SUCOMPLEX);
+  }
+}
+
+void
+AutoSaveWriter::open(QString const &path, quint64 preallocate)
+{
+  close();
+
+  m_file = newFile(path, preallocate);
+  submit(ENTRY_OPEN, m_file);
+
+  m_fileFormat = m_file->format;
+  m_fileScale  = m_file->fullScale;
+  m_fileBytes  = 0;
+
+  m_written = 0;
+  m_dropped = 0;
+}
+
+void
+AutoSaveWriter::prepare(QString const &path, quint64 preallocate)
+{
+  // An unused prepared file is removed, not left empty behind
+  if (m_next != nullptr)
+    submit(ENTRY_DISCARD, m_next);
+
+  m_next = newFile(path, preallocate);
+  submit(ENTRY_OPEN, m_next);
+}
+
+bool
+AutoSaveWriter::isOpen() const
+{
+  return m_file != nullptr;
+}
+
+bool
+AutoSaveWriter::havePrepared() const
+{
+  return m_next != nullptr;
+}
+
+bool
+AutoSaveWriter::rotate()
+{
+  if (m_file == nullptr || m_next == nullptr)
+    return false;
+
+  flushCurrent(ENTRY_CLOSE);
+
+  m_file = m_next;
+  m_next = nullptr;
+
+  m_fileFormat = m_file->format;
+  m_fileScale  = m_file->fullScale;
+  m_fileBytes  = 0;
+
+  // Drops are accounted per file (and happen in this thread only)
+  m_dropped = 0;
+
+  return true;
+}
+
+bool
+AutoSaveWriter::write(const void *data, size_t size)
+{
+  const char *p = static_cast<const char *>(data);
+
+  if (m_file == nullptr)
+    return false;
+
+  while (size > 0) {
+    size_t chunk;
+
+    if (m_current == nullptr && (m_current = takeBuffer()) == nullptr) {
+      // The writer thread cannot keep up
+      m_dropped += size;
+      return false;
+    }
+
+    chunk = std::min(size, m_bufferSize - m_used);
+    memcpy(m_current + m_used, p, chunk);
+
+    m_used      += chunk;
+    m_fileBytes += chunk;
+    p           += chunk;
+    size        -= chunk;
+
+    if (m_used == m_bufferSize) {
+      submit(ENTRY_DATA, m_file, m_current, m_used);
+      m_current = nullptr;
+      m_used    = 0;
+    }
+  }
+
+  return true;
+}
+
+bool
+AutoSaveWriter::writeSamples(const SUCOMPLEX *data, size_t count)
+{
+  size_t size = sampleSize(m_fileFormat);
+
+  if (m_fileFormat == AUTO_SAVE_FORMAT_NATIVE)
+    return write(data, count * size);
+
+  if (m_file == nullptr)
+    return false;
+
+  // Sample sizes divide the buffer size, so samples never straddle buffers
+  while (count > 0) {
+    size_t chunk;
+
+    if (m_current == nullptr && (m_current = takeBuffer()) == nullptr) {
+      m_dropped += count * size;
+      return false;
+    }
+
+    chunk = std::min(count, (m_bufferSize - m_used) / size);
+
+    if (m_fileFormat == AUTO_SAVE_FORMAT_CI16
+        || m_fileFormat == AUTO_SAVE_FORMAT_ZCI16)
+      quantizeInt16(
+            reinterpret_cast<int16_t *>(m_current + m_used),
+            data,
+            32767 / m_fileScale,
+            chunk);
+    else
+      quantizeHalf(
+            reinterpret_cast<uint16_t *>(m_current + m_used),
+            data,
+            1 / m_fileScale,
+            chunk);
+
+    m_used      += chunk * size;
+    m_fileBytes += chunk * size;
+    data        += chunk;
+    count       -= chunk;
+
+    if (m_used == m_bufferSize) {
+      submit(ENTRY_DATA, m_file, m_current, m_used);
+      m_current = nullptr;
+      m_used    = 0;
+    }
+  }
+
+  return true;
+}
+
+void
+AutoSaveWriter::close()
+{
+  if (m_next != nullptr) {
+    submit(ENTRY_DISCARD, m_next);
+    m_next = nullptr;
+  }
+
+  // The file belongs to the writer thread from now on
+  if (m_file != nullptr)
+    flushCurrent(ENTRY_CLOSE);
+}
+
+quint64
+AutoSaveWriter::writtenBytes() const
+{
+  return m_written;
+}
+
+quint64
+AutoSaveWriter::droppedBytes() const
+{
+  return m_dropped;
+}
+
+quint64
+AutoSaveWriter::fileBytes() const
+{
+  return m_fileBytes;
+}
+
+quint64
+AutoSaveWriter::freeBytes() const
+{
+  return m_freeBytes;
+}
+
+unsigned
+AutoSaveWriter::pendingBuffers()
+{
+  QMutexLocker locker(&m_mutex);
+
+  return static_cast<unsigned>(m_queue.size());
+}
+
+void
+AutoSaveWriter::refreshFreeBytes(File *file)
+{
+  struct statvfs st;
+
+  if (fstatvfs(file->fd, &st) == 0)
+    m_freeBytes = static_cast<quint64>(st.f_bavail) * st.f_frsize;
+
+  m_lastStatfs = m_clock.elapsed();
+}
+
+void
+AutoSaveWriter::start(File *file)
+{
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+#ifdef O_DIRECT
+  if (file->directIO) {
+    file->fd = ::open(file->path.constData(), flags | O_DIRECT, 0644);
+    file->direct = file->fd != -1;
+  }
+#endif // O_DIRECT
+
+  // Not all file systems support O_DIRECT. Fall back to the page cache.
+  if (file->fd == -1)
+    file->fd = ::open(file->path.constData(), flags, 0644);
+
+  if (file->fd == -1) {
+    file->failed = true;
+    emit error(
+          "Cannot open "
+          + QString::fromLocal8Bit(file->path)
+          + ": "
+          + QString(strerror(errno)));
+    return;
+  }
+
+  if (file->format == AUTO_SAVE_FORMAT_ZCI16) {
+    SampleCodecHeader header;
+
+    SampleCodec::header(header, file->fullScale);
+
+    if (!writeAll(
+          file->fd,
+          reinterpret_cast<const char *>(&header),
+          sizeof(SampleCodecHeader))) {
+      file->failed = true;
+      emit error(QString(strerror(errno)));
+      return;
+    }
+
+    file->size = sizeof(SampleCodecHeader);
+  }
+
+  refreshFreeBytes(file);
+
+  // Reserve the blocks now, so the file system does not have to find
+  // them while we write. The file size is left untouched, and whatever
+  // is not used is given back by the ftruncate() in finish().
+#ifdef FALLOC_FL_KEEP_SIZE
+  if (file->preallocate > 0)
+    fallocate(
+          file->fd,
+          FALLOC_FL_KEEP_SIZE,
+          0,
+          static_cast<off_t>(file->preallocate));
+#endif // FALLOC_FL_KEEP_SIZE
+
+  file->lastSync = m_clock.elapsed();
+}
+
+void
+AutoSaveWriter::writeEntry(Entry const &entry)
+{
+  File *file = entry.file;
+  const char *data = entry.buffer;
+  size_t size = entry.size;
+  size_t length = entry.size;
+
+  if (entry.size == 0 || file->failed)
+    return;
+
+  if (file->format == AUTO_SAVE_FORMAT_ZCI16) {
+    size = length = compress(file, entry.buffer, entry.size);
+    data = reinterpret_cast<const char *>(m_packed.data());
+  } else if (file->direct) {
+    // Only the last buffer of a file can be partial. Pad it, and let
+    // finish() truncate the file back to its actual size.
+    length = (length + AUTO_SAVE_WRITER_ALIGNMENT - 1)
+        / AUTO_SAVE_WRITER_ALIGNMENT * AUTO_SAVE_WRITER_ALIGNMENT;
+  }
+
+  if (!writeAll(file->fd, data, length)) {
+    file->failed = true;
+    emit error(QString(strerror(errno)));
+    return;
+  }
+
+  file->size += size;
+  m_written  += size;
+
+  if (m_syncPolicy == AUTO_SAVE_SYNC_PERIODIC
+      && m_clock.elapsed() - file->lastSync >= m_syncInterval) {
+    fdatasync(file->fd);
+    file->lastSync = m_clock.elapsed();
+  }
+
+  if (m_clock.elapsed() - m_lastStatfs >= AUTO_SAVE_WRITER_STATFS_INTERVAL)
+    refreshFreeBytes(file);
+}
+
+size_t
+AutoSaveWriter::compress(File *file, const char *buffer, size_t size)
+{
+  const int16_t *samples = reinterpret_cast<const int16_t *>(buffer);
+  size_t count  = size / sampleSize(AUTO_SAVE_FORMAT_ZCI16);
+  size_t blocks =
+      (count + SAMPLE_CODEC_BLOCK_SAMPLES - 1) / SAMPLE_CODEC_BLOCK_SAMPLES;
+  size_t slot   = sizeof(SampleCodecBlock)
+      + SampleCodec::bound(SAMPLE_CODEC_BLOCK_SAMPLES);
+  size_t length = 0;
+
+  if (m_packed.size() < blocks * slot)
+    m_packed.resize(blocks * slot);
+  m_packedSizes.resize(blocks);
+
+  // Every block goes to its own slot, right after room for its header
+  for (size_t i = 0; i < blocks; ++i) {
+    size_t first = i * SAMPLE_CODEC_BLOCK_SAMPLES;
+
+    m_compressors.start(
+          new CompressTask(
+            samples + 2 * first,
+            std::min<size_t>(SAMPLE_CODEC_BLOCK_SAMPLES, count - first),
+            m_packed.data() + i * slot + sizeof(SampleCodecBlock),
+            &m_packedSizes[i]));
+  }
+
+  m_compressors.waitForDone();
+
+  // Now pack them back to back. Blocks never grow past their slots, so
+  // they only ever move towards the beginning.
+  for (size_t i = 0; i < blocks; ++i) {
+    size_t first = i * SAMPLE_CODEC_BLOCK_SAMPLES;
+    SampleCodecBlock header;
+
+    SampleCodec::block(
+          header,
+          std::min<size_t>(SAMPLE_CODEC_BLOCK_SAMPLES, count - first),
+          m_packedSizes[i],
+          file->samples + first);
+
+    file->blocks.push_back(
+          SampleCodecIndexEntry {file->size + length, header.first});
+
+    memcpy(m_packed.data() + length, &header, sizeof(SampleCodecBlock));
+    memmove(
+          m_packed.data() + length + sizeof(SampleCodecBlock),
+          m_packed.data() + i * slot + sizeof(SampleCodecBlock),
+          m_packedSizes[i]);
+
+    length += sizeof(SampleCodecBlock) + m_packedSizes[i];
+  }
+
+  file->samples += count;
+
+  return length;
+}
+
+bool
+AutoSaveWriter::writeBlockIndex(File *file)
+{
+  SampleCodecTrailer trailer;
+  size_t size = file->blocks.size() * sizeof(SampleCodecIndexEntry);
+
+  SampleCodec::trailer(trailer, file->blocks.size(), file->size);
+
+  if (!writeAll(
+        file->fd,
+        reinterpret_cast<const char *>(file->blocks.data()),
+        size)
+      || !writeAll(
+        file->fd,
+        reinterpret_cast<const char *>(&trailer),
+        sizeof(SampleCodecTrailer)))
+    return false;
+
+  file->size += size + sizeof(SampleCodecTrailer);
+
+  return true;
+}
+
+void
+AutoSaveWriter::finish(File *file, bool discard)
+{
+  if (file->fd != -1) {
+    if (discard) {
+      unlink(file->path.constData());
+    } else if (!file->failed) {
+      if (file->format == AUTO_SAVE_FORMAT_ZCI16 && !writeBlockIndex(file))
+        emit error(QString(strerror(errno)));
+
+      if ((file->direct || file->preallocate > 0)
+          && ftruncate(file->fd, static_cast<off_t>(file->size)) == -1)
+        emit error(QString(strerror(errno)));
+
+      if (m_syncPolicy != AUTO_SAVE_SYNC_NEVER)
+        fdatasync(file->fd);
+    }
+
+    ::close(file->fd);
+  }
+
+  delete file;
+}
+
+///////////////////////////////// Slots ////////////////////////////////////////
+void
+AutoSaveWriter::process()
+{
+  Entry entry;
+
+  m_scheduled = false;
+
+  for (;;) {
+    {
+      QMutexLocker locker(&m_mutex);
+
+      if (m_queue.empty())
+        break;
+
+      entry = m_queue.front();
+      m_queue.pop_front();
+    }
+
+    if (entry.type == ENTRY_OPEN)
+      start(entry.file);
+    else
+      writeEntry(entry);
+
+    if (entry.buffer != nullptr) {
+      QMutexLocker locker(&m_mutex);
+      m_free.push_back(entry.buffer);
+    }
+
+    if (entry.type == ENTRY_CLOSE || entry.type == ENTRY_DISCARD)
+      finish(entry.file, entry.type == ENTRY_DISCARD);
+  }
+}
@@ -0,0 +1,214 @@
+//
+//    AutoSaveWriter.h: Asynchronous sample file writer
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef AUTOSAVEWRITER_H
+#define AUTOSAVEWRITER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <sigutils/types.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "SampleCodec.h"
+
+#define AUTO_SAVE_WRITER_DEFAULT_BUFFER_SIZE   (4 << 20)
+#define AUTO_SAVE_WRITER_DEFAULT_BUFFERS       16
+#define AUTO_SAVE_WRITER_DEFAULT_SYNC_INTERVAL 5000 // ms
+#define AUTO_SAVE_WRITER_ALIGNMENT             4096
+#define AUTO_SAVE_WRITER_STATFS_INTERVAL       1000 // ms
+
+//
+// Writes a stream of bytes to a file from its own thread. The producer
+// copies its data into large, page-aligned buffers taken from a fixed
+// pool, and full buffers are queued to the writer thread. write() never
+// blocks: if the disk falls behind and the pool runs dry, the data is
+// dropped and accounted for in droppedBytes().
+//
+// open(), write() and close() are meant to be called from the producer
+// thread only, and process() runs in the thread the writer lives in.
+// Files are opened, preallocated, closed and synced (depending on the
+// policy) by the writer thread too, in the same order as the data. In
+// particular, prepare() lets the writer open the next file ahead of time,
+// so rotate() only needs to queue a marker. Open errors are reported
+// through error() like any other.
+//
+// The writer thread also keeps track of the free space left in the file
+// system of the current file, so the producer can stop before it fills.
+//
+// Samples passed to writeSamples() are stored in the format selected at
+// open() time. Quantized formats are converted straight into the pool
+// buffers: ci16 maps fullScale to 32767, and cf16 stores the samples
+// divided by fullScale.
+//
+// Compressed ci16 (zci16) is quantized like ci16 by the producer. The
+// writer thread then splits every buffer in SampleCodec blocks, has them
+// compressed by a pool of threads and writes them in order, followed by
+// the block index when the file is closed. Compressed files are never
+// written with direct I/O (blocks are not aligned), and their offsets as
+// seen by the producer (see fileBytes()) are those of the ci16 stream.
+//
+
+namespace SigDigger {
+  enum AutoSaveSyncPolicy {
+    AUTO_SAVE_SYNC_NEVER,
+    AUTO_SAVE_SYNC_ON_CLOSE,
+    AUTO_SAVE_SYNC_PERIODIC
+  };
+
+  enum AutoSaveFormat {
+    AUTO_SAVE_FORMAT_NATIVE, // SUCOMPLEX, as is
+    AUTO_SAVE_FORMAT_CI16,
+    AUTO_SAVE_FORMAT_CF16,
+    AUTO_SAVE_FORMAT_ZCI16   // ci16, compressed (see SampleCodec)
+  };
+
+  class AutoSaveWriter : public QObject
+  {
+    Q_OBJECT
+
+    enum EntryType {
+      ENTRY_DATA,
+      ENTRY_OPEN,
+      ENTRY_CLOSE,
+      ENTRY_DISCARD
+    };
+
+    struct File {
+      QByteArray     path;
+      quint64        preallocate = 0;
+      AutoSaveFormat format      = AUTO_SAVE_FORMAT_NATIVE;
+      SUFLOAT        fullScale   = 1;
+      bool           directIO    = false;
+      int            fd          = -1;
+      bool           direct      = false;
+      bool           failed      = false;
+      quint64        size        = 0;
+      qint64         lastSync    = 0;
+
+      // Compressed files
+      quint64        samples     = 0;
+      std::vector<SampleCodecIndexEntry> blocks;
+    };
+
+    struct Entry {
+      EntryType type;
+      File     *file;
+      char     *buffer;
+      size_t    size;
+    };
+
+    size_t               m_bufferSize;
+    std::vector<char *>  m_buffers;
+    bool                 m_directIO  = false;
+    AutoSaveFormat       m_format    = AUTO_SAVE_FORMAT_NATIVE;
+    SUFLOAT              m_fullScale = 1;
+
+    // Producer side
+    File                *m_file       = nullptr;
+    File                *m_next       = nullptr;
+    AutoSaveFormat       m_fileFormat = AUTO_SAVE_FORMAT_NATIVE;
+    SUFLOAT              m_fileScale  = 1;
+    char                *m_current    = nullptr;
+    size_t               m_used       = 0;
+    quint64              m_fileBytes  = 0;
+
+    // Shared
+    QMutex               m_mutex;
+    std::deque<Entry>    m_queue;
+    std::vector<char *>  m_free;
+    std::atomic<bool>    m_scheduled;
+    std::atomic<int>     m_syncPolicy;
+    std::atomic<int>     m_syncInterval;
+    std::atomic<quint64> m_written;
+    std::atomic<quint64> m_dropped;
+    std::atomic<quint64> m_freeBytes;
+
+    // Writer side
+    QElapsedTimer        m_clock;
+    qint64               m_lastStatfs = 0;
+    QThreadPool          m_compressors;
+    std::vector<uint8_t> m_packed;
+    std::vector<size_t>  m_packedSizes;
+
+    char  *takeBuffer();
+    File  *newFile(QString const &, quint64);
+    void   submit(EntryType, File *, char *buffer = nullptr, size_t size = 0);
+    void   flushCurrent(EntryType);
+    void   start(File *);
+    void   writeEntry(Entry const &);
+    size_t compress(File *, const char *buffer, size_t size);
+    bool   writeBlockIndex(File *);
+    void   finish(File *, bool discard);
+    void   refreshFreeBytes(File *);
+
+  public:
+    explicit AutoSaveWriter(
+        size_t bufferSize = AUTO_SAVE_WRITER_DEFAULT_BUFFER_SIZE,
+        unsigned buffers = AUTO_SAVE_WRITER_DEFAULT_BUFFERS,
+        QObject *parent = nullptr);
+    ~AutoSaveWriter() override;
+
+    // Bypass the page cache, if the file system allows it
+    void     setDirectIO(bool);
+
+    // Both take effect on the next open() or prepare()
+    void     setFormat(AutoSaveFormat, SUFLOAT fullScale = 1);
+    static size_t sampleSize(AutoSaveFormat);
+    void     setSyncPolicy(
+        AutoSaveSyncPolicy,
+        int intervalMs = AUTO_SAVE_WRITER_DEFAULT_SYNC_INTERVAL);
+
+    // Files are preallocated (without changing their size) if asked to
+    void     open(QString const &path, quint64 preallocate = 0);
+    void     prepare(QString const &path, quint64 preallocate = 0);
+    bool     isOpen() const;
+    bool     havePrepared() const;
+
+    // Close the current file and continue in the prepared one
+    bool     rotate();
+    bool     write(const void *, size_t);
+    bool     writeSamples(const SUCOMPLEX *, size_t);
+    void     close();
+
+    quint64  writtenBytes() const;
+
+    // Bytes dropped from the current file, i.e. since the last open() or
+    // rotate() (producer side)
+    quint64  droppedBytes() const;
+
+    // Bytes accepted for the current file so far, i.e. the offset the
+    // next write() lands at (producer side)
+    quint64  fileBytes() const;
+
+    // Free space in the file system of the last file opened
+    quint64  freeBytes() const;
+    unsigned pendingBuffers();
+
+  public slots:
+    void process();
+
+  signals:
+    void error(QString);
+  };
+}
+
+#endif // AUTOSAVEWRITER_H
@@ -0,0 +1,185 @@
+//
+//    ChannelAligner.cpp: Inter-channel delay estimation and compensation
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "ChannelAligner.h"
+#include "DelayEstimator.h"
+#include <algorithm>
+
+using namespace SigDigger;
+
+ChannelAligner::ChannelAligner(QObject *parent) : QObject(parent)
+{
+  m_estimator = new DelayEstimator();
+  m_thread    = new QThread(this);
+
+  m_stageLo.resize(m_estimator->size());
+  m_stageHi.resize(m_estimator->size());
+
+  m_estimator->moveToThread(m_thread);
+
+  connect(
+        m_estimator,
+        SIGNAL(delayEstimated(qreal, qreal)),
+        this,
+        SLOT(onDelayEstimated(qreal, qreal)));
+
+  m_thread->start();
+}
+
+ChannelAligner::~ChannelAligner()
+{
+  m_thread->quit();
+  m_thread->wait();
+
+  delete m_estimator;
+}
+
+void
+ChannelAligner::applyDelay()
+{
+  qreal center = m_loFilter.centerDelay();
+
+  m_loFilter.setDelay(static_cast<SUFLOAT>(center + .5 * m_delay));
+  m_hiFilter.setDelay(static_cast<SUFLOAT>(center - .5 * m_delay));
+}
+
+void
+ChannelAligner::stage(const SUCOMPLEX *lo, const SUCOMPLEX *hi, size_t size)
+{
+  size_t p = 0, chunk;
+
+  while (p < size) {
+    chunk = std::min(size - p, m_stageLo.size() - m_staged);
+
+    std::copy(lo + p, lo + p + chunk, m_stageLo.begin() + m_staged);
+    std::copy(hi + p, hi + p + chunk, m_stageHi.begin() + m_staged);
+
+    m_staged += chunk;
+    p        += chunk;
+
+    // If the estimator is still busy, this block is just dropped
+    if (m_staged == m_stageLo.size()) {
+      m_estimator->submit(m_stageLo.data(), m_stageHi.data());
+      m_staged = 0;
+    }
+  }
+}
+
+void
+ChannelAligner::setEstimationEnabled(bool enabled)
+{
+  if (m_estimate != enabled) {
+    m_estimate = enabled;
+    m_staged   = 0;
+    m_estimator->reset();
+  }
+}
+
+bool
+ChannelAligner::estimationEnabled() const
+{
+  return m_estimate;
+}
+
+void
+ChannelAligner::setCompensationEnabled(bool enabled)
+{
+  if (m_compensate != enabled) {
+    m_compensate = enabled;
+    m_loFilter.reset();
+    m_hiFilter.reset();
+  }
+}
+
+bool
+ChannelAligner::compensationEnabled() const
+{
+  return m_compensate;
+}
+
+void
+ChannelAligner::setDelay(qreal delay)
+{
+  m_delay     = qBound(-maxDelay(), delay, maxDelay());
+  m_haveDelay = true;
+
+  applyDelay();
+
+  emit delayChanged(m_delay);
+}
+
+qreal
+ChannelAligner::delay() const
+{
+  return m_delay;
+}
+
+qreal
+ChannelAligner::maxDelay() const
+{
+  return 2 * static_cast<qreal>(m_loFilter.centerDelay());
+}
+
+qreal
+ChannelAligner::latency() const
+{
+  return m_compensate ? static_cast<qreal>(m_loFilter.centerDelay()) : 0;
+}
+
+void
+ChannelAligner::reset()
+{
+  m_staged    = 0;
+  m_haveDelay = false;
+  m_delay     = 0;
+
+  m_estimator->reset();
+  m_loFilter.reset();
+  m_hiFilter.reset();
+
+  applyDelay();
+}
+
+void
+ChannelAligner::process(
+    const SUCOMPLEX *&lo,
+    const SUCOMPLEX *&hi,
+    size_t size)
+{
+  if (m_estimate)
+    stage(lo, hi, size);
+
+  if (m_compensate) {
+    lo = m_loFilter.feed(lo, size);
+    hi = m_hiFilter.feed(hi, size);
+  }
+}
+
+///////////////////////////////// Slots ////////////////////////////////////////
+void
+ChannelAligner::onDelayEstimated(qreal delay, qreal quality)
+{
+  if (!m_estimate || quality < CHANNEL_ALIGNER_MIN_QUALITY)
+    return;
+
+  if (m_haveDelay)
+    delay = m_delay + CHANNEL_ALIGNER_ALPHA * (delay - m_delay);
+
+  setDelay(delay);
+}
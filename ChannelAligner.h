@@ -0,0 +1,96 @@
+//
+//    ChannelAligner.h: Inter-channel delay estimation and compensation
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef CHANNELALIGNER_H
+#define CHANNELALIGNER_H
+
+#include <QObject>
+#include <QThread>
+#include "FractionalDelayFilter.h"
+
+// Estimates with a lower peak-to-mean ratio are discarded as ambiguous
+#define CHANNEL_ALIGNER_MIN_QUALITY 8.
+#define CHANNEL_ALIGNER_ALPHA       .25
+
+//
+// The channel aligner sits between the two synchronous forwarders and
+// whatever combines them. It forwards blocks of both channels to a
+// DelayEstimator running in its own thread and, if compensation is
+// enabled, runs both channels through fractional delay filters so that
+// their differential delay is cancelled. Both filters share the same
+// nominal delay (the center of the filter) and the differential delay is
+// split symmetrically between them.
+//
+
+namespace SigDigger {
+  class DelayEstimator;
+
+  class ChannelAligner : public QObject
+  {
+    Q_OBJECT
+
+    QThread               *m_thread    = nullptr;
+    DelayEstimator        *m_estimator = nullptr;
+
+    FractionalDelayFilter  m_loFilter;
+    FractionalDelayFilter  m_hiFilter;
+
+    std::vector<SUCOMPLEX> m_stageLo;
+    std::vector<SUCOMPLEX> m_stageHi;
+    size_t                 m_staged = 0;
+
+    bool                   m_estimate   = false;
+    bool                   m_compensate = false;
+    bool                   m_haveDelay  = false;
+    qreal                  m_delay      = 0;
+
+    void applyDelay();
+    void stage(const SUCOMPLEX *lo, const SUCOMPLEX *hi, size_t size);
+
+  public:
+    explicit ChannelAligner(QObject *parent = nullptr);
+    ~ChannelAligner() override;
+
+    void  setEstimationEnabled(bool);
+    bool  estimationEnabled() const;
+
+    void  setCompensationEnabled(bool);
+    bool  compensationEnabled() const;
+
+    void  setDelay(qreal);
+    qreal delay() const;
+    qreal maxDelay() const;
+
+    // Samples by which process() delays its output (0 if not compensating)
+    qreal latency() const;
+
+    void  reset();
+
+    // May replace lo and hi by pointers to the compensated samples
+    void  process(const SUCOMPLEX *&lo, const SUCOMPLEX *&hi, size_t size);
+
+  public slots:
+    void onDelayEstimated(qreal, qreal);
+
+  signals:
+    void delayChanged(qreal);
+  };
+}
+
+#endif // CHANNELALIGNER_H
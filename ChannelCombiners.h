@@ -0,0 +1,133 @@
+//
+//    ChannelCombiners.h: Combiner policies for ChannelPairEngine
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef CHANNELCOMBINERS_H
+#define CHANNELCOMBINERS_H
+
+#include <sigutils/types.h>
+#include <vector>
+#include "SignalKernels.h"
+
+//
+// A combiner policy is any class providing:
+//
+//   void   reset();
+//   bool   feed(const SUCOMPLEX *lo, const SUCOMPLEX *hi, size_t size);
+//   size_t carried() const;
+//
+// feed() receives each aligned pair of blocks and returns true when new
+// output is available. carried() tells how many input samples fed so far
+// went into the first output of the next feed(), so the output can be
+// timed after its input. The policies below are all header-inlined so that
+// ChannelPairEngine can expand them inside its pairing step.
+//
+
+namespace SigDigger {
+  // lo * conj(-hi), optionally integrated and dumped
+  class CrossProductCombiner
+  {
+    CrossProductIntegrator m_integrator;
+    std::vector<SUCOMPLEX> m_output;
+
+  public:
+    inline void
+    reset()
+    {
+      m_integrator.reset();
+      m_output.clear();
+    }
+
+    inline bool
+    feed(const SUCOMPLEX *lo, const SUCOMPLEX *hi, size_t size)
+    {
+      m_output.resize(m_integrator.maxOutput(size));
+      m_output.resize(m_integrator.feed(m_output.data(), lo, hi, size));
+
+      return !m_output.empty();
+    }
+
+    inline size_t
+    carried() const
+    {
+      return m_integrator.pending();
+    }
+
+    inline void
+    setIntegration(unsigned samples)
+    {
+      m_integrator.setDecimation(samples);
+    }
+
+    inline unsigned
+    integration() const
+    {
+      return m_integrator.decimation();
+    }
+
+    inline const std::vector<SUCOMPLEX> &
+    data() const
+    {
+      return m_output;
+    }
+  };
+
+  // Both channels, untouched
+  class PassThroughPairCombiner
+  {
+    std::vector<SUCOMPLEX> m_lo;
+    std::vector<SUCOMPLEX> m_hi;
+
+  public:
+    inline void
+    reset()
+    {
+      m_lo.clear();
+      m_hi.clear();
+    }
+
+    inline bool
+    feed(const SUCOMPLEX *lo, const SUCOMPLEX *hi, size_t size)
+    {
+      m_lo.assign(lo, lo + size);
+      m_hi.assign(hi, hi + size);
+
+      return size > 0;
+    }
+
+    inline size_t
+    carried() const
+    {
+      return 0;
+    }
+
+    inline const std::vector<SUCOMPLEX> &
+    loData() const
+    {
+      return m_lo;
+    }
+
+    inline const std::vector<SUCOMPLEX> &
+    hiData() const
+    {
+      return m_hi;
+    }
+  };
+}
+
+#endif // CHANNELCOMBINERS_H
@@ -0,0 +1,81 @@
+//
+//    ChannelPairEngine.h: Policy-based LO/HI pairing engine
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef CHANNELPAIRENGINE_H
+#define CHANNELPAIRENGINE_H
+
+#include "PairedChannelForwarder.h"
+#include "ChannelCombiners.h"
+
+//
+// All channel pairing logic (opening, closing, offset calculation, state
+// tracking, alignment) lives in PairedChannelForwarder. This template
+// only binds it to a combiner policy, whose feed() is called directly
+// (and hence inlined) once per aligned pair of blocks.
+//
+// Signals and slots are inherited from PairedChannelForwarder, so
+// instances can be connected with the usual SIGNAL() / SLOT() syntax.
+//
+
+namespace SigDigger {
+  template <class Combiner>
+  class ChannelPairEngine : public PairedChannelForwarder
+  {
+    Combiner m_combiner;
+
+  protected:
+    bool
+    combine(const SUCOMPLEX *lo, const SUCOMPLEX *hi, size_t size) override
+    {
+      return m_combiner.feed(lo, hi, size);
+    }
+
+    void
+    resetCombiner() override
+    {
+      m_combiner.reset();
+    }
+
+    size_t
+    combinerCarry() const override
+    {
+      return m_combiner.carried();
+    }
+
+  public:
+    explicit ChannelPairEngine(UIMediator *mediator, QObject *parent = nullptr)
+      : PairedChannelForwarder(mediator, parent)
+    {
+    }
+
+    Combiner &
+    combiner()
+    {
+      return m_combiner;
+    }
+
+    const Combiner &
+    combiner() const
+    {
+      return m_combiner;
+    }
+  };
+}
+
+#endif // CHANNELPAIRENGINE_H
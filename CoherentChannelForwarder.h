@@ -19,71 +19,17 @@
 #ifndef CoherentChannelForwarder_H
 #define CoherentChannelForwarder_H
 
-#include <QObject>
-#include "RawChannelForwarder.h"
+#include "ChannelPairEngine.h"
 
 namespace SigDigger {
-  class CoherentChannelForwarder : public QObject
+  class CoherentChannelForwarder
+      : public ChannelPairEngine<PassThroughPairCombiner>
   {
-    Q_OBJECT
-
-    Suscan::Analyzer    *m_analyzer = nullptr;
-    UIMediator          *m_mediator    = nullptr;
-
-    RawChannelForwarder *m_forwarder_lo = nullptr;
-    RawChannelForwarder *m_forwarder_hi = nullptr;
-
-    qreal               m_desiredBandwidth = 0;
-    qreal               m_desiredFrequency = 0;
-    std::vector<SUCOMPLEX> m_lastHiBuffer;
-    std::vector<SUCOMPLEX> m_lastLoBuffer;
-
-    bool m_hiRunning = false;
-    bool m_loRunning = false;
-
-    bool m_hiAvail = false;
-    bool m_loAvail = false;
-
-    void connectAll();
-    bool calcOffsetFrequencies(qreal freq, qreal &off1, qreal &off2);
-
   public:
     CoherentChannelForwarder(UIMediator *, QObject *parent = nullptr);
-    virtual ~CoherentChannelForwarder() override;
 
     const std::vector<SUCOMPLEX> &hiData() const;
     const std::vector<SUCOMPLEX> &loData() const;
-
-    void  setAnalyzer(Suscan::Analyzer *);
-    void  setFFTSizeHint(unsigned int);
-
-    bool  open(SUFREQ, SUFLOAT);
-    bool  isRunning() const;
-    bool  close();
-
-    qreal setBandwidth(qreal bandwidth);
-    void  setFrequency(qreal freq);
-    qreal getFrequency() const;
-
-    qreal getFrequencyLo() const;
-    qreal getFrequencyHi() const;
-
-    qreal getMinBandwidth() const;
-    qreal getMaxBandwidth() const;
-    qreal getTrueBandwidth() const;
-    qreal getEquivFs() const;
-    unsigned getDecimation() const;
-
-  public slots:
-    void onStateChanged(int, QString const &);
-    void onDataAvailable();
-
-  signals:
-    void stateChanged(int, int, QString);
-    void error(QString);
-    void opened();
-    void closed();
-    void dataAvailable();
   };
 }
 
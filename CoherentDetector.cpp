@@ -18,11 +18,13 @@
 //
 
 #include "CoherentDetector.h"
-#include <sys/time.h>
+#include "SignalKernels.h"
+#include <algorithm>
 
 using namespace SigDigger;
 
 CoherentDetector::CoherentDetector()
+  : m_lastEvent(), m_metric(COHERENT_DETECTOR_BLOCK_SIZE)
 {
 
 }
@@ -68,73 +70,108 @@ CoherentDetector::setHoldMax(size_t hold)
   m_holdMax = hold;
 }
 
-size_t
-CoherentDetector::feed(const SUCOMPLEX *data, size_t size)
+//
+// Runs the trigger logic over samples whose filtered metric is already in
+// m_metric. Untriggered, we just look for the first signaled sample.
+// Triggered, we look for the end of the hold period, and accumulate the
+// whole span at once.
+//
+void
+CoherentDetector::scan(
+    const SUCOMPLEX *data,
+    size_t size,
+    size_t offset,
+    SUSCOUNT position,
+    std::vector<CoherentTransition> &transitions)
 {
-  size_t i;
-
-  SUCOMPLEX iq;
-  SUCOMPLEX prev = m_prev;
-  SUFLOAT   detSig = m_detSig;
-  bool      signaled;
-  SUFLOAT   angle;
-  bool      searching = true;
-
-  for (i = 0; i < size && searching; ++i) {
-    iq = data[i];
-
-    angle = SU_C_ARG(iq * SU_C_CONJ(prev));
-    if (isinf(angle) || isnan(angle))
-      angle = 0;
-
-    SU_SPLPF_FEED(detSig, angle * angle, m_alpha);
-    signaled = detSig < m_threshold2;
-
-    if (m_triggered) {
-      // Triggered! Accumulate signal data
-      m_iqAcc  += iq;
-      m_pwrAcc += SU_C_REAL(iq * SU_C_CONJ(iq));
-      ++m_count;
-
-      if (!signaled) {
-        if (++m_holdCntr > m_holdMax) {
-          // EVENT!
-          m_lastEvent.length    = m_count - m_holdCntr - 1;
-          m_lastEvent.meanPhase = SU_C_ARG(m_iqAcc);
-          m_lastEvent.meanPower = m_pwrAcc / m_count;
-
-          m_lastEvent.aoa[0]    = SU_ASIN(m_lastEvent.meanPhase / m_dipPhase);
-          m_lastEvent.aoa[1]    = M_PI - m_lastEvent.aoa[0];
-          m_haveEvent = true;
-
-          m_triggered = false;
-          searching   = false;
+  const SUFLOAT *metric = m_metric.data();
+  size_t i = 0;
+
+  while (i < size) {
+    if (!m_triggered) {
+      while (i < size && !(metric[i] < m_threshold2))
+        ++i;
+
+      if (i == size)
+        break;
+
+      m_lastEvent.start = position + offset + i;
+
+      m_iqAcc     = data[i];
+      m_count     = 1;
+      m_pwrAcc    = SU_C_REAL(data[i] * SU_C_CONJ(data[i]));
+      m_holdCntr  = 0;
+      m_triggered = true;
+
+      transitions.push_back(
+            CoherentTransition {offset + i, true, m_lastEvent});
+      ++i;
+    } else {
+      size_t from = i;
+      bool   ended = false;
+
+      for (; i < size; ++i) {
+        if (metric[i] < m_threshold2) {
+          // Signal present: reset hold counter
+          m_holdCntr = 0;
+        } else if (++m_holdCntr > m_holdMax) {
+          ended = true;
+          break;
         }
-      } else {
-        // Signal present: reset hold counter
-        m_holdCntr = 0;
       }
-    } else {
-      // Non triggered
-      if (signaled) {
-        // But triggered now
-        gettimeofday(&m_lastEvent.timeStamp, nullptr);
-        m_iqAcc     = iq;
-        m_count     = 1;
-        m_pwrAcc    = SU_C_REAL(iq * SU_C_CONJ(iq));
-        m_holdCntr  = 0;
-        m_triggered = true;
-        searching   = false;
+
+      // The sample that ends the event is still part of it
+      if (ended)
+        ++i;
+
+      for (size_t j = from; j < i; ++j)
+        m_iqAcc += data[j];
+      m_pwrAcc += powerSum(data + from, i - from);
+      m_count  += i - from;
+
+      if (ended) {
+        m_lastEvent.end       = position + offset + i - 1;
+        m_lastEvent.length    = m_count - m_holdCntr - 1;
+        m_lastEvent.meanPhase = SU_C_ARG(m_iqAcc);
+        m_lastEvent.meanPower = m_pwrAcc / m_count;
+
+        m_lastEvent.aoa[0]    = SU_ASIN(m_lastEvent.meanPhase / m_dipPhase);
+        m_lastEvent.aoa[1]    = M_PI - m_lastEvent.aoa[0];
+        m_haveEvent = true;
+        m_triggered = false;
+
+        transitions.push_back(
+              CoherentTransition {offset + i - 1, false, m_lastEvent});
       }
     }
-
-    prev = iq;
   }
+}
 
-  m_prev      = prev;
-  m_detSig    = detSig;
+size_t
+CoherentDetector::detect(
+    const SUCOMPLEX *data,
+    size_t size,
+    SUSCOUNT position,
+    std::vector<CoherentTransition> &transitions)
+{
+  transitions.clear();
+
+  for (size_t p = 0; p < size; p += COHERENT_DETECTOR_BLOCK_SIZE) {
+    size_t count = std::min<size_t>(COHERENT_DETECTOR_BLOCK_SIZE, size - p);
+    SUFLOAT *metric = m_metric.data();
+
+    phaseIncrement(metric, data + p, m_prev, count);
+
+    for (size_t i = 0; i < count; ++i)
+      metric[i] *= metric[i];
+
+    m_detSig = singlePoleFilter(metric, metric, m_alpha, m_detSig, count);
+    m_prev   = data[p + count - 1];
+
+    scan(data + p, count, p, position, transitions);
+  }
 
-  return i;
+  return transitions.size();
 }
 
 CoherentEvent
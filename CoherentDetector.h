@@ -21,8 +21,11 @@
 #define COHERENTDETECTOR_H
 
 #include <sigutils/types.h>
+#include <sys/time.h>
 #include <vector>
 
+#define COHERENT_DETECTOR_BLOCK_SIZE 4096
+
 //
 // The coherent detector works as follows:
 // 1. Constantly demodulate the signal in FM, using arg(x[n] * conj(x[n-1]))
@@ -32,16 +35,37 @@
 //    the phase coherence.
 // 3. Compare this division against the threshold.
 //
+// In practice, the accumulator is a single pole low pass filter of the
+// squared phase increments. Both are computed for up to
+// COHERENT_DETECTOR_BLOCK_SIZE samples at a time with the vectorized
+// kernels (see phaseIncrement() and singlePoleFilter()), and only then the
+// trigger logic walks the result. detect() goes through the whole block
+// and reports every state change in it.
+//
+// Events are located by the absolute indices of their first and last
+// samples, given the index of the first sample of every block. The
+// detector does not know when the samples were captured, so timeStamp is
+// left to the caller (e.g. PhaseRecording::sampleTime() on the start of
+// the block and event.start - position).
+//
 
 namespace SigDigger {
   struct CoherentEvent {
     struct timeval timeStamp;
+    SUSCOUNT start;  // First sample (absolute)
+    SUSCOUNT end;    // Sample that ended the event (absolute)
     SUSCOUNT length;
     SUFLOAT  meanPhase;
     SUFLOAT  meanPower;
     SUFLOAT  aoa[2];
   };
 
+  struct CoherentTransition {
+    size_t        offset;    // Sample of the block where the state changed
+    bool          triggered; // State from that sample on
+    CoherentEvent event;     // The event that just ended, if !triggered
+  };
+
   class CoherentDetector
   {
     SUSCOUNT  m_holdMax    = 0;
@@ -60,6 +84,14 @@ namespace SigDigger {
     bool      m_haveEvent = false;
 
     CoherentEvent m_lastEvent;
+    std::vector<SUFLOAT> m_metric;
+
+    void scan(
+        const SUCOMPLEX *,
+        size_t,
+        size_t offset,
+        SUSCOUNT position,
+        std::vector<CoherentTransition> &);
 
   public:
     CoherentDetector();
@@ -71,7 +103,14 @@ namespace SigDigger {
     void setHoldMax(size_t);
     void setThreshold(float); // In radians, always
 
-    size_t feed(const SUCOMPLEX *, size_t);
+    // Leaves the state changes the block goes through in `transitions`
+    // (which is cleared first) and returns how many there were. `position`
+    // is the absolute index of the first sample of the block
+    size_t detect(
+        const SUCOMPLEX *,
+        size_t,
+        SUSCOUNT position,
+        std::vector<CoherentTransition> &transitions);
     bool  triggered() const;
     CoherentEvent lastEvent();
     bool  haveEvent() const;
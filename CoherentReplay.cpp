@@ -0,0 +1,230 @@
+//
+//    CoherentReplay.cpp: Offline coherent event detection over recordings
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "CoherentReplay.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace SigDigger;
+
+CoherentReplay::CoherentReplay(QObject *parent) :
+  QObject(parent),
+  m_cancelled(false),
+  m_processed(0)
+{
+}
+
+bool
+CoherentReplay::open(QString const &path)
+{
+  m_events.clear();
+
+  return m_recording.open(path);
+}
+
+void
+CoherentReplay::close()
+{
+  m_events.clear();
+  m_recording.close();
+}
+
+PhaseRecording const &
+CoherentReplay::recording() const
+{
+  return m_recording;
+}
+
+void
+CoherentReplay::setDetector(
+    SUSCOUNT size,
+    SUSCOUNT holdMax,
+    SUFLOAT threshold,
+    SUFLOAT dipolePhase)
+{
+  m_size        = size;
+  m_holdMax     = holdMax;
+  m_threshold   = threshold;
+  m_dipolePhase = dipolePhase;
+}
+
+void
+CoherentReplay::setThreads(unsigned threads)
+{
+  m_threads = threads;
+}
+
+void
+CoherentReplay::cancel()
+{
+  m_cancelled = true;
+}
+
+std::vector<CoherentReplayEvent> const &
+CoherentReplay::events() const
+{
+  return m_events;
+}
+
+SUSCOUNT
+CoherentReplay::overlap() const
+{
+  return COHERENT_REPLAY_WARMUP * m_size + m_holdMax;
+}
+
+std::vector<CoherentReplayChunk>
+CoherentReplay::split(unsigned chunks) const
+{
+  SUSCOUNT total = m_recording.size();
+  SUSCOUNT chunkSize;
+  std::vector<CoherentReplayChunk> result;
+
+  // Short recordings are not worth scanning their overlaps many times
+  chunks = static_cast<unsigned>(
+        std::max<SUSCOUNT>(
+          1,
+          std::min<SUSCOUNT>(
+            chunks,
+            total / (COHERENT_REPLAY_MIN_CHUNK_RATIO
+                     * std::max<SUSCOUNT>(1, overlap())))));
+
+  chunkSize = (total + chunks - 1) / chunks;
+  result.resize(chunks);
+
+  for (unsigned i = 0; i < chunks; ++i) {
+    result[i].begin = std::min(total, i * chunkSize);
+    result[i].end   = std::min(total, (i + 1) * chunkSize);
+  }
+
+  return result;
+}
+
+void
+CoherentReplay::scan(CoherentReplayChunk &chunk)
+{
+  CoherentDetector detector;
+  std::vector<SUCOMPLEX> buffer(COHERENT_REPLAY_BLOCK_SIZE);
+  std::vector<CoherentTransition> transitions;
+  SUSCOUNT total = m_recording.size();
+  SUSCOUNT pos, start = 0;
+  bool triggered = false;
+
+  detector.resize(m_size);
+  detector.setHoldMax(m_holdMax);
+  detector.setThreshold(m_threshold);
+  detector.setDipolePhase(m_dipolePhase);
+
+  pos = chunk.begin > overlap() ? chunk.begin - overlap() : 0;
+
+  while (pos < total && !m_cancelled) {
+    size_t size = static_cast<size_t>(
+          std::min<SUSCOUNT>(COHERENT_REPLAY_BLOCK_SIZE, total - pos));
+
+    // Past the chunk, only an event that started in it keeps us going
+    if (pos >= chunk.end && !(triggered && start >= chunk.begin))
+      break;
+
+    m_recording.read(pos, size, buffer.data());
+    detector.detect(buffer.data(), size, pos, transitions);
+
+    for (auto const &transition : transitions) {
+      if (transition.triggered) {
+        start = transition.event.start;
+      } else if (start >= chunk.begin && start < chunk.end) {
+        CoherentReplayEvent event;
+
+        event.start = start;
+        event.end   = transition.event.end;
+        event.event = transition.event;
+        event.event.timeStamp = m_recording.time(start);
+
+        chunk.events.push_back(event);
+      }
+    }
+
+    triggered = detector.triggered();
+
+    if (pos + size > chunk.begin && pos < chunk.end)
+      m_processed +=
+          std::min<SUSCOUNT>(pos + size, chunk.end)
+          - std::max<SUSCOUNT>(pos, chunk.begin);
+
+    pos += size;
+  }
+}
+
+void
+CoherentReplay::run()
+{
+  SUSCOUNT total = m_recording.size();
+  unsigned threads = m_threads;
+  std::vector<CoherentReplayChunk> chunks;
+  std::vector<std::thread> workers;
+  std::atomic<unsigned> running;
+  bool completed;
+
+  m_events.clear();
+  m_cancelled = false;
+  m_processed = 0;
+
+  if (!m_recording.isOpen() || m_size == 0) {
+    emit finished(false);
+    return;
+  }
+
+  // Nothing to scan: done, with no events
+  if (total == 0) {
+    emit progress(1);
+    emit finished(true);
+    return;
+  }
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  chunks  = split(threads);
+  running = static_cast<unsigned>(chunks.size());
+  for (auto &chunk : chunks)
+    workers.push_back(
+          std::thread([this, &chunk, &running] () {
+            scan(chunk);
+            --running;
+          }));
+
+  while (running > 0) {
+    std::this_thread::sleep_for(
+          std::chrono::milliseconds(COHERENT_REPLAY_PROGRESS_MS));
+    emit progress(static_cast<qreal>(m_processed) / total);
+  }
+
+  for (auto &worker : workers)
+    worker.join();
+
+  completed = !m_cancelled;
+
+  if (completed)
+    for (auto &chunk : chunks)
+      m_events.insert(
+            m_events.end(),
+            chunk.events.begin(),
+            chunk.events.end());
+
+  emit finished(completed);
+}
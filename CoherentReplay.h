@@ -0,0 +1,131 @@
+//
+//    CoherentReplay.h: Offline coherent event detection over recordings
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef COHERENTREPLAY_H
+#define COHERENTREPLAY_H
+
+#include <QObject>
+#include <sigutils/types.h>
+#include <atomic>
+#include <vector>
+#include "CoherentDetector.h"
+#include "PhaseRecording.h"
+
+#define COHERENT_REPLAY_BLOCK_SIZE      65536
+#define COHERENT_REPLAY_WARMUP          20   // Detector time constants
+#define COHERENT_REPLAY_MIN_CHUNK_RATIO 8    // Chunk size over overlap
+#define COHERENT_REPLAY_PROGRESS_MS     100
+
+//
+// Runs the coherent detector over a whole PhaseRecording as fast as the
+// CPU allows. The recording is split in one chunk per thread, and every
+// thread runs its own detector over its chunk:
+//
+// - Each detector starts COHERENT_REPLAY_WARMUP time constants plus the
+//   hold time before its chunk, so its smoothed statistic and trigger
+//   state have converged to what a single pass would have by then.
+// - Only the events that start inside the chunk are kept, and the
+//   detector keeps going past the end of the chunk until the last of
+//   them is over.
+//
+// Put together in chunk order, the events are those of a single pass
+// over the file. Start and end are the exact indices of the samples that
+// triggered and released the detector, and the time stamp of the event
+// is that of its start, as told by PhaseRecording::time().
+//
+// The object is meant to live in its own thread, like AutoSaveWriter:
+// the owner opens the recording and configures the detector while idle,
+// and invokes run(), which reports through progress() and finished().
+// cancel() can be called from any thread.
+//
+// Batch tools that schedule their own workers can use split() and scan()
+// directly instead. Both only read the configuration, so chunks of the
+// same recording can be scanned from several threads at once.
+//
+
+namespace SigDigger {
+  struct CoherentReplayEvent {
+    SUSCOUNT      start;
+    SUSCOUNT      end;
+    CoherentEvent event;
+  };
+
+  struct CoherentReplayChunk {
+    SUSCOUNT begin = 0;
+    SUSCOUNT end   = 0;
+    std::vector<CoherentReplayEvent> events;
+  };
+
+  class CoherentReplay : public QObject
+  {
+    Q_OBJECT
+
+    PhaseRecording m_recording;
+    SUSCOUNT       m_size        = 0;
+    SUSCOUNT       m_holdMax     = 0;
+    SUFLOAT        m_threshold   = 0;
+    SUFLOAT        m_dipolePhase = M_PI;
+    unsigned       m_threads     = 0;
+
+    std::vector<CoherentReplayEvent> m_events;
+    std::atomic<bool>     m_cancelled;
+    std::atomic<SUSCOUNT> m_processed;
+
+  public:
+    explicit CoherentReplay(QObject *parent = nullptr);
+
+    // Closes the current recording. On failure, see errorString() in it
+    bool     open(QString const &path);
+    void     close();
+    PhaseRecording const &recording() const;
+
+    // Same meaning as in CoherentDetector: sizes in samples and the
+    // threshold in radians
+    void     setDetector(
+        SUSCOUNT size,
+        SUSCOUNT holdMax,
+        SUFLOAT threshold,
+        SUFLOAT dipolePhase);
+
+    // 0 means one per hardware thread
+    void     setThreads(unsigned);
+
+    // Samples scanned before each chunk to settle the detector
+    SUSCOUNT overlap() const;
+
+    // At most `chunks` chunks (fewer for short recordings), in order
+    std::vector<CoherentReplayChunk> split(unsigned chunks) const;
+
+    // Appends the events that start in the chunk to its event list
+    void     scan(CoherentReplayChunk &);
+    void     cancel();
+
+    // Valid after finished(), until the next run()
+    std::vector<CoherentReplayEvent> const &events() const;
+
+  public slots:
+    void run();
+
+  signals:
+    void progress(qreal);
+    void finished(bool completed);
+  };
+}
+
+#endif // COHERENTREPLAY_H
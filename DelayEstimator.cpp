@@ -0,0 +1,212 @@
+//
+//    DelayEstimator.cpp: Background inter-channel delay estimation
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "DelayEstimator.h"
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+
+using namespace SigDigger;
+
+DelayEstimator::DelayEstimator(unsigned size, QObject *parent)
+  : QObject(parent), m_busy(false), m_resetPending(false)
+{
+  m_size = size;
+
+  m_lo    = SU_FFTW(_alloc_complex)(size);
+  m_hi    = SU_FFTW(_alloc_complex)(size);
+  m_xcorr = SU_FFTW(_alloc_complex)(size);
+
+  // Plans are created here, before the object is moved to its thread
+  m_loPlan = SU_FFTW(_plan_dft_1d)(
+        static_cast<int>(size),
+        m_lo,
+        m_lo,
+        FFTW_FORWARD,
+        FFTW_ESTIMATE);
+
+  m_hiPlan = SU_FFTW(_plan_dft_1d)(
+        static_cast<int>(size),
+        m_hi,
+        m_hi,
+        FFTW_FORWARD,
+        FFTW_ESTIMATE);
+
+  m_invPlan = SU_FFTW(_plan_dft_1d)(
+        static_cast<int>(size),
+        m_xcorr,
+        m_xcorr,
+        FFTW_BACKWARD,
+        FFTW_ESTIMATE);
+
+  m_spectrum.resize(size);
+  m_pendingLo.resize(size);
+  m_pendingHi.resize(size);
+}
+
+DelayEstimator::~DelayEstimator()
+{
+  if (m_loPlan != nullptr)
+    SU_FFTW(_destroy_plan)(m_loPlan);
+
+  if (m_hiPlan != nullptr)
+    SU_FFTW(_destroy_plan)(m_hiPlan);
+
+  if (m_invPlan != nullptr)
+    SU_FFTW(_destroy_plan)(m_invPlan);
+
+  if (m_lo != nullptr)
+    SU_FFTW(_free)(m_lo);
+
+  if (m_hi != nullptr)
+    SU_FFTW(_free)(m_hi);
+
+  if (m_xcorr != nullptr)
+    SU_FFTW(_free)(m_xcorr);
+}
+
+unsigned
+DelayEstimator::size() const
+{
+  return m_size;
+}
+
+bool
+DelayEstimator::busy() const
+{
+  return m_busy;
+}
+
+bool
+DelayEstimator::submit(const SUCOMPLEX *lo, const SUCOMPLEX *hi)
+{
+  if (m_busy)
+    return false;
+
+  {
+    QMutexLocker locker(&m_mutex);
+    std::copy(lo, lo + m_size, m_pendingLo.begin());
+    std::copy(hi, hi + m_size, m_pendingHi.begin());
+  }
+
+  m_busy = true;
+
+  QMetaObject::invokeMethod(this, "process", Qt::QueuedConnection);
+
+  return true;
+}
+
+void
+DelayEstimator::reset()
+{
+  m_resetPending = true;
+}
+
+void
+DelayEstimator::estimate()
+{
+  unsigned i, peak = 0;
+  SUFLOAT mag, max = 0, mean = 0;
+  SUFLOAT m0, m1, p1, den, frac = 0;
+  qreal delay;
+
+  for (i = 0; i < m_size; ++i) {
+    SUCOMPLEX x = m_spectrum[i];
+    m_xcorr[i][0] = SU_C_REAL(x);
+    m_xcorr[i][1] = SU_C_IMAG(x);
+  }
+
+  SU_FFTW(_execute)(m_invPlan);
+
+  for (i = 0; i < m_size; ++i) {
+    mag = m_xcorr[i][0] * m_xcorr[i][0] + m_xcorr[i][1] * m_xcorr[i][1];
+    mean += mag;
+    if (mag > max) {
+      max  = mag;
+      peak = i;
+    }
+  }
+
+  mean /= m_size;
+
+  if (mean <= 0)
+    return;
+
+  // Parabolic interpolation around the peak (circular indexing)
+  auto magAt = [this] (unsigned j) {
+    j %= m_size;
+    return std::sqrt(
+          m_xcorr[j][0] * m_xcorr[j][0] + m_xcorr[j][1] * m_xcorr[j][1]);
+  };
+
+  m0  = magAt(peak);
+  m1  = magAt(peak + m_size - 1);
+  p1  = magAt(peak + 1);
+  den = m1 - 2 * m0 + p1;
+
+  if (std::fabs(den) > 0)
+    frac = .5f * (m1 - p1) / den;
+
+  delay = static_cast<qreal>(peak) + frac;
+  if (delay >= .5 * m_size)
+    delay -= m_size;
+
+  emit delayEstimated(delay, static_cast<qreal>(max / mean));
+}
+
+///////////////////////////////// Slots ////////////////////////////////////////
+void
+DelayEstimator::process()
+{
+  if (m_resetPending) {
+    std::fill(m_spectrum.begin(), m_spectrum.end(), 0);
+    m_count        = 0;
+    m_resetPending = false;
+  }
+
+  {
+    QMutexLocker locker(&m_mutex);
+
+    for (unsigned i = 0; i < m_size; ++i) {
+      m_lo[i][0] = SU_C_REAL(m_pendingLo[i]);
+      m_lo[i][1] = SU_C_IMAG(m_pendingLo[i]);
+      m_hi[i][0] = SU_C_REAL(m_pendingHi[i]);
+      m_hi[i][1] = SU_C_IMAG(m_pendingHi[i]);
+    }
+  }
+
+  SU_FFTW(_execute)(m_loPlan);
+  SU_FFTW(_execute)(m_hiPlan);
+
+  // Cross spectrum: HI * conj(LO), whose inverse peaks at the HI delay
+  for (unsigned i = 0; i < m_size; ++i) {
+    SUCOMPLEX lo(m_lo[i][0], m_lo[i][1]);
+    SUCOMPLEX hi(m_hi[i][0], m_hi[i][1]);
+
+    m_spectrum[i] += hi * SU_C_CONJ(lo);
+  }
+
+  if (++m_count == m_averages) {
+    estimate();
+    std::fill(m_spectrum.begin(), m_spectrum.end(), 0);
+    m_count = 0;
+  }
+
+  m_busy = false;
+}
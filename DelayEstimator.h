@@ -0,0 +1,89 @@
+//
+//    DelayEstimator.h: Background inter-channel delay estimation
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef DELAYESTIMATOR_H
+#define DELAYESTIMATOR_H
+
+#include <QObject>
+#include <QMutex>
+#include <sigutils/types.h>
+#include <fftw3.h>
+#include <atomic>
+#include <vector>
+
+#define DELAY_ESTIMATOR_DEFAULT_SIZE     4096
+#define DELAY_ESTIMATOR_DEFAULT_AVERAGES 8
+
+//
+// Estimates the delay of the HI channel with respect to the LO channel
+// (i.e. hi[n] = lo[n - delay]) from the peak of their cross-correlation.
+// The cross-spectrum of several consecutive blocks is averaged before
+// transforming back, and the peak is refined by parabolic interpolation.
+//
+// This object is meant to live in a worker thread. Blocks are handed over
+// with submit(), which never blocks: if the previous block is still being
+// processed, the new one is simply rejected.
+//
+
+namespace SigDigger {
+  class DelayEstimator : public QObject
+  {
+    Q_OBJECT
+
+    unsigned               m_size;
+    unsigned               m_averages = DELAY_ESTIMATOR_DEFAULT_AVERAGES;
+    unsigned               m_count    = 0;
+
+    SU_FFTW(_complex)     *m_lo    = nullptr;
+    SU_FFTW(_complex)     *m_hi    = nullptr;
+    SU_FFTW(_complex)     *m_xcorr = nullptr;
+    SU_FFTW(_plan)         m_loPlan  = nullptr;
+    SU_FFTW(_plan)         m_hiPlan  = nullptr;
+    SU_FFTW(_plan)         m_invPlan = nullptr;
+
+    std::vector<SUCOMPLEX> m_spectrum;
+
+    QMutex                 m_mutex;
+    std::vector<SUCOMPLEX> m_pendingLo;
+    std::vector<SUCOMPLEX> m_pendingHi;
+    std::atomic<bool>      m_busy;
+    std::atomic<bool>      m_resetPending;
+
+    void estimate();
+
+  public:
+    explicit DelayEstimator(
+        unsigned size = DELAY_ESTIMATOR_DEFAULT_SIZE,
+        QObject *parent = nullptr);
+    ~DelayEstimator() override;
+
+    unsigned size() const;
+    bool     busy() const;
+    bool     submit(const SUCOMPLEX *lo, const SUCOMPLEX *hi);
+    void     reset();
+
+  public slots:
+    void process();
+
+  signals:
+    void delayEstimated(qreal delay, qreal quality);
+  };
+}
+
+#endif // DELAYESTIMATOR_H
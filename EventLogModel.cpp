@@ -0,0 +1,176 @@
+//
+//    EventLogModel.cpp: Bounded event log table
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "EventLogModel.h"
+#include <QDateTime>
+#include <SuWidgetsHelpers.h>
+#include <sigutils/types.h>
+
+using namespace SigDigger;
+
+EventLogModel::EventLogModel(size_t maxRows, QObject *parent) :
+  QAbstractListModel(parent),
+  m_maxRows(maxRows)
+{
+}
+
+void
+EventLogModel::setMaxRows(size_t rows)
+{
+  m_maxRows = rows > 0 ? rows : 1;
+}
+
+size_t
+EventLogModel::maxRows() const
+{
+  return m_maxRows;
+}
+
+bool
+EventLogModel::empty() const
+{
+  return m_entries.empty() && m_pending.empty();
+}
+
+void
+EventLogModel::append(EventLogEntry const &entry)
+{
+  m_pending.push_back(entry);
+}
+
+bool
+EventLogModel::flush()
+{
+  size_t excess;
+  int first;
+
+  if (m_pending.empty())
+    return false;
+
+  // Pending entries that would not survive the trim below
+  if (m_pending.size() > m_maxRows)
+    m_pending.erase(
+          m_pending.begin(),
+          m_pending.end() - static_cast<ptrdiff_t>(m_maxRows));
+
+  excess = m_entries.size() + m_pending.size();
+  excess = excess > m_maxRows ? excess - m_maxRows : 0;
+
+  if (excess > 0) {
+    beginRemoveRows(QModelIndex(), 0, static_cast<int>(excess) - 1);
+    m_entries.erase(
+          m_entries.begin(),
+          m_entries.begin() + static_cast<ptrdiff_t>(excess));
+    endRemoveRows();
+  }
+
+  first = static_cast<int>(m_entries.size());
+
+  beginInsertRows(
+        QModelIndex(),
+        first,
+        first + static_cast<int>(m_pending.size()) - 1);
+  m_entries.insert(m_entries.end(), m_pending.begin(), m_pending.end());
+  endInsertRows();
+
+  m_pending.clear();
+
+  return true;
+}
+
+void
+EventLogModel::clear()
+{
+  beginResetModel();
+  m_entries.clear();
+  m_pending.clear();
+  endResetModel();
+}
+
+QString
+EventLogModel::format(EventLogEntry const &entry)
+{
+  QDateTime timestamp = QDateTime::fromSecsSinceEpoch(entry.time.tv_sec);
+  QString prefix = "[" + timestamp.toUTC().toString() + "] ";
+  QString phaseInfoText;
+
+  switch (entry.kind) {
+    case EVENT_LOG_TEXT:
+      return prefix + entry.text;
+
+    case EVENT_LOG_EVENT_START:
+      return prefix + "Coherent event detected.";
+
+    case EVENT_LOG_EVENT_END:
+      if (entry.aoa) {
+        phaseInfoText =
+            "AoA = " + SuWidgetsHelpers::formatQuantity(
+              SU_RAD2DEG(entry.angles[0]),
+              4,
+              "deg",
+              true) +
+            " or " + SuWidgetsHelpers::formatQuantity(
+              SU_RAD2DEG(entry.angles[1]),
+              4,
+              "deg",
+              true);
+      } else {
+        phaseInfoText =
+            "dPhi = " + SuWidgetsHelpers::formatQuantity(
+              SU_RAD2DEG(entry.phase),
+              4,
+              "º");
+      }
+
+      return prefix
+          + "Coherent event end. T = "
+          + SuWidgetsHelpers::formatQuantity(entry.duration, 4, "s")
+          + ", S = " + QString::number(entry.powerDb) + " dB, "
+          + phaseInfoText;
+  }
+
+  return prefix;
+}
+
+QString
+EventLogModel::text(int row) const
+{
+  return format(m_entries[static_cast<size_t>(row)]);
+}
+
+int
+EventLogModel::rowCount(QModelIndex const &parent) const
+{
+  // Flat list: only the root has children
+  if (parent.isValid())
+    return 0;
+
+  return static_cast<int>(m_entries.size());
+}
+
+QVariant
+EventLogModel::data(QModelIndex const &index, int role) const
+{
+  if (role != Qt::DisplayRole
+      || !index.isValid()
+      || index.row() >= rowCount())
+    return QVariant();
+
+  return text(index.row());
+}
@@ -0,0 +1,92 @@
+//
+//    EventLogModel.h: Bounded event log table
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef EVENTLOGMODEL_H
+#define EVENTLOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QString>
+#include <sys/time.h>
+#include <deque>
+#include <vector>
+
+#define EVENT_LOG_MODEL_DEFAULT_MAX_ROWS (1 << 20)
+
+//
+// Event log kept as a table of small records instead of text. Rows are
+// only formatted when the view asks for them, i.e. when they are visible
+// or the log is being saved. append() just queues the entry: rows are
+// inserted in batches by flush(), which the page calls once per frame.
+// Past maxRows, the oldest rows are dropped.
+//
+
+namespace SigDigger {
+  enum EventLogKind {
+    EVENT_LOG_TEXT,
+    EVENT_LOG_EVENT_START,
+    EVENT_LOG_EVENT_END
+  };
+
+  struct EventLogEntry {
+    struct timeval time = {0, 0};
+    EventLogKind   kind = EVENT_LOG_TEXT;
+    QString        text;         // EVENT_LOG_TEXT only
+
+    // EVENT_LOG_EVENT_END only
+    bool    aoa       = false;   // Show the angles of arrival, not dPhi
+    float   duration  = 0;       // s
+    float   powerDb   = 0;
+    float   phase     = 0;       // rad
+    float   angles[2] = {0, 0};  // rad
+  };
+
+  class EventLogModel : public QAbstractListModel
+  {
+    Q_OBJECT
+
+    std::deque<EventLogEntry>  m_entries;
+    std::vector<EventLogEntry> m_pending;
+    size_t                     m_maxRows;
+
+  public:
+    explicit EventLogModel(
+        size_t maxRows = EVENT_LOG_MODEL_DEFAULT_MAX_ROWS,
+        QObject *parent = nullptr);
+
+    void    setMaxRows(size_t);
+    size_t  maxRows() const;
+
+    // Neither rows nor pending entries
+    bool    empty() const;
+
+    void    append(EventLogEntry const &);
+
+    // Returns whether any rows were inserted
+    bool    flush();
+    void    clear();
+
+    static QString format(EventLogEntry const &);
+    QString text(int row) const;
+
+    int      rowCount(QModelIndex const &parent = QModelIndex()) const override;
+    QVariant data(QModelIndex const &, int role = Qt::DisplayRole) const override;
+  };
+}
+
+#endif // EVENTLOGMODEL_H
@@ -0,0 +1,503 @@
+//
+//    EventStore.cpp: Append-only columnar store of coherent events
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "EventStore.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define EVENT_STORE_MAGIC       "ANTSDREV"
+#define EVENT_STORE_TABLE_MAGIC "ANTSDRET"
+#define EVENT_STORE_VERSION     1
+
+using namespace SigDigger;
+
+namespace {
+  struct StoreHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t blockEvents;
+    uint64_t count;
+  };
+
+  struct TableHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t columns;
+    uint64_t count;
+  };
+
+  struct TableColumn {
+    char     name[16];
+    char     type[8];
+    uint64_t offset;
+  };
+
+  struct Column {
+    const char *name;
+    const char *type;
+    size_t      size;
+  };
+
+  // Widest first, so every column stays aligned to its own size
+  enum {
+    COLUMN_TIME,
+    COLUMN_SAMPLE,
+    COLUMN_LENGTH,
+    COLUMN_DURATION,
+    COLUMN_MEAN_PHASE,
+    COLUMN_MEAN_POWER,
+    COLUMN_AOA0,
+    COLUMN_AOA1,
+    COLUMN_COUNT
+  };
+
+  const Column g_columns[COLUMN_COUNT] = {
+    {"time",       "<i8", sizeof(int64_t)},
+    {"sample",     "<u8", sizeof(uint64_t)},
+    {"length",     "<u8", sizeof(uint64_t)},
+    {"duration",   "<f8", sizeof(double)},
+    {"mean_phase", "<f4", sizeof(float)},
+    {"mean_power", "<f4", sizeof(float)},
+    {"aoa0",       "<f4", sizeof(float)},
+    {"aoa1",       "<f4", sizeof(float)}
+  };
+
+  // Offset of a column inside a block
+  size_t
+  columnOffset(unsigned column)
+  {
+    size_t offset = 0;
+
+    for (unsigned i = 0; i < column; ++i)
+      offset += g_columns[i].size * EVENT_STORE_BLOCK_EVENTS;
+
+    return offset;
+  }
+}
+
+EventStore::EventStore()
+{
+}
+
+EventStore::~EventStore()
+{
+  close();
+}
+
+size_t
+EventStore::blockSize()
+{
+  return columnOffset(COLUMN_COUNT);
+}
+
+size_t
+EventStore::mapSize(size_t blocks)
+{
+  return EVENT_STORE_HEADER_SIZE + blocks * blockSize();
+}
+
+char *
+EventStore::field(size_t index, unsigned column) const
+{
+  size_t block = index / EVENT_STORE_BLOCK_EVENTS;
+  size_t entry = index % EVENT_STORE_BLOCK_EVENTS;
+
+  return m_base
+      + mapSize(block)
+      + columnOffset(column)
+      + entry * g_columns[column].size;
+}
+
+void
+EventStore::writeCount()
+{
+  StoreHeader *header = reinterpret_cast<StoreHeader *>(m_base);
+
+  header->count = m_count;
+}
+
+bool
+EventStore::grow()
+{
+  size_t capacity = m_capacity > 0 ? 2 * m_capacity : 1;
+  void *map;
+
+  if (m_fd != -1
+      && ftruncate(m_fd, static_cast<off_t>(mapSize(capacity))) == -1)
+    return false;
+
+  map = mremap(m_base, mapSize(m_capacity), mapSize(capacity), MREMAP_MAYMOVE);
+  if (map == MAP_FAILED)
+    return false;
+
+  m_base     = static_cast<char *>(map);
+  m_capacity = capacity;
+
+  return true;
+}
+
+bool
+EventStore::open(std::string const &path)
+{
+  StoreHeader *header;
+  struct stat sbuf;
+  size_t size, blocks;
+  void *map;
+  int fd = -1, error;
+
+  close();
+
+  if (path.empty()) {
+    blocks = 1;
+    map = mmap(
+          nullptr,
+          mapSize(blocks),
+          PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS,
+          -1,
+          0);
+  } else {
+    if ((fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644)) == -1)
+      return false;
+
+    if (fstat(fd, &sbuf) == -1)
+      goto fail;
+
+    size = static_cast<size_t>(sbuf.st_size);
+
+    // New (or truncated before the first block): start over
+    if (size < mapSize(1)) {
+      size = mapSize(1);
+      if (ftruncate(fd, static_cast<off_t>(size)) == -1)
+        goto fail;
+    }
+
+    blocks = (size - EVENT_STORE_HEADER_SIZE) / blockSize();
+    map = mmap(
+          nullptr,
+          mapSize(blocks),
+          PROT_READ | PROT_WRITE,
+          MAP_SHARED,
+          fd,
+          0);
+  }
+
+  if (map == MAP_FAILED)
+    goto fail;
+
+  m_fd       = fd;
+  m_base     = static_cast<char *>(map);
+  m_capacity = blocks;
+  m_path     = path;
+
+  header = reinterpret_cast<StoreHeader *>(m_base);
+
+  if (header->magic[0] == '\0') {
+    memcpy(header->magic, EVENT_STORE_MAGIC, sizeof(header->magic));
+    header->version     = EVENT_STORE_VERSION;
+    header->blockEvents = EVENT_STORE_BLOCK_EVENTS;
+    header->count       = 0;
+  } else if (
+      memcmp(header->magic, EVENT_STORE_MAGIC, sizeof(header->magic)) != 0
+      || header->version != EVENT_STORE_VERSION
+      || header->blockEvents != EVENT_STORE_BLOCK_EVENTS) {
+    close();
+    errno = EINVAL;
+    return false;
+  }
+
+  // Never trust the count beyond what the file holds
+  m_count  = std::min<size_t>(
+        static_cast<size_t>(header->count),
+        m_capacity * EVENT_STORE_BLOCK_EVENTS);
+  m_sorted = true;
+
+  for (size_t i = 1; i < m_count && m_sorted; ++i)
+    m_sorted = time(i - 1) <= time(i);
+
+  return true;
+
+fail:
+  error = errno;
+  if (fd != -1)
+    ::close(fd);
+  errno = error;
+
+  return false;
+}
+
+void
+EventStore::close()
+{
+  if (m_base != nullptr)
+    munmap(m_base, mapSize(m_capacity));
+
+  if (m_fd != -1)
+    ::close(m_fd);
+
+  m_fd       = -1;
+  m_base     = nullptr;
+  m_capacity = 0;
+  m_count    = 0;
+  m_sorted   = true;
+  m_path.clear();
+}
+
+bool
+EventStore::isOpen() const
+{
+  return m_base != nullptr;
+}
+
+bool
+EventStore::fileBacked() const
+{
+  return m_fd != -1;
+}
+
+std::string const &
+EventStore::path() const
+{
+  return m_path;
+}
+
+size_t
+EventStore::size() const
+{
+  return m_count;
+}
+
+bool
+EventStore::empty() const
+{
+  return m_count == 0;
+}
+
+bool
+EventStore::sorted() const
+{
+  return m_sorted;
+}
+
+bool
+EventStore::append(EventRecord const &record)
+{
+  if (!isOpen()) {
+    errno = EBADF;
+    return false;
+  }
+
+  if (m_count == m_capacity * EVENT_STORE_BLOCK_EVENTS && !grow())
+    return false;
+
+  if (m_count > 0 && record.time < time(m_count - 1))
+    m_sorted = false;
+
+  memcpy(field(m_count, COLUMN_TIME),       &record.time,      sizeof(int64_t));
+  memcpy(field(m_count, COLUMN_SAMPLE),     &record.sample,    sizeof(uint64_t));
+  memcpy(field(m_count, COLUMN_LENGTH),     &record.length,    sizeof(uint64_t));
+  memcpy(field(m_count, COLUMN_DURATION),   &record.duration,  sizeof(double));
+  memcpy(field(m_count, COLUMN_MEAN_PHASE), &record.meanPhase, sizeof(float));
+  memcpy(field(m_count, COLUMN_MEAN_POWER), &record.meanPower, sizeof(float));
+  memcpy(field(m_count, COLUMN_AOA0),       &record.aoa[0],    sizeof(float));
+  memcpy(field(m_count, COLUMN_AOA1),       &record.aoa[1],    sizeof(float));
+
+  // Only now the event is part of the store
+  ++m_count;
+  writeCount();
+
+  return true;
+}
+
+EventRecord
+EventStore::at(size_t index) const
+{
+  EventRecord record;
+
+  memcpy(&record.time,      field(index, COLUMN_TIME),       sizeof(int64_t));
+  memcpy(&record.sample,    field(index, COLUMN_SAMPLE),     sizeof(uint64_t));
+  memcpy(&record.length,    field(index, COLUMN_LENGTH),     sizeof(uint64_t));
+  memcpy(&record.duration,  field(index, COLUMN_DURATION),   sizeof(double));
+  memcpy(&record.meanPhase, field(index, COLUMN_MEAN_PHASE), sizeof(float));
+  memcpy(&record.meanPower, field(index, COLUMN_MEAN_POWER), sizeof(float));
+  memcpy(&record.aoa[0],    field(index, COLUMN_AOA0),       sizeof(float));
+  memcpy(&record.aoa[1],    field(index, COLUMN_AOA1),       sizeof(float));
+
+  return record;
+}
+
+std::string
+EventStore::csvLine(EventRecord const &record)
+{
+  char line[256];
+
+  snprintf(
+        line,
+        sizeof(line),
+        "%lld,%lld,%.7e,%.7e,%.7e,%.7e,%.7e,%llu",
+        static_cast<long long>(record.time / 1000000),
+        static_cast<long long>(record.time % 1000000),
+        SU_RAD2DEG(record.meanPhase),
+        SU_RAD2DEG(record.aoa[0]),
+        SU_RAD2DEG(record.aoa[1]),
+        SU_POWER_DB_RAW(record.meanPower),
+        record.duration,
+        static_cast<unsigned long long>(record.sample));
+
+  return line;
+}
+
+int64_t
+EventStore::time(size_t index) const
+{
+  int64_t time;
+
+  memcpy(&time, field(index, COLUMN_TIME), sizeof(int64_t));
+
+  return time;
+}
+
+size_t
+EventStore::lowerBound(int64_t time) const
+{
+  size_t lo = 0, hi = m_count;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (this->time(mid) < time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+std::vector<size_t>
+EventStore::query(int64_t start, int64_t end) const
+{
+  std::vector<size_t> result;
+
+  if (m_sorted) {
+    for (size_t i = lowerBound(start); i < m_count && time(i) < end; ++i)
+      result.push_back(i);
+  } else {
+    for (size_t i = 0; i < m_count; ++i)
+      if (time(i) >= start && time(i) < end)
+        result.push_back(i);
+  }
+
+  return result;
+}
+
+EventRecord
+EventStore::record(
+    CoherentEvent const &event,
+    struct timeval const &start,
+    uint64_t sample,
+    double duration)
+{
+  EventRecord record;
+
+  record.time      = static_cast<int64_t>(start.tv_sec) * 1000000
+      + start.tv_usec;
+  record.sample    = sample;
+  record.length    = event.length;
+  record.duration  = duration;
+  record.meanPhase = event.meanPhase;
+  record.meanPower = event.meanPower;
+  record.aoa[0]    = event.aoa[0];
+  record.aoa[1]    = event.aoa[1];
+
+  return record;
+}
+
+bool
+EventStore::exportTable(std::string const &path) const
+{
+  TableHeader header;
+  TableColumn columns[COLUMN_COUNT];
+  uint64_t offset = sizeof(TableHeader) + sizeof(columns);
+  size_t blocks = (m_count + EVENT_STORE_BLOCK_EVENTS - 1)
+      / EVENT_STORE_BLOCK_EVENTS;
+  static const char padding[8] = {0};
+  FILE *fp;
+  bool ok;
+  int error;
+
+  memset(&header, 0, sizeof(header));
+  memset(columns, 0, sizeof(columns));
+
+  memcpy(header.magic, EVENT_STORE_TABLE_MAGIC, sizeof(header.magic));
+  header.version = EVENT_STORE_VERSION;
+  header.columns = COLUMN_COUNT;
+  header.count   = m_count;
+
+  for (unsigned i = 0; i < COLUMN_COUNT; ++i) {
+    strncpy(columns[i].name, g_columns[i].name, sizeof(columns[i].name));
+    strncpy(columns[i].type, g_columns[i].type, sizeof(columns[i].type));
+
+    offset = (offset + 7) / 8 * 8;
+    columns[i].offset = offset;
+    offset += m_count * g_columns[i].size;
+  }
+
+  if ((fp = fopen(path.c_str(), "wb")) == nullptr)
+    return false;
+
+  ok = fwrite(&header, sizeof(header), 1, fp) == 1
+      && fwrite(columns, sizeof(columns), 1, fp) == 1;
+
+  // Block after block, each column is already contiguous
+  for (unsigned i = 0; ok && i < COLUMN_COUNT; ++i) {
+    long pad = static_cast<long>(columns[i].offset) - ftell(fp);
+
+    ok = fwrite(padding, 1, static_cast<size_t>(pad), fp)
+        == static_cast<size_t>(pad);
+
+    for (size_t b = 0; ok && b < blocks; ++b) {
+      size_t first = b * EVENT_STORE_BLOCK_EVENTS;
+      size_t count = std::min<size_t>(
+            m_count - first,
+            EVENT_STORE_BLOCK_EVENTS);
+
+      ok = fwrite(field(first, i), g_columns[i].size, count, fp) == count;
+    }
+  }
+
+  error = errno;
+  if (fclose(fp) != 0 && ok) {
+    ok = false;
+    error = errno;
+  }
+
+  if (!ok) {
+    unlink(path.c_str());
+    errno = error;
+  }
+
+  return ok;
+}
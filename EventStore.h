@@ -0,0 +1,140 @@
+//
+//    EventStore.h: Append-only columnar store of coherent events
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef EVENTSTORE_H
+#define EVENTSTORE_H
+
+#include <sigutils/types.h>
+#include <sys/time.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CoherentDetector.h"
+
+#define EVENT_STORE_BLOCK_EVENTS    4096
+#define EVENT_STORE_HEADER_SIZE     4096
+#define EVENT_STORE_EXTENSION       ".events"
+#define EVENT_STORE_TABLE_EXTENSION ".evtable"
+
+//
+// Append-only table of coherent events, stored by columns. Events are
+// grouped in blocks of EVENT_STORE_BLOCK_EVENTS, and each block keeps
+// every column contiguous, so appending never moves what is already
+// there and scanning one field only touches that field.
+//
+// The store lives in a file that is mapped in memory and grown as
+// needed. The event count in its header is updated after each event is
+// written, so the file is consistent if the program dies at any point
+// (a system crash may still lose what the kernel had not written back).
+// Reopening the file picks up where it was left. Without a path, the
+// store is kept in anonymous memory instead.
+//
+// Times are expected to grow with the index, as they come from the
+// capture clock. Time queries are binary searches then, and fall back
+// to a linear scan if the clock ever went back.
+//
+// exportTable() writes a self-describing columnar file, meant to be read
+// with no parsing at all (e.g. numpy.fromfile with the offsets in it):
+//
+//   char     magic[8]      "ANTSDRET"
+//   uint32_t version       1
+//   uint32_t columns       N
+//   uint64_t count         Events per column
+//   N times:
+//     char     name[16]    NUL-padded
+//     char     type[8]     NumPy style (e.g. "<f8"), NUL-padded
+//     uint64_t offset      From the start of the file, 8-byte aligned
+//   Column data
+//
+// All fields are little endian.
+//
+
+namespace SigDigger {
+  struct EventRecord {
+    int64_t  time      = 0; // us since the epoch (UTC)
+    uint64_t sample    = 0; // Stream index of the first sample
+    uint64_t length    = 0; // Samples
+    double   duration  = 0; // s
+    float    meanPhase = 0; // rad
+    float    meanPower = 0;
+    float    aoa[2]    = {0, 0}; // rad
+  };
+
+  class EventStore
+  {
+    int         m_fd       = -1;
+    char       *m_base     = nullptr; // Header, then the blocks
+    size_t      m_capacity = 0;       // Blocks mapped
+    size_t      m_count    = 0;
+    bool        m_sorted   = true;
+    std::string m_path;
+
+    static size_t blockSize();
+    static size_t mapSize(size_t blocks);
+
+    bool  grow();
+    char *field(size_t index, unsigned column) const;
+    void  writeCount();
+
+  public:
+    EventStore();
+    ~EventStore();
+
+    EventStore(EventStore const &) = delete;
+    EventStore &operator=(EventStore const &) = delete;
+
+    // Opens or creates a store file (or an anonymous one if the path is
+    // empty), closing the current one. On failure, the store is left
+    // closed and errno tells why.
+    bool   open(std::string const &path = "");
+    void   close();
+    bool   isOpen() const;
+    bool   fileBacked() const;
+    std::string const &path() const;
+
+    size_t size() const;
+    bool   empty() const;
+    bool   sorted() const;
+
+    bool   append(EventRecord const &);
+    EventRecord at(size_t) const;
+    int64_t time(size_t) const;
+
+    // Indices of the events with times in [start, end), in order
+    std::vector<size_t> query(int64_t start, int64_t end) const;
+
+    // First event not earlier than `time` (only if sorted())
+    size_t lowerBound(int64_t time) const;
+
+    bool   exportTable(std::string const &path) const;
+
+    static EventRecord record(
+        CoherentEvent const &,
+        struct timeval const &start,
+        uint64_t sample,
+        double duration);
+
+    // One CSV line (without the newline) with the columns every event
+    // list shares: seconds and microseconds of the start, mean phase,
+    // both AoA (in degrees), mean power (dB), duration (s) and sample.
+    static std::string csvLine(EventRecord const &);
+  };
+}
+
+#endif // EVENTSTORE_H
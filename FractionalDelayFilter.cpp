@@ -0,0 +1,127 @@
+//
+//    FractionalDelayFilter.cpp: Windowed-sinc fractional delay line
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "FractionalDelayFilter.h"
+#include "SignalKernels.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace SigDigger;
+
+FractionalDelayFilter::FractionalDelayFilter(size_t order)
+{
+  if (order < 2)
+    order = 2;
+
+  m_order = order;
+  m_taps.resize(order);
+  m_buffer.resize(order - 1);
+
+  setDelay(centerDelay());
+}
+
+void
+FractionalDelayFilter::computeTaps()
+{
+  SUFLOAT sum = 0;
+  SUFLOAT N = static_cast<SUFLOAT>(m_order - 1);
+
+  for (size_t k = 0; k < m_order; ++k) {
+    SUFLOAT t = static_cast<SUFLOAT>(k) - m_delay;
+    SUFLOAT sinc = std::fabs(t) < 1e-6f
+        ? 1.f
+        : static_cast<SUFLOAT>(std::sin(M_PI * t) / (M_PI * t));
+
+    // Window follows the delay, so that shifted responses stay symmetric
+    SUFLOAT x = (static_cast<SUFLOAT>(k) - m_delay) / N + .5f;
+    SUFLOAT w = 0;
+
+    if (x >= 0 && x <= 1)
+      w = static_cast<SUFLOAT>(
+            .42 - .5 * std::cos(2 * M_PI * x) + .08 * std::cos(4 * M_PI * x));
+
+    m_taps[k] = sinc * w;
+    sum += m_taps[k];
+  }
+
+  // Unity gain at DC
+  if (std::fabs(sum) > 0)
+    for (auto &t : m_taps)
+      t /= sum;
+}
+
+size_t
+FractionalDelayFilter::order() const
+{
+  return m_order;
+}
+
+SUFLOAT
+FractionalDelayFilter::centerDelay() const
+{
+  return .5f * static_cast<SUFLOAT>(m_order) - 1;
+}
+
+SUFLOAT
+FractionalDelayFilter::maxDelay() const
+{
+  return static_cast<SUFLOAT>(m_order - 1);
+}
+
+void
+FractionalDelayFilter::reset()
+{
+  std::fill(m_buffer.begin(), m_buffer.begin() + m_order - 1, 0);
+}
+
+void
+FractionalDelayFilter::setDelay(SUFLOAT delay)
+{
+  if (delay < 0)
+    delay = 0;
+  if (delay > maxDelay())
+    delay = maxDelay();
+
+  m_delay = delay;
+  computeTaps();
+}
+
+SUFLOAT
+FractionalDelayFilter::delay() const
+{
+  return m_delay;
+}
+
+const SUCOMPLEX *
+FractionalDelayFilter::feed(const SUCOMPLEX *data, size_t size)
+{
+  size_t hist = m_order - 1;
+
+  m_buffer.resize(hist + size);
+  m_output.resize(size);
+
+  std::copy(data, data + size, m_buffer.begin() + hist);
+
+  firFilter(m_output.data(), m_buffer.data() + hist, m_taps.data(), m_order, size);
+
+  // Keep the last order - 1 samples as history for the next block
+  std::copy(m_buffer.end() - hist, m_buffer.end(), m_buffer.begin());
+
+  return m_output.data();
+}
@@ -0,0 +1,62 @@
+//
+//    FractionalDelayFilter.h: Windowed-sinc fractional delay line
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef FRACTIONALDELAYFILTER_H
+#define FRACTIONALDELAYFILTER_H
+
+#include <sigutils/types.h>
+#include <vector>
+
+#define FRACTIONAL_DELAY_FILTER_DEFAULT_ORDER 32
+
+//
+// Delays a complex signal by an arbitrary (non-integer) number of samples,
+// using a Blackman-windowed sinc. The achievable delay ranges from 0 to
+// order - 1 samples, with the best response around the middle of the
+// filter (order / 2 - 1).
+//
+
+namespace SigDigger {
+  class FractionalDelayFilter
+  {
+    std::vector<SUFLOAT>   m_taps;
+    std::vector<SUCOMPLEX> m_buffer; // order - 1 history samples + block
+    std::vector<SUCOMPLEX> m_output;
+    size_t                 m_order = 0;
+    SUFLOAT                m_delay = 0;
+
+    void computeTaps();
+
+  public:
+    FractionalDelayFilter(size_t order = FRACTIONAL_DELAY_FILTER_DEFAULT_ORDER);
+
+    size_t  order() const;
+    SUFLOAT centerDelay() const;
+    SUFLOAT maxDelay() const;
+
+    void    reset();
+    void    setDelay(SUFLOAT);
+    SUFLOAT delay() const;
+
+    // Returns a pointer to the filtered samples, valid until the next call
+    const SUCOMPLEX *feed(const SUCOMPLEX *, size_t);
+  };
+}
+
+#endif // FRACTIONALDELAYFILTER_H
@@ -0,0 +1,656 @@
+//
+//    PairedChannelForwarder.cpp: Synchronous LO/HI channel pair
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+#include "PairedChannelForwarder.h"
+#include "SharedChannelizer.h"
+#include <cmath>
+
+using namespace SigDigger;
+
+////////////////////////////// PairedSpan //////////////////////////////////////
+void
+PairedSpan::clear()
+{
+  samples.clear();
+  start = 0;
+}
+
+quint64
+PairedSpan::end() const
+{
+  return start + samples.size();
+}
+
+void
+PairedSpan::append(std::vector<SUCOMPLEX> const &data, quint64 index)
+{
+  // Anything not contiguous with what we have starts a new span
+  if (samples.empty() || end() != index) {
+    samples.clear();
+    start = index;
+  }
+
+  samples.insert(samples.end(), data.begin(), data.end());
+
+  if (samples.size() > PAIRED_CHANNEL_FORWARDER_MAX_SPAN)
+    discard(end() - PAIRED_CHANNEL_FORWARDER_MAX_SPAN);
+}
+
+void
+PairedSpan::discard(quint64 until)
+{
+  if (until <= start)
+    return;
+
+  if (until >= end()) {
+    samples.clear();
+    start = until;
+  } else {
+    samples.erase(
+          samples.begin(),
+          samples.begin() + static_cast<ptrdiff_t>(until - start));
+    start = until;
+  }
+}
+
+/////////////////////////// PairedChannelForwarder /////////////////////////////
+
+PairedChannelForwarder::PairedChannelForwarder(
+    UIMediator *mediator, QObject *parent) : QObject(parent)
+{
+  m_mediator = mediator;
+
+  m_forwarder_hi = new RawChannelForwarder(mediator, this);
+  m_forwarder_lo = new RawChannelForwarder(mediator, this);
+  m_aligner      = new ChannelAligner(this);
+
+  connectAll();
+}
+
+PairedChannelForwarder::~PairedChannelForwarder()
+{
+
+}
+
+void
+PairedChannelForwarder::connectAll()
+{
+  connect(
+        m_forwarder_hi,
+        SIGNAL(dataAvailable()),
+        this,
+        SLOT(onDataAvailable()));
+
+  connect(
+        m_forwarder_lo,
+        SIGNAL(dataAvailable()),
+        this,
+        SLOT(onDataAvailable()));
+
+  connect(
+        m_forwarder_hi,
+        SIGNAL(stateChanged(int,QString)),
+        this,
+        SLOT(onStateChanged(int,QString)));
+
+  connect(
+        m_forwarder_lo,
+        SIGNAL(stateChanged(int,QString)),
+        this,
+        SLOT(onStateChanged(int,QString)));
+
+  connect(
+        m_forwarder_hi,
+        SIGNAL(blocksShed(quint64, quint64)),
+        this,
+        SLOT(onBlocksShed()));
+
+  connect(
+        m_forwarder_lo,
+        SIGNAL(blocksShed(quint64, quint64)),
+        this,
+        SLOT(onBlocksShed()));
+
+  connect(
+        m_aligner,
+        SIGNAL(delayChanged(qreal)),
+        this,
+        SIGNAL(delayChanged(qreal)));
+}
+
+void
+PairedChannelForwarder::setAnalyzer(Suscan::Analyzer *analyzer)
+{
+  m_analyzer = analyzer;
+
+  m_forwarder_lo->setAnalyzer(analyzer);
+  m_forwarder_hi->setAnalyzer(analyzer);
+}
+
+void
+PairedChannelForwarder::setFFTSizeHint(unsigned int fftSize)
+{
+  m_forwarder_lo->setFFTSizeHint(fftSize);
+  m_forwarder_hi->setFFTSizeHint(fftSize);
+}
+
+void
+PairedChannelForwarder::setDelayEstimation(bool enabled)
+{
+  m_aligner->setEstimationEnabled(enabled);
+}
+
+void
+PairedChannelForwarder::setDelayCompensation(bool enabled)
+{
+  m_aligner->setCompensationEnabled(enabled);
+}
+
+bool
+PairedChannelForwarder::setChannelizer(SharedChannelizer *channelizer)
+{
+  if (isRunning())
+    return false;
+
+  if (m_channelizer != nullptr)
+    disconnect(m_channelizer, nullptr, this, nullptr);
+
+  m_channelizer = channelizer;
+
+  if (m_channelizer != nullptr) {
+    connect(
+          m_channelizer,
+          SIGNAL(opened()),
+          this,
+          SLOT(onChannelizerOpened()));
+
+    connect(
+          m_channelizer,
+          SIGNAL(closed()),
+          this,
+          SLOT(onChannelizerClosed()));
+
+    connect(
+          m_channelizer,
+          SIGNAL(error(QString)),
+          this,
+          SLOT(onChannelizerError(QString)));
+
+    connect(
+          m_channelizer,
+          SIGNAL(dataAvailable()),
+          this,
+          SLOT(onChannelizerData()));
+
+    connect(
+          m_channelizer,
+          SIGNAL(blocksShed(quint64, quint64)),
+          this,
+          SIGNAL(dataShed(quint64, quint64)));
+  }
+
+  return true;
+}
+
+SharedChannelizer *
+PairedChannelForwarder::channelizer() const
+{
+  return m_channelizer;
+}
+
+void
+PairedChannelForwarder::setDropPolicy(RawChannelForwarderDropPolicy policy)
+{
+  m_forwarder_lo->setDropPolicy(policy);
+  m_forwarder_hi->setDropPolicy(policy);
+}
+
+void
+PairedChannelForwarder::setMaxPendingBlocks(unsigned blocks)
+{
+  m_forwarder_lo->setMaxPendingBlocks(blocks);
+  m_forwarder_hi->setMaxPendingBlocks(blocks);
+}
+
+void
+PairedChannelForwarder::setNotifyRate(qreal rate)
+{
+  m_forwarder_lo->setNotifyRate(rate);
+  m_forwarder_hi->setNotifyRate(rate);
+}
+
+quint64
+PairedChannelForwarder::getDroppedBlocks() const
+{
+  if (m_tapped)
+    return m_channelizer->droppedBlocks();
+
+  return m_forwarder_lo->droppedBlocks() + m_forwarder_hi->droppedBlocks();
+}
+
+quint64
+PairedChannelForwarder::getLateBlocks() const
+{
+  if (m_tapped)
+    return m_channelizer->lateBlocks();
+
+  return m_forwarder_lo->lateBlocks() + m_forwarder_hi->lateBlocks();
+}
+
+qreal
+PairedChannelForwarder::getDelay() const
+{
+  return m_aligner->delay();
+}
+
+bool
+PairedChannelForwarder::calcOffsetFrequencies(
+    qreal freq, qreal &off1, qreal &off2)
+{
+  qreal delta;
+
+  if (m_analyzer == nullptr)
+    return false;
+
+  delta = .5 * SCAST(qreal, m_analyzer->getSampleRate());
+
+  off1 = freq - m_analyzer->getFrequency();
+  if (off1 > 0)
+    off1 -= delta;
+  off2 = off1 + delta;
+
+  return true;
+}
+
+void
+PairedChannelForwarder::calcBins(qreal freq)
+{
+  qreal off1, off2;
+  unsigned M = m_channelizer->channels();
+
+  if (!calcOffsetFrequencies(freq, off1, off2))
+    return;
+
+  // HI is derived from LO so that both always land on a paired bin
+  m_loBin = m_channelizer->binOf(off1);
+  m_hiBin = (m_loBin + M / 2) % M;
+}
+
+void
+PairedChannelForwarder::emitTapState(int state, QString const &message)
+{
+  emit stateChanged(0, state, message);
+  emit stateChanged(1, state, message);
+}
+
+bool
+PairedChannelForwarder::open(SUFREQ freq, SUFLOAT bandwidth)
+{
+  qreal off1, off2;
+
+  if (!calcOffsetFrequencies(freq, off1, off2))
+    return false;
+
+  if (isRunning())
+    return false;
+
+  m_desiredFrequency = freq;
+  m_desiredBandwidth = bandwidth;
+
+  m_aligner->reset();
+  resetCombiner();
+  m_loSpan.clear();
+  m_hiSpan.clear();
+
+  if (m_channelizer != nullptr) {
+    calcBins(freq);
+
+    if (!m_channelizer->acquire())
+      return false;
+
+    m_tapped = true;
+
+    // Opening is always asynchronous, even if the channelizer is ready
+    emitTapState(RAW_CHANNEL_FORWARDER_OPENING, "Waiting for channelizer...");
+    if (m_channelizer->isReady())
+      QMetaObject::invokeMethod(
+            this,
+            "onChannelizerOpened",
+            Qt::QueuedConnection);
+
+    return true;
+  }
+
+  m_forwarder_lo->open(off1, bandwidth);
+  m_forwarder_hi->open(off2, bandwidth);
+
+  return true;
+}
+
+bool
+PairedChannelForwarder::isRunning() const
+{
+  return m_tapped
+      || m_forwarder_lo->isRunning()
+      || m_forwarder_hi->isRunning();
+}
+
+bool
+PairedChannelForwarder::close()
+{
+  if (m_analyzer == nullptr)
+    return false;
+
+  if (m_tapped) {
+    m_tapped    = false;
+    m_loRunning = m_hiRunning = false;
+    m_channelizer->release();
+
+    emitTapState(RAW_CHANNEL_FORWARDER_IDLE, "Closed by user");
+    emit closed();
+
+    return true;
+  }
+
+  m_forwarder_lo->close();
+  m_forwarder_hi->close();
+
+  return true;
+}
+
+qreal
+PairedChannelForwarder::setBandwidth(qreal bandwidth)
+{
+  qreal ret1, ret2;
+
+  m_desiredBandwidth = bandwidth;
+
+  if (m_tapped)
+    return getTrueBandwidth();
+
+  ret1 = m_forwarder_lo->setBandwidth(bandwidth);
+  ret2 = m_forwarder_hi->setBandwidth(bandwidth);
+
+  return .5 * (ret1 + ret2);
+}
+
+void
+PairedChannelForwarder::setFrequency(qreal freq)
+{
+  qreal off1, off2;
+
+  m_desiredFrequency = freq;
+
+  if (m_tapped) {
+    calcBins(freq);
+    return;
+  }
+
+  if (!calcOffsetFrequencies(freq, off1, off2))
+    return;
+
+  m_forwarder_lo->setFrequency(off1);
+  m_forwarder_hi->setFrequency(off2);
+}
+
+qreal
+PairedChannelForwarder::getFrequency() const
+{
+  return m_desiredFrequency;
+}
+
+qreal
+PairedChannelForwarder::getFrequencyLo() const
+{
+  if (m_analyzer == nullptr)
+    return 0;
+
+  if (m_tapped)
+    return m_channelizer->binFrequency(m_loBin) + m_analyzer->getFrequency();
+
+  return m_forwarder_lo->getFrequency() + m_analyzer->getFrequency();
+}
+
+qreal
+PairedChannelForwarder::getFrequencyHi() const
+{
+  if (m_analyzer == nullptr)
+    return 0;
+
+  if (m_tapped)
+    return m_channelizer->binFrequency(m_hiBin) + m_analyzer->getFrequency();
+
+  return m_forwarder_hi->getFrequency() + m_analyzer->getFrequency();
+}
+
+struct timeval
+PairedChannelForwarder::dataTime() const
+{
+  return m_dataTime;
+}
+
+qreal
+PairedChannelForwarder::getMinBandwidth() const
+{
+  if (m_tapped)
+    return m_channelizer->channelRate();
+
+  return fmax(
+        m_forwarder_lo->getMinBandwidth(),
+        m_forwarder_hi->getMinBandwidth());
+}
+
+qreal
+PairedChannelForwarder::getMaxBandwidth() const
+{
+  if (m_tapped)
+    return m_channelizer->channelRate();
+
+  return fmin(
+        m_forwarder_lo->getMaxBandwidth(),
+        m_forwarder_hi->getMaxBandwidth());
+}
+
+qreal
+PairedChannelForwarder::getTrueBandwidth() const
+{
+  if (m_tapped)
+    return m_channelizer->channelRate();
+
+  return .5 * (m_forwarder_lo->getTrueBandwidth() + m_forwarder_hi->getTrueBandwidth());
+}
+
+qreal
+PairedChannelForwarder::getEquivFs() const
+{
+  if (m_tapped)
+    return m_channelizer->channelRate();
+
+  if (m_forwarder_lo->isRunning())
+    return m_forwarder_lo->getEquivFs();
+  else if (m_forwarder_hi->isRunning())
+    return m_forwarder_hi->getEquivFs();
+
+  return 0;
+}
+
+unsigned
+PairedChannelForwarder::getDecimation() const
+{
+  if (m_tapped)
+    return m_channelizer->decimation();
+
+  if (m_forwarder_lo->isRunning())
+    return m_forwarder_lo->getDecimation();
+  else if (m_forwarder_hi->isRunning())
+    return m_forwarder_hi->getDecimation();
+
+  return 1;
+}
+
+///////////////////////////////// Slots ////////////////////////////////////////
+void
+PairedChannelForwarder::onStateChanged(int state, QString const &message)
+{
+  RawChannelForwarder *sender = SCAST(RawChannelForwarder *, QObject::sender());
+
+  emit stateChanged(sender == m_forwarder_hi, state, message);
+
+  if (state == RAW_CHANNEL_FORWARDER_IDLE) {
+    if (message.startsWith("Failed"))
+      emit error(message);
+    else if (!isRunning())
+      emit closed();
+
+    m_forwarder_hi->close();
+    m_forwarder_lo->close();
+
+    m_loRunning = m_hiRunning = false;
+    m_loSpan.clear();
+    m_hiSpan.clear();
+  } else if (state == RAW_CHANNEL_FORWARDER_RUNNING) {
+    if (sender == m_forwarder_lo)
+      m_loRunning = true;
+    else if (sender == m_forwarder_hi)
+      m_hiRunning = true;
+
+    if (m_loRunning && m_hiRunning)
+      emit opened();
+  }
+}
+
+void
+PairedChannelForwarder::onDataAvailable()
+{
+  RawChannelForwarder *sender = SCAST(RawChannelForwarder *, QObject::sender());
+  quint64 begin, end, loEnd, hiEnd;
+
+  if (!m_loRunning || !m_hiRunning)
+    return;
+
+  if (sender == m_forwarder_lo)
+    m_loSpan.append(sender->data(), sender->dataIndex());
+  else if (sender == m_forwarder_hi)
+    m_hiSpan.append(sender->data(), sender->dataIndex());
+
+  if (m_loSpan.samples.empty() || m_hiSpan.samples.empty())
+    return;
+
+  // Only the samples present in both channels can be paired
+  loEnd = m_loSpan.end();
+  hiEnd = m_hiSpan.end();
+  begin = qMax(m_loSpan.start, m_hiSpan.start);
+  end   = qMin(loEnd, hiEnd);
+
+  m_loSpan.discard(begin);
+  m_hiSpan.discard(begin);
+
+  if (end > begin) {
+    size_t size = static_cast<size_t>(end - begin);
+
+    pair(
+          m_forwarder_lo->sampleTime(begin),
+          m_loSpan.samples.data(),
+          m_hiSpan.samples.data(),
+          size);
+
+    m_loSpan.discard(end);
+    m_hiSpan.discard(end);
+  }
+}
+
+void
+PairedChannelForwarder::pair(
+    struct timeval const &time,
+    const SUCOMPLEX *lo,
+    const SUCOMPLEX *hi,
+    size_t size)
+{
+  struct timeval lead;
+  qreal fs = getEquivFs();
+  qreal leadTime = 0;
+
+  // The first output started with the samples carried over, which went
+  // through the nominal delay of the aligner filters
+  if (fs > 0)
+    leadTime = (combinerCarry() + m_aligner->latency()) / fs;
+
+  lead.tv_sec  = static_cast<time_t>(std::floor(leadTime));
+  lead.tv_usec = static_cast<suseconds_t>((leadTime - lead.tv_sec) * 1e6);
+
+  m_aligner->process(lo, hi, size);
+
+  if (combine(lo, hi, size)) {
+    timersub(&time, &lead, &m_dataTime);
+    emit dataAvailable();
+  }
+}
+
+void
+PairedChannelForwarder::onBlocksShed()
+{
+  emit dataShed(getDroppedBlocks(), getLateBlocks());
+}
+
+void
+PairedChannelForwarder::onChannelizerOpened()
+{
+  if (m_tapped && !m_loRunning) {
+    m_loRunning = m_hiRunning = true;
+    emitTapState(RAW_CHANNEL_FORWARDER_RUNNING, "Channelizer bin running");
+    emit opened();
+  }
+}
+
+void
+PairedChannelForwarder::onChannelizerClosed()
+{
+  if (m_tapped) {
+    m_tapped    = false;
+    m_loRunning = m_hiRunning = false;
+    emitTapState(RAW_CHANNEL_FORWARDER_IDLE, "Channelizer closed");
+    emit closed();
+  }
+}
+
+void
+PairedChannelForwarder::onChannelizerError(QString message)
+{
+  if (m_tapped) {
+    m_tapped    = false;
+    m_loRunning = m_hiRunning = false;
+    emitTapState(RAW_CHANNEL_FORWARDER_IDLE, message);
+    emit error(message);
+  }
+}
+
+void
+PairedChannelForwarder::onChannelizerData()
+{
+  if (m_tapped && m_loRunning) {
+    auto const &bufLo = m_channelizer->channel(m_loBin);
+    auto const &bufHi = m_channelizer->channel(m_hiBin);
+
+    pair(
+          m_channelizer->channelTime(),
+          bufLo.data(),
+          bufHi.data(),
+          bufLo.size());
+  }
+}
+
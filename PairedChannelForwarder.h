@@ -0,0 +1,169 @@
+//
+//    PairedChannelForwarder.h: Synchronous LO/HI channel pair
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+#ifndef PAIREDCHANNELFORWARDER_H
+#define PAIREDCHANNELFORWARDER_H
+
+#include <QObject>
+#include "RawChannelForwarder.h"
+#include "ChannelAligner.h"
+
+//
+// Opens the LO and HI copies of the same channel in the 2RX combined
+// spectrum, waits for both of them to deliver a block and hands the pair
+// to combine(). Subclasses are not expected to derive from this class
+// directly, but through the ChannelPairEngine template, which implements
+// combine() in terms of a combiner policy (see ChannelCombiners.h).
+//
+// Alternatively, the pair can be tapped from a SharedChannelizer (see
+// setChannelizer()). In that case no inspectors are opened: the LO and
+// HI channels are the channelizer bins closest to the requested
+// frequency, and their bandwidth is fixed to the bin spacing.
+//
+
+// Samples kept from one channel while the other one catches up
+#define PAIRED_CHANNEL_FORWARDER_MAX_SPAN (1 << 20)
+
+namespace SigDigger {
+  class SharedChannelizer;
+
+  //
+  // Samples of one channel not yet paired, along with the absolute index
+  // of the first of them. Forwarders may deliver spans of different
+  // lengths (or with gaps), so pairing is done on the overlap of both.
+  //
+  struct PairedSpan {
+    std::vector<SUCOMPLEX> samples;
+    quint64                start = 0;
+
+    void    clear();
+    quint64 end() const;
+    void    append(std::vector<SUCOMPLEX> const &, quint64 index);
+    void    discard(quint64 until);
+  };
+
+  class PairedChannelForwarder : public QObject
+  {
+    Q_OBJECT
+
+    Suscan::Analyzer    *m_analyzer = nullptr;
+    UIMediator          *m_mediator    = nullptr;
+
+    RawChannelForwarder *m_forwarder_lo = nullptr;
+    RawChannelForwarder *m_forwarder_hi = nullptr;
+    ChannelAligner      *m_aligner      = nullptr;
+
+    SharedChannelizer   *m_channelizer  = nullptr;
+    bool                 m_tapped       = false;
+    unsigned             m_loBin        = 0;
+    unsigned             m_hiBin        = 0;
+
+    qreal               m_desiredBandwidth = 0;
+    qreal               m_desiredFrequency = 0;
+
+    bool m_hiRunning = false;
+    bool m_loRunning = false;
+
+    PairedSpan m_loSpan;
+    PairedSpan m_hiSpan;
+
+    struct timeval m_dataTime = {0, 0};
+
+    void connectAll();
+    bool calcOffsetFrequencies(qreal freq, qreal &off1, qreal &off2);
+    void calcBins(qreal freq);
+    void pair(
+        struct timeval const &,
+        const SUCOMPLEX *lo,
+        const SUCOMPLEX *hi,
+        size_t size);
+    void emitTapState(int, QString const &);
+
+  protected:
+    // Returns true if the combiner produced new data
+    virtual bool combine(
+        const SUCOMPLEX *lo,
+        const SUCOMPLEX *hi,
+        size_t size) = 0;
+    virtual void resetCombiner() = 0;
+
+    // Input samples of previous pairs that go into the next output
+    virtual size_t combinerCarry() const = 0;
+
+  public:
+    PairedChannelForwarder(UIMediator *, QObject *parent = nullptr);
+    virtual ~PairedChannelForwarder() override;
+
+    void  setAnalyzer(Suscan::Analyzer *);
+    void  setFFTSizeHint(unsigned int);
+    bool  setChannelizer(SharedChannelizer *);
+    SharedChannelizer *channelizer() const;
+    void  setDelayEstimation(bool);
+    void  setDelayCompensation(bool);
+    qreal getDelay() const;
+
+    void  setDropPolicy(RawChannelForwarderDropPolicy);
+    void  setMaxPendingBlocks(unsigned);
+    void  setNotifyRate(qreal);
+
+    // Blocks shed by the forwarders because consumers fell behind
+    quint64 getDroppedBlocks() const;
+    quint64 getLateBlocks() const;
+
+    bool  open(SUFREQ, SUFLOAT);
+    bool  isRunning() const;
+    bool  close();
+
+    qreal setBandwidth(qreal bandwidth);
+    void  setFrequency(qreal freq);
+    qreal getFrequency() const;
+
+    qreal getFrequencyLo() const;
+    qreal getFrequencyHi() const;
+
+    // Source time of the first sample of the combined data, derived from
+    // its sample index rather than from when it was delivered
+    struct timeval dataTime() const;
+
+    qreal getMinBandwidth() const;
+    qreal getMaxBandwidth() const;
+    qreal getTrueBandwidth() const;
+    qreal getEquivFs() const;
+    unsigned getDecimation() const;
+
+  public slots:
+    void onStateChanged(int, QString const &);
+    void onDataAvailable();
+    void onBlocksShed();
+    void onChannelizerOpened();
+    void onChannelizerClosed();
+    void onChannelizerError(QString);
+    void onChannelizerData();
+
+  signals:
+    void stateChanged(int, int, QString);
+    void error(QString);
+    void opened();
+    void closed();
+    void dataAvailable();
+    void delayChanged(qreal);
+    void dataShed(quint64 dropped, quint64 late);
+  };
+}
+
+#endif // PAIREDCHANNELFORWARDER_H
@@ -22,10 +22,13 @@
 #include <QDir>
 #include <GlobalProperty.h>
 #include <QTextStream>
+#include <QFileDialog>
+#include <SuWidgetsHelpers.h>
 
 #include "PhaseComparator.h"
 #include "PhasePlotPage.h"
 #include "PhasePlotPageFactory.h"
+#include "PhaseComparatorBank.h"
 #include "SimplePhaseComparator.h"
 #include "ui_PhaseComparator.h"
 
@@ -40,6 +43,10 @@ void
 PhaseComparatorConfig::deserialize(Suscan::Object const &conf)
 {
   LOAD(collapsed);
+  LOAD(compensateDelay);
+  LOAD(integration);
+  LOAD(useChannelizer);
+  LOAD(channelizerBins);
 }
 
 Suscan::Object &&
@@ -50,6 +57,10 @@ PhaseComparatorConfig::serialize()
   obj.setClass("PhaseComparatorConfig");
 
   STORE(collapsed);
+  STORE(compensateDelay);
+  STORE(integration);
+  STORE(useChannelizer);
+  STORE(channelizerBins);
 
   return persist(obj);
 }
@@ -66,7 +77,7 @@ PhaseComparator::PhaseComparator(
 
   assertConfig();
 
-  m_comparator = new SimplePhaseComparator(mediator, this);
+  m_bank      = new PhaseComparatorBank(mediator, this);
   m_mediator  = mediator;
   m_spectrum  = mediator->getMainSpectrum();
 
@@ -96,6 +107,18 @@ PhaseComparator::connectAll()
         this,
         SLOT(onCloseChannel()));
 
+  connect(
+        ui->closeAllButton,
+        SIGNAL(clicked(bool)),
+        this,
+        SLOT(onCloseAllChannels()));
+
+  connect(
+        ui->targetCombo,
+        SIGNAL(activated(int)),
+        this,
+        SLOT(onSelectTarget()));
+
   connect(
         ui->frequencySpin,
         SIGNAL(valueChanged(double)),
@@ -108,6 +131,36 @@ PhaseComparator::connectAll()
         this,
         SLOT(onAdjustBandwidth()));
 
+  connect(
+        ui->delayCompensationCheck,
+        SIGNAL(toggled(bool)),
+        this,
+        SLOT(onToggleDelayCompensation()));
+
+  connect(
+        ui->integrationSpin,
+        SIGNAL(valueChanged(int)),
+        this,
+        SLOT(onAdjustIntegration()));
+
+  connect(
+        ui->channelizerCheck,
+        SIGNAL(toggled(bool)),
+        this,
+        SLOT(onToggleChannelizer()));
+
+  connect(
+        ui->channelizerBinsSpin,
+        SIGNAL(valueChanged(int)),
+        this,
+        SLOT(onAdjustChannelizerBins()));
+
+  connect(
+        ui->saveEventsButton,
+        SIGNAL(clicked(bool)),
+        this,
+        SLOT(onSaveEvents()));
+
   connect(
         m_spectrum,
         SIGNAL(frequencyChanged(qint64)),
@@ -115,49 +168,122 @@ PhaseComparator::connectAll()
         SLOT(onSpectrumFrequencyChanged(qint64)));
 
   connect(
-        m_comparator,
-        SIGNAL(opened()),
+        m_bank,
+        SIGNAL(targetOpened(int)),
+        this,
+        SLOT(onTargetOpened(int)));
+
+  connect(
+        m_bank,
+        SIGNAL(targetError(int, QString)),
         this,
-        SLOT(onComparatorOpened()));
+        SLOT(onTargetError(int, QString)));
 
   connect(
-        m_comparator,
-        SIGNAL(error(QString)),
+        m_bank,
+        SIGNAL(targetClosed(int)),
         this,
-        SLOT(onComparatorError(QString)));
+        SLOT(onTargetClosed(int)));
 
   connect(
-        m_comparator,
-        SIGNAL(closed()),
+        m_bank,
+        SIGNAL(targetData(int)),
         this,
-        SLOT(onComparatorClosed()));
+        SLOT(onTargetData(int)));
 
   connect(
-        m_comparator,
-        SIGNAL(dataAvailable()),
+        m_bank,
+        SIGNAL(targetStateChanged(int, int, int, QString)),
         this,
-        SLOT(onComparatorData()));
+        SLOT(onTargetStateChanged(int, int, int, QString)));
 
   connect(
-        m_comparator,
-        SIGNAL(stateChanged(int,int,QString)),
+        m_bank,
+        SIGNAL(targetDelayChanged(int, qreal)),
         this,
-        SLOT(onComparatorStateChanged(int, int, QString)));
+        SLOT(onTargetDelayChanged(int, qreal)));
+
+  connect(
+        m_bank,
+        SIGNAL(targetDataShed(int, quint64, quint64)),
+        this,
+        SLOT(onTargetDataShed(int, quint64, quint64)));
+
+  connect(
+        m_bank,
+        SIGNAL(eventRecorded(int)),
+        this,
+        SLOT(onEventRecorded(int)));
+}
+
+int
+PhaseComparator::selectedTarget() const
+{
+  if (ui->targetCombo->currentIndex() < 0)
+    return -1;
+
+  return ui->targetCombo->currentData().value<int>();
+}
+
+int
+PhaseComparator::targetOfPlotPage(QObject *page) const
+{
+  for (auto &p : m_targets)
+    if (p.second.plotPage == page)
+      return p.first;
+
+  return -1;
+}
+
+void
+PhaseComparator::selectTarget(int id)
+{
+  int index = ui->targetCombo->findData(id);
+
+  if (index >= 0) {
+    BLOCKSIG(ui->targetCombo, setCurrentIndex(index));
+    refreshSelectedTarget();
+  }
+}
+
+void
+PhaseComparator::removeTarget(int id)
+{
+  auto it = m_targets.find(id);
+
+  if (it == m_targets.end())
+    return;
+
+  // The plot page is left open, so that the user can still inspect it
+  if (it->second.haveNamChan) {
+    m_spectrum->removeChannel(it->second.namChanLo);
+    m_spectrum->removeChannel(it->second.namChanHi);
+    m_spectrum->updateOverlay();
+  }
+
+  m_targets.erase(it);
+
+  refreshTargetList();
 }
 
 void
-PhaseComparator::updatePlotProperties()
+PhaseComparator::updatePlotProperties(int id)
 {
-  if (m_plotPage != nullptr) {
-    m_plotPage->setFreqencyLimits(
+  auto it = m_targets.find(id);
+  auto comparator = m_bank->target(id);
+
+  if (it != m_targets.end()
+      && it->second.plotPage != nullptr
+      && comparator != nullptr) {
+    it->second.plotPage->setFreqencyLimits(
           ui->frequencySpin->minimum(),
           ui->frequencySpin->maximum());
 
-    m_plotPage->setProperties(
+    it->second.plotPage->setProperties(
           this,
-          m_comparator->getEquivFs(),
-          ui->frequencySpin->value(),
-          ui->bandwidthSpin->value());
+          comparator->getEquivFs() / comparator->getIntegration(),
+          m_bank->targetFrequency(id),
+          comparator->getTrueBandwidth());
   }
 }
 
@@ -173,7 +299,8 @@ PhaseComparator::applySpectrumState()
     ui->frequencySpin->setMinimum(min);
     ui->frequencySpin->setMaximum(max);
 
-    updatePlotProperties();
+    for (auto &p : m_targets)
+      updatePlotProperties(p.first);
   }
 
   onAdjustFrequency();
@@ -189,82 +316,142 @@ PhaseComparator::channelColor(bool state) const
 }
 
 void
-PhaseComparator::refreshNamedChannel()
+PhaseComparator::refreshNamedChannel(int id)
 {
+  auto it = m_targets.find(id);
+  auto comparator = m_bank->target(id);
+
+  if (it == m_targets.end())
+    return;
+
+  TargetState &target = it->second;
   bool shouldHaveNamChan =
          m_analyzer != nullptr
-      && m_comparator->isRunning();
+      && comparator != nullptr
+      && comparator->isRunning();
 
   // Check whether we should have a named channel here.
-  if (shouldHaveNamChan != m_haveNamChan) { // Inconsistency!
-    m_haveNamChan = shouldHaveNamChan;
+  if (shouldHaveNamChan != target.haveNamChan) { // Inconsistency!
+    target.haveNamChan = shouldHaveNamChan;
 
     // Make sure we have a named channel
-    if (m_haveNamChan) {
-      auto chBw   = m_comparator->getTrueBandwidth();
-      auto loFreq = m_comparator->getFrequencyLo();
-      auto hiFreq = m_comparator->getFrequencyHi();
-
-      m_namChanLo = m_mediator->getMainSpectrum()->addChannel(
-            "Phase comparator (LO)",
+    if (target.haveNamChan) {
+      auto chBw   = comparator->getTrueBandwidth();
+      auto loFreq = comparator->getFrequencyLo();
+      auto hiFreq = comparator->getFrequencyHi();
+      QString name = "Phase comparator #" + QString::number(id + 1);
+
+      target.namChanLo = m_mediator->getMainSpectrum()->addChannel(
+            name + " (LO)",
             loFreq,
             -chBw / 2,
             +chBw / 2,
-            channelColor(m_loOpened),
-            channelColor(m_loOpened),
-            channelColor(m_loOpened));
-      m_namChanHi = m_mediator->getMainSpectrum()->addChannel(
-            "Phase comparator (HI)",
+            channelColor(target.loOpened),
+            channelColor(target.loOpened),
+            channelColor(target.loOpened));
+      target.namChanHi = m_mediator->getMainSpectrum()->addChannel(
+            name + " (HI)",
             hiFreq,
             -chBw / 2,
             +chBw / 2,
-            channelColor(m_hiOpened),
-            channelColor(m_hiOpened),
-            channelColor(m_hiOpened));
+            channelColor(target.hiOpened),
+            channelColor(target.hiOpened),
+            channelColor(target.hiOpened));
     } else {
       // We should NOT have a named channel, remove
-      m_spectrum->removeChannel(m_namChanLo);
-      m_spectrum->removeChannel(m_namChanHi);
+      m_spectrum->removeChannel(target.namChanLo);
+      m_spectrum->removeChannel(target.namChanHi);
       m_spectrum->updateOverlay();
     }
-  } else if (m_haveNamChan) {
-    auto chBw   = m_comparator->getTrueBandwidth();
-    auto loFreq = m_comparator->getFrequencyLo();
-    auto hiFreq = m_comparator->getFrequencyHi();
-
-    m_namChanLo.value()->frequency   = loFreq;
-    m_namChanLo.value()->lowFreqCut  = -chBw / 2;
-    m_namChanLo.value()->highFreqCut = +chBw / 2;
-    m_namChanLo.value()->cutOffColor = channelColor(m_loOpened);
-    m_namChanLo.value()->markerColor = channelColor(m_loOpened);
-    m_namChanLo.value()->boxColor    = channelColor(m_loOpened);
-    m_spectrum->refreshChannel(m_namChanLo);
-
-    m_namChanHi.value()->frequency   = hiFreq;
-    m_namChanHi.value()->lowFreqCut  = -chBw / 2;
-    m_namChanHi.value()->highFreqCut = +chBw / 2;
-    m_namChanHi.value()->cutOffColor = channelColor(m_hiOpened);
-    m_namChanHi.value()->markerColor = channelColor(m_hiOpened);
-    m_namChanHi.value()->boxColor    = channelColor(m_hiOpened);
-    m_spectrum->refreshChannel(m_namChanHi);
+  } else if (target.haveNamChan) {
+    auto chBw   = comparator->getTrueBandwidth();
+    auto loFreq = comparator->getFrequencyLo();
+    auto hiFreq = comparator->getFrequencyHi();
+
+    target.namChanLo.value()->frequency   = loFreq;
+    target.namChanLo.value()->lowFreqCut  = -chBw / 2;
+    target.namChanLo.value()->highFreqCut = +chBw / 2;
+    target.namChanLo.value()->cutOffColor = channelColor(target.loOpened);
+    target.namChanLo.value()->markerColor = channelColor(target.loOpened);
+    target.namChanLo.value()->boxColor    = channelColor(target.loOpened);
+    m_spectrum->refreshChannel(target.namChanLo);
+
+    target.namChanHi.value()->frequency   = hiFreq;
+    target.namChanHi.value()->lowFreqCut  = -chBw / 2;
+    target.namChanHi.value()->highFreqCut = +chBw / 2;
+    target.namChanHi.value()->cutOffColor = channelColor(target.hiOpened);
+    target.namChanHi.value()->markerColor = channelColor(target.hiOpened);
+    target.namChanHi.value()->boxColor    = channelColor(target.hiOpened);
+    m_spectrum->refreshChannel(target.namChanHi);
 
     m_spectrum->updateOverlay();
   }
 }
 
+void
+PhaseComparator::refreshTargetList()
+{
+  int selected = selectedTarget();
+
+  BLOCKSIG_BEGIN(ui->targetCombo);
+    ui->targetCombo->clear();
+
+    for (auto &p : m_targets)
+      ui->targetCombo->addItem(
+            "#" + QString::number(p.first + 1) + ": " +
+            SuWidgetsHelpers::formatQuantity(
+              m_bank->targetFrequency(p.first),
+              6,
+              "Hz"),
+            QVariant::fromValue(p.first));
+
+    int index = ui->targetCombo->findData(selected);
+    if (index < 0)
+      index = ui->targetCombo->count() - 1;
+    ui->targetCombo->setCurrentIndex(index);
+  BLOCKSIG_END();
+
+  refreshSelectedTarget();
+}
+
+void
+PhaseComparator::refreshSelectedTarget()
+{
+  auto comparator = m_bank->target(selectedTarget());
+
+  if (comparator != nullptr) {
+    BLOCKSIG(ui->frequencySpin, setValue(m_bank->targetFrequency(selectedTarget())));
+    BLOCKSIG(ui->bandwidthSpin, setValue(comparator->getTrueBandwidth()));
+  }
+
+  // Delays are only estimated while they are compensated
+  if (comparator != nullptr && m_panelConfig->compensateDelay)
+    ui->delayLabel->setText(
+          QString::asprintf("%+.3f samples", comparator->getDelay()));
+  else
+    ui->delayLabel->setText("N/A");
+
+  refreshUi();
+}
+
 void
 PhaseComparator::refreshUi()
 {
-  bool running   = m_comparator->isRunning();
-  bool canRun    = m_analyzer != nullptr && !running;
-  bool canAdjust = running;
+  auto comparator = m_bank->target(selectedTarget());
+  bool running    = comparator != nullptr && comparator->isRunning();
+  bool canRun     = m_analyzer != nullptr;
+  bool canAdjust  = running;
 
+  ui->targetCombo->setEnabled(!m_targets.empty());
   ui->frequencySpin->setEnabled(canAdjust);
   ui->bandwidthSpin->setEnabled(canAdjust);
+  ui->saveEventsButton->setEnabled(!m_bank->events().empty());
+  ui->channelizerBinsSpin->setEnabled(!m_bank->channelizerRunning());
 
   BLOCKSIG_BEGIN(ui->openButton);
     ui->openButton->setEnabled(canRun);
     ui->closeButton->setEnabled(running);
+    ui->closeAllButton->setEnabled(m_bank->count() > 0);
   BLOCKSIG_END();
 }
 
@@ -280,6 +467,32 @@ PhaseComparator::applyConfig()
 {
   setProperty("collapsed", m_panelConfig->collapsed);
 
+  BLOCKSIG(
+        ui->delayCompensationCheck,
+        setChecked(m_panelConfig->compensateDelay));
+  m_bank->setDelayCompensation(m_panelConfig->compensateDelay);
+
+  if (m_panelConfig->integration < 1)
+    m_panelConfig->integration = 1;
+
+  BLOCKSIG(
+        ui->integrationSpin,
+        setValue(m_panelConfig->integration));
+  m_bank->setIntegration(SCAST(unsigned, m_panelConfig->integration));
+
+  if (m_panelConfig->channelizerBins < 2)
+    m_panelConfig->channelizerBins = 2;
+
+  BLOCKSIG(
+        ui->channelizerCheck,
+        setChecked(m_panelConfig->useChannelizer));
+  BLOCKSIG(
+        ui->channelizerBinsSpin,
+        setValue(m_panelConfig->channelizerBins));
+  m_bank->setChannelizerEnabled(m_panelConfig->useChannelizer);
+  m_bank->setChannelizerChannels(
+        SCAST(unsigned, m_panelConfig->channelizerBins));
+
   refreshUi();
 }
 
@@ -302,53 +515,65 @@ void
 PhaseComparator::setState(int, Suscan::Analyzer *analyzer)
 {
   m_analyzer = analyzer;
-  m_comparator->setAnalyzer(analyzer);
+  m_bank->setAnalyzer(analyzer);
 
 
   if (analyzer != nullptr) {
     auto windowSize = m_mediator->getAnalyzerParams()->windowSize;
-    m_comparator->setFFTSizeHint(windowSize);
+    m_bank->setFFTSizeHint(windowSize);
     applySpectrumState();
   }
 
-  refreshNamedChannel();
+  for (auto &p : m_targets)
+    refreshNamedChannel(p.first);
+
   refreshUi();
 }
 
 void
-PhaseComparator::openPlot()
+PhaseComparator::openPlot(int id)
 {
   auto sus = Suscan::Singleton::get_instance();
   auto factory = sus->findTabWidgetFactory("PhasePlotPage");
+  auto it = m_targets.find(id);
+  PhasePlotPage *plotPage;
 
-  if (m_analyzer == nullptr)
+  if (m_analyzer == nullptr || it == m_targets.end())
     return;
 
-  m_plotPage = SCAST(PhasePlotPage *, factory->make(m_mediator));
-  m_plotPage->setColorConfig(m_colors);
+  plotPage = SCAST(PhasePlotPage *, factory->make(m_mediator));
+  plotPage->setColorConfig(m_colors);
+
+  it->second.plotPage = plotPage;
 
   connect(
-        m_plotPage,
+        plotPage,
         SIGNAL(closeReq()),
         this,
         SLOT(onClosePlotPage()));
 
   connect(
-        m_plotPage,
+        plotPage,
         SIGNAL(frequencyChanged(double)),
         this,
         SLOT(onAdjustFrequencyRequested(qreal)));
 
 
   connect(
-        m_plotPage,
+        plotPage,
         SIGNAL(bandwidthChanged(qreal)),
         this,
         SLOT(onAdjustBandwidthRequested(qreal)));
 
-  updatePlotProperties();
+  connect(
+        plotPage,
+        SIGNAL(eventDetected(CoherentEvent)),
+        this,
+        SLOT(onPlotPageEvent(CoherentEvent)));
 
-  m_mediator->addTabWidget(m_plotPage);
+  updatePlotProperties(id);
+
+  m_mediator->addTabWidget(plotPage);
 }
 
 void
@@ -383,59 +608,164 @@ PhaseComparator::onOpenChannel()
   auto bandwidth  = m_spectrum->getBandwidth();
   auto loFreq     = m_spectrum->getLoFreq();
   auto centerFreq = m_spectrum->getCenterFreq();
-  auto delta      = m_analyzer->getSampleRate() * .25;
   auto freq       = centerFreq + loFreq;
+  int  id;
 
-  BLOCKSIG(ui->bandwidthSpin, setValue(bandwidth));
-  BLOCKSIG(ui->frequencySpin, setValue(freq + delta));
+  // Selecting an already tracked frequency just brings it up
+  id = m_bank->findTarget(freq, .5 * bandwidth);
+  if (id >= 0) {
+    selectTarget(id);
+    return;
+  }
 
-  auto result = m_comparator->open(freq, bandwidth);
+  id = m_bank->open(freq, bandwidth);
 
-  if (!result) {
+  if (id < 0) {
     QMessageBox::critical(
           this,
           "Cannot open inspector",
           "Failed to open phase comparator. See log window for details");
+    return;
   }
+
+  m_targets[id] = TargetState();
+
+  refreshTargetList();
+  selectTarget(id);
 }
 
 void
 PhaseComparator::onAdjustFrequencyRequested(qreal freq)
 {
-  ui->frequencySpin->setValue(freq);
-  onAdjustFrequency();
+  int id = targetOfPlotPage(QObject::sender());
+
+  if (id >= 0) {
+    selectTarget(id);
+    ui->frequencySpin->setValue(freq);
+    onAdjustFrequency();
+  }
 }
 
 void
 PhaseComparator::onAdjustBandwidthRequested(qreal bw)
 {
-  ui->bandwidthSpin->setValue(bw);
-  onAdjustBandwidth();
+  int id = targetOfPlotPage(QObject::sender());
+
+  if (id >= 0) {
+    selectTarget(id);
+    ui->bandwidthSpin->setValue(bw);
+    onAdjustBandwidth();
+  }
+}
+
+void
+PhaseComparator::onPlotPageEvent(CoherentEvent const &event)
+{
+  int id = targetOfPlotPage(QObject::sender());
+
+  if (id >= 0)
+    m_bank->recordEvent(id, event);
 }
 
 void
 PhaseComparator::onCloseChannel()
 {
-  m_comparator->close();
+  m_bank->close(selectedTarget());
+}
+
+void
+PhaseComparator::onCloseAllChannels()
+{
+  m_bank->closeAll();
+}
+
+void
+PhaseComparator::onSelectTarget()
+{
+  refreshSelectedTarget();
 }
 
 void
 PhaseComparator::onAdjustFrequency()
 {
-  if (m_analyzer != nullptr) {
+  int id = selectedTarget();
+  auto comparator = m_bank->target(id);
+
+  if (m_analyzer != nullptr && comparator != nullptr) {
     auto delta = m_analyzer->getSampleRate() * .25;
-    m_comparator->setFrequency(ui->frequencySpin->value() - delta);
-    updatePlotProperties();
-    refreshNamedChannel();
+    comparator->setFrequency(ui->frequencySpin->value() - delta);
+    updatePlotProperties(id);
+    refreshNamedChannel(id);
+
+    int index = ui->targetCombo->findData(id);
+    if (index >= 0)
+      ui->targetCombo->setItemText(
+            index,
+            "#" + QString::number(id + 1) + ": " +
+            SuWidgetsHelpers::formatQuantity(
+              ui->frequencySpin->value(),
+              6,
+              "Hz"));
   }
 }
 
 void
 PhaseComparator::onAdjustBandwidth()
 {
-  m_comparator->setBandwidth(ui->bandwidthSpin->value());
-  updatePlotProperties();
-  refreshNamedChannel();
+  int id = selectedTarget();
+  auto comparator = m_bank->target(id);
+
+  if (comparator != nullptr) {
+    comparator->setBandwidth(ui->bandwidthSpin->value());
+    updatePlotProperties(id);
+    refreshNamedChannel(id);
+  }
+}
+
+void
+PhaseComparator::onAdjustIntegration()
+{
+  m_panelConfig->integration = ui->integrationSpin->value();
+  m_bank->setIntegration(SCAST(unsigned, m_panelConfig->integration));
+}
+
+void
+PhaseComparator::onToggleDelayCompensation()
+{
+  m_panelConfig->compensateDelay = ui->delayCompensationCheck->isChecked();
+  m_bank->setDelayCompensation(m_panelConfig->compensateDelay);
+  refreshSelectedTarget();
+}
+
+void
+PhaseComparator::onToggleChannelizer()
+{
+  m_panelConfig->useChannelizer = ui->channelizerCheck->isChecked();
+  m_bank->setChannelizerEnabled(m_panelConfig->useChannelizer);
+}
+
+void
+PhaseComparator::onAdjustChannelizerBins()
+{
+  m_panelConfig->channelizerBins = ui->channelizerBinsSpin->value();
+  m_bank->setChannelizerChannels(
+        SCAST(unsigned, m_panelConfig->channelizerBins));
+}
+
+void
+PhaseComparator::onSaveEvents()
+{
+  QString path = QFileDialog::getSaveFileName(
+        this,
+        "Save events of all targets",
+        QString(),
+        "Coherent event list (*.csv)");
+
+  if (!path.isEmpty() && !m_bank->saveEvents(path))
+    QMessageBox::critical(
+          this,
+          "Save events",
+          "Cannot save event file " + path);
 }
 
 void
@@ -444,76 +774,114 @@ PhaseComparator::onSpectrumFrequencyChanged(qint64)
   applySpectrumState();
 }
 
-
 void
-PhaseComparator::onComparatorOpened()
+PhaseComparator::onTargetOpened(int id)
 {
   m_count = 0;
 
-  ui->stateLabel->setText("Comparator opened");
-  openPlot();
+  ui->stateLabel->setText(
+        "Target #" + QString::number(id + 1) + " opened");
+  openPlot(id);
 
   refreshUi();
-  refreshNamedChannel();
+  refreshNamedChannel(id);
 }
 
 void
-PhaseComparator::onComparatorClosed()
+PhaseComparator::onTargetClosed(int id)
 {
-  ui->stateLabel->setText("Comparator closed");
-  m_plotPage = nullptr;
+  ui->stateLabel->setText(
+        "Target #" + QString::number(id + 1) + " closed");
 
+  removeTarget(id);
   refreshUi();
-  refreshNamedChannel();
 }
 
 void
-PhaseComparator::onComparatorError(QString error)
+PhaseComparator::onTargetError(int id, QString error)
 {
-  ui->stateLabel->setText("Comparator error: " + error);
-  m_plotPage = nullptr;
+  ui->stateLabel->setText(
+        "Target #" + QString::number(id + 1) + " error: " + error);
 
+  removeTarget(id);
   refreshUi();
-  refreshNamedChannel();
 }
 
 void
-PhaseComparator::onComparatorData()
-{
-  auto data = m_comparator->data();
-
-  if (m_plotPage != nullptr && m_analyzer != nullptr) {
-    m_plotPage->feed(m_analyzer->getSourceTimeStamp(), data.data(), data.size());
+PhaseComparator::onTargetData(int id)
+{
+  auto it = m_targets.find(id);
+  auto comparator = m_bank->target(id);
+
+  if (it != m_targets.end()
+      && comparator != nullptr
+      && it->second.plotPage != nullptr) {
+    auto const &data = comparator->data();
+    it->second.plotPage->feed(
+          comparator->dataTime(),
+          data.data(),
+          data.size());
   }
 
   ++m_count;
-  //ui->stateLabel->setText(QString::number(m_count) + " packets");
 }
 
 void
-PhaseComparator::onComparatorStateChanged(int ch, int state, QString msg)
+PhaseComparator::onTargetStateChanged(int id, int ch, int state, QString msg)
 {
+  auto it = m_targets.find(id);
   bool fullyOpened = state == RAW_CHANNEL_FORWARDER_RUNNING;
 
+  if (it == m_targets.end())
+    return;
+
   if (ch == 0)
-    m_loOpened = fullyOpened;
+    it->second.loOpened = fullyOpened;
   else
-    m_hiOpened = fullyOpened;
+    it->second.hiOpened = fullyOpened;
 
   if (state != RAW_CHANNEL_FORWARDER_IDLE)
-    ui->stateLabel->setText("Channel " + QString::number(ch + 1) + ": " + msg);
+    ui->stateLabel->setText(
+          "Target #" + QString::number(id + 1) +
+          ", channel " + QString::number(ch + 1) + ": " + msg);
 
-  refreshNamedChannel();
+  refreshNamedChannel(id);
+}
+
+void
+PhaseComparator::onTargetDelayChanged(int id, qreal delay)
+{
+  if (id == selectedTarget())
+    ui->delayLabel->setText(
+          QString::asprintf("%+.3f samples", delay));
+}
+
+void
+PhaseComparator::onTargetDataShed(int id, quint64 dropped, quint64 late)
+{
+  ui->stateLabel->setText(
+        "Target #" + QString::number(id + 1) + ": " +
+        QString::number(dropped) + " blocks dropped, " +
+        QString::number(late) + " late");
+}
+
+void
+PhaseComparator::onEventRecorded(int)
+{
+  ui->eventCountLabel->setText(
+        QString::number(m_bank->events().size()));
+  ui->saveEventsButton->setEnabled(true);
 }
 
 void
 PhaseComparator::onClosePlotPage()
 {
   PhasePlotPage *sender = SCAST(PhasePlotPage *, QObject::sender());
+  int id = targetOfPlotPage(sender);
 
-  if (sender == m_plotPage) {
-    m_plotPage = nullptr;
-    m_comparator->close();
+  if (id >= 0) {
+    m_targets[id].plotPage = nullptr;
+    m_bank->close(id);
   }
 
   delete sender;
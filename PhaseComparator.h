@@ -25,13 +25,15 @@
 #include <QWidget>
 #include <QFile>
 #include <ColorConfig.h>
+#include <map>
+#include "CoherentDetector.h"
 
 namespace Ui {
   class PhaseComparator;
 }
 
 namespace SigDigger {
-  class SimplePhaseComparator;
+  class PhaseComparatorBank;
   class MainSpectrum;
   class GlobalProperty;
   class DetachableProcess;
@@ -40,6 +42,10 @@ namespace SigDigger {
   class PhaseComparatorConfig : public Suscan::Serializable {
   public:
     bool collapsed = false;
+    bool compensateDelay = false;
+    int  integration = 1;
+    bool useChannelizer = false;
+    int  channelizerBins = 256;
 
     // Overriden methods
     void deserialize(Suscan::Object const &conf) override;
@@ -51,32 +57,41 @@ namespace SigDigger {
   {
     Q_OBJECT
 
+    // Per-target UI state
+    struct TargetState {
+      PhasePlotPage          *plotPage = nullptr;
+      NamedChannelSetIterator namChanLo;
+      NamedChannelSetIterator namChanHi;
+      bool                    loOpened    = false;
+      bool                    hiOpened    = false;
+      bool                    haveNamChan = false;
+    };
+
     Suscan::Analyzer       *m_analyzer    = nullptr;
     PhaseComparatorConfig  *m_panelConfig = nullptr;
-    SimplePhaseComparator  *m_comparator  = nullptr;
+    PhaseComparatorBank    *m_bank        = nullptr;
     MainSpectrum           *m_spectrum    = nullptr;
     SUSCOUNT                m_count       = 0;
 
-    // Named channels
-    NamedChannelSetIterator m_namChanLo;
-    NamedChannelSetIterator m_namChanHi;
-    bool                    m_loOpened = false;
-    bool                    m_hiOpened = false;
-    bool m_haveNamChan = false;
+    std::map<int, TargetState> m_targets;
 
     // Other UI state properties
     bool    m_haveFirstReading = false;
 
-    // Current plot
-    PhasePlotPage *m_plotPage = nullptr;
     ColorConfig    m_colors;
 
-    void openPlot();
-    void updatePlotProperties();
+    int  selectedTarget() const;
+    int  targetOfPlotPage(QObject *) const;
+    void selectTarget(int);
+    void removeTarget(int);
+    void openPlot(int);
+    void updatePlotProperties(int);
     void applySpectrumState();
     void connectAll();
     void refreshUi();
-    void refreshNamedChannel();
+    void refreshTargetList();
+    void refreshSelectedTarget();
+    void refreshNamedChannel(int);
     QColor channelColor(bool state) const;
 
   public:
@@ -98,17 +113,28 @@ namespace SigDigger {
   public slots:
     void onOpenChannel();
     void onCloseChannel();
+    void onCloseAllChannels();
+    void onSelectTarget();
     void onAdjustFrequency();
     void onAdjustBandwidth();
+    void onToggleDelayCompensation();
+    void onAdjustIntegration();
+    void onToggleChannelizer();
+    void onAdjustChannelizerBins();
+    void onSaveEvents();
 
     void onAdjustFrequencyRequested(qreal);
     void onAdjustBandwidthRequested(qreal);
-
-    void onComparatorOpened();
-    void onComparatorClosed();
-    void onComparatorError(QString);
-    void onComparatorData();
-    void onComparatorStateChanged(int, int, QString);
+    void onPlotPageEvent(CoherentEvent const &);
+
+    void onTargetOpened(int);
+    void onTargetClosed(int);
+    void onTargetError(int, QString);
+    void onTargetData(int);
+    void onTargetStateChanged(int, int, int, QString);
+    void onTargetDelayChanged(int, qreal);
+    void onTargetDataShed(int, quint64, quint64);
+    void onEventRecorded(int);
 
     void onSpectrumFrequencyChanged(qint64);
     void onClosePlotPage();
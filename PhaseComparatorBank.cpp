@@ -0,0 +1,423 @@
+//
+//    PhaseComparatorBank.cpp: Several phase comparators sharing one capture
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "PhaseComparatorBank.h"
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace SigDigger;
+
+PhaseComparatorBank::PhaseComparatorBank(
+    UIMediator *mediator,
+    QObject *parent) : QObject(parent)
+{
+  m_mediator    = mediator;
+  m_channelizer = new SharedChannelizer(mediator, this);
+
+  m_events.open();
+}
+
+PhaseComparatorBank::~PhaseComparatorBank()
+{
+}
+
+int
+PhaseComparatorBank::idOf(QObject *obj) const
+{
+  for (auto &p : m_targets)
+    if (p.second == obj)
+      return p.first;
+
+  return -1;
+}
+
+void
+PhaseComparatorBank::connectTarget(SimplePhaseComparator *comparator)
+{
+  connect(
+        comparator,
+        SIGNAL(opened()),
+        this,
+        SLOT(onTargetOpened()));
+
+  connect(
+        comparator,
+        SIGNAL(closed()),
+        this,
+        SLOT(onTargetClosed()));
+
+  connect(
+        comparator,
+        SIGNAL(error(QString)),
+        this,
+        SLOT(onTargetError(QString)));
+
+  connect(
+        comparator,
+        SIGNAL(dataAvailable()),
+        this,
+        SLOT(onTargetData()));
+
+  connect(
+        comparator,
+        SIGNAL(stateChanged(int,int,QString)),
+        this,
+        SLOT(onTargetStateChanged(int,int,QString)));
+
+  connect(
+        comparator,
+        SIGNAL(delayChanged(qreal)),
+        this,
+        SLOT(onTargetDelayChanged(qreal)));
+
+  connect(
+        comparator,
+        SIGNAL(dataShed(quint64, quint64)),
+        this,
+        SLOT(onTargetDataShed(quint64, quint64)));
+}
+
+void
+PhaseComparatorBank::setAnalyzer(Suscan::Analyzer *analyzer)
+{
+  m_analyzer = analyzer;
+
+  m_channelizer->setAnalyzer(analyzer);
+
+  for (auto &p : m_targets)
+    p.second->setAnalyzer(analyzer);
+}
+
+void
+PhaseComparatorBank::setFFTSizeHint(unsigned int size)
+{
+  m_fftSize = size;
+
+  m_channelizer->setFFTSizeHint(size);
+
+  for (auto &p : m_targets)
+    p.second->setFFTSizeHint(size);
+}
+
+void
+PhaseComparatorBank::setIntegration(unsigned int samples)
+{
+  m_integration = samples;
+
+  // Running targets keep their integration until they are reopened
+  for (auto &p : m_targets)
+    if (!p.second->isRunning())
+      p.second->setIntegration(samples);
+}
+
+void
+PhaseComparatorBank::setDelayCompensation(bool enabled)
+{
+  m_delayCompensation = enabled;
+
+  // Estimating the delay of every target is only worth it if we use it
+  for (auto &p : m_targets) {
+    p.second->setDelayEstimation(enabled);
+    p.second->setDelayCompensation(enabled);
+  }
+}
+
+void
+PhaseComparatorBank::setChannelizerEnabled(bool enabled)
+{
+  m_useChannelizer = enabled;
+}
+
+bool
+PhaseComparatorBank::channelizerEnabled() const
+{
+  return m_useChannelizer;
+}
+
+bool
+PhaseComparatorBank::setChannelizerChannels(unsigned channels)
+{
+  return m_channelizer->setChannels(channels);
+}
+
+bool
+PhaseComparatorBank::channelizerRunning() const
+{
+  return m_channelizer->isRunning();
+}
+
+int
+PhaseComparatorBank::open(SUFREQ freq, SUFLOAT bandwidth)
+{
+  SimplePhaseComparator *comparator;
+  int id;
+
+  if (m_analyzer == nullptr)
+    return -1;
+
+  comparator = new SimplePhaseComparator(m_mediator, this);
+
+  comparator->setAnalyzer(m_analyzer);
+  comparator->setFFTSizeHint(m_fftSize);
+  comparator->setIntegration(m_integration);
+  comparator->setDelayEstimation(m_delayCompensation);
+  comparator->setDelayCompensation(m_delayCompensation);
+
+  if (m_useChannelizer)
+    comparator->setChannelizer(m_channelizer);
+
+  connectTarget(comparator);
+
+  id = m_nextId++;
+  m_targets[id] = comparator;
+
+  if (!comparator->open(freq, bandwidth)) {
+    m_targets.erase(id);
+    comparator->deleteLater();
+    return -1;
+  }
+
+  return id;
+}
+
+bool
+PhaseComparatorBank::close(int id)
+{
+  auto comparator = target(id);
+
+  if (comparator == nullptr)
+    return false;
+
+  return comparator->close();
+}
+
+void
+PhaseComparatorBank::closeAll()
+{
+  // close() may remove the target from the map, iterate over a copy
+  for (auto id : targets())
+    close(id);
+}
+
+int
+PhaseComparatorBank::count() const
+{
+  return static_cast<int>(m_targets.size());
+}
+
+bool
+PhaseComparatorBank::isRunning() const
+{
+  for (auto &p : m_targets)
+    if (p.second->isRunning())
+      return true;
+
+  return false;
+}
+
+std::vector<int>
+PhaseComparatorBank::targets() const
+{
+  std::vector<int> ids;
+
+  for (auto &p : m_targets)
+    ids.push_back(p.first);
+
+  return ids;
+}
+
+SimplePhaseComparator *
+PhaseComparatorBank::target(int id) const
+{
+  auto it = m_targets.find(id);
+
+  if (it == m_targets.end())
+    return nullptr;
+
+  return it->second;
+}
+
+qreal
+PhaseComparatorBank::targetFrequency(int id) const
+{
+  auto comparator = target(id);
+
+  if (comparator == nullptr || m_analyzer == nullptr)
+    return 0;
+
+  // Same convention as the frequency spin box of the tool widget
+  return comparator->getFrequency() + .25 * m_analyzer->getSampleRate();
+}
+
+int
+PhaseComparatorBank::findTarget(SUFREQ freq, SUFLOAT tolerance) const
+{
+  for (auto &p : m_targets)
+    if (std::fabs(p.second->getFrequency() - freq) <= tolerance)
+      return p.first;
+
+  return -1;
+}
+
+void
+PhaseComparatorBank::recordEvent(int id, CoherentEvent const &event)
+{
+  auto comparator = target(id);
+  qreal fs;
+
+  if (comparator == nullptr)
+    return;
+
+  fs = comparator->getEquivFs() / comparator->getIntegration();
+
+  // Targets deliver their events in order, but not in sync. The store
+  // takes them as they come and saveEvents() sorts them.
+  if (!m_events.append(
+        EventStore::record(
+          event,
+          event.timeStamp,
+          event.start,
+          fs > 0 ? static_cast<qreal>(event.length) / fs : 0)))
+    return;
+
+  m_eventFrequencies.push_back(targetFrequency(id));
+
+  emit eventRecorded(id);
+}
+
+EventStore const &
+PhaseComparatorBank::events() const
+{
+  return m_events;
+}
+
+void
+PhaseComparatorBank::clearEvents()
+{
+  m_events.close();
+  m_events.open();
+  m_eventFrequencies.clear();
+}
+
+bool
+PhaseComparatorBank::saveEvents(QString const &path) const
+{
+  std::vector<size_t> order(m_events.size());
+  QFile outfile;
+
+  outfile.setFileName(path);
+  outfile.open(QIODevice::Text | QIODevice::WriteOnly);
+
+  if (!outfile.isOpen())
+    return false;
+
+  QTextStream out(&outfile);
+
+  std::iota(order.begin(), order.end(), 0);
+  if (!m_events.sorted())
+    std::stable_sort(
+          order.begin(),
+          order.end(),
+          [this] (size_t a, size_t b) {
+            return m_events.time(a) < m_events.time(b);
+          });
+
+  // Same columns as the event list of the phase plot page, plus the
+  // target frequency
+  for (auto i : order)
+    out << QString::fromStdString(EventStore::csvLine(m_events.at(i))) << ","
+        << QString::number(m_eventFrequencies[i], 'f', 0) << "\n";
+
+  return true;
+}
+
+////////////////////////////// Slots ///////////////////////////////////////////
+void
+PhaseComparatorBank::onTargetOpened()
+{
+  int id = idOf(QObject::sender());
+
+  if (id >= 0)
+    emit targetOpened(id);
+}
+
+void
+PhaseComparatorBank::onTargetClosed()
+{
+  QObject *sender = QObject::sender();
+  int id = idOf(sender);
+
+  if (id >= 0) {
+    m_targets.erase(id);
+    sender->deleteLater();
+    emit targetClosed(id);
+  }
+}
+
+void
+PhaseComparatorBank::onTargetError(QString error)
+{
+  QObject *sender = QObject::sender();
+  int id = idOf(sender);
+
+  if (id >= 0) {
+    m_targets.erase(id);
+    sender->deleteLater();
+    emit targetError(id, error);
+  }
+}
+
+void
+PhaseComparatorBank::onTargetData()
+{
+  int id = idOf(QObject::sender());
+
+  if (id >= 0)
+    emit targetData(id);
+}
+
+void
+PhaseComparatorBank::onTargetStateChanged(int ch, int state, QString msg)
+{
+  int id = idOf(QObject::sender());
+
+  if (id >= 0)
+    emit targetStateChanged(id, ch, state, msg);
+}
+
+void
+PhaseComparatorBank::onTargetDelayChanged(qreal delay)
+{
+  int id = idOf(QObject::sender());
+
+  if (id >= 0)
+    emit targetDelayChanged(id, delay);
+}
+
+void
+PhaseComparatorBank::onTargetDataShed(quint64 dropped, quint64 late)
+{
+  int id = idOf(QObject::sender());
+
+  if (id >= 0)
+    emit targetDataShed(id, dropped, late);
+}
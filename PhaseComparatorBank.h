@@ -0,0 +1,114 @@
+//
+//    PhaseComparatorBank.h: Several phase comparators sharing one capture
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef PHASECOMPARATORBANK_H
+#define PHASECOMPARATORBANK_H
+
+#include <QObject>
+#include <map>
+#include <vector>
+#include "SimplePhaseComparator.h"
+#include "SharedChannelizer.h"
+#include "CoherentDetector.h"
+#include "EventStore.h"
+
+//
+// A phase comparator bank keeps K comparators (targets) open at the same
+// time, each one identified by an integer id that is never reused during
+// the lifetime of the bank. Per-target signals carry that id, and the
+// events detected on any target are merged into a single in-memory
+// EventStore, sorted by time when saved.
+//
+// Targets can either open their own pair of inspectors or tap a
+// SharedChannelizer owned by the bank. The channelizer setting applies
+// to targets opened after the change.
+//
+
+namespace SigDigger {
+  class PhaseComparatorBank : public QObject
+  {
+    Q_OBJECT
+
+    UIMediator       *m_mediator = nullptr;
+    Suscan::Analyzer *m_analyzer = nullptr;
+    unsigned int      m_fftSize  = 8192;
+    unsigned int      m_integration = 1;
+    bool              m_delayCompensation = false;
+    bool              m_useChannelizer = false;
+    SharedChannelizer *m_channelizer = nullptr;
+    int               m_nextId = 0;
+
+    std::map<int, SimplePhaseComparator *> m_targets;
+    EventStore                             m_events;
+    std::vector<qreal>                     m_eventFrequencies;
+
+    int  idOf(QObject *) const;
+    void connectTarget(SimplePhaseComparator *);
+
+  public:
+    explicit PhaseComparatorBank(UIMediator *, QObject *parent = nullptr);
+    ~PhaseComparatorBank() override;
+
+    void setAnalyzer(Suscan::Analyzer *);
+    void setFFTSizeHint(unsigned int);
+    void setIntegration(unsigned int);
+    void setDelayCompensation(bool);
+    void setChannelizerEnabled(bool);
+    bool channelizerEnabled() const;
+    bool setChannelizerChannels(unsigned);
+    bool channelizerRunning() const;
+
+    int  open(SUFREQ, SUFLOAT);
+    bool close(int);
+    void closeAll();
+
+    int  count() const;
+    bool isRunning() const;
+    std::vector<int> targets() const;
+    SimplePhaseComparator *target(int) const;
+    qreal targetFrequency(int) const;
+    int  findTarget(SUFREQ, SUFLOAT tolerance) const;
+
+    void recordEvent(int, CoherentEvent const &);
+    EventStore const &events() const;
+    void clearEvents();
+    bool saveEvents(QString const &path) const;
+
+  public slots:
+    void onTargetOpened();
+    void onTargetClosed();
+    void onTargetError(QString);
+    void onTargetData();
+    void onTargetStateChanged(int, int, QString);
+    void onTargetDelayChanged(qreal);
+    void onTargetDataShed(quint64, quint64);
+
+  signals:
+    void targetOpened(int);
+    void targetClosed(int);
+    void targetError(int, QString);
+    void targetData(int);
+    void targetStateChanged(int, int, int, QString);
+    void targetDelayChanged(int, qreal);
+    void targetDataShed(int, quint64, quint64);
+    void eventRecorded(int);
+  };
+}
+
+#endif // PHASECOMPARATORBANK_H
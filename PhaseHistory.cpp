@@ -0,0 +1,428 @@
+//
+//    PhaseHistory.cpp: Bounded phase difference history
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "PhaseHistory.h"
+#include "SignalKernels.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace SigDigger;
+
+PhaseHistory::PhaseHistory(size_t capacity, unsigned chunks)
+{
+  setCapacity(capacity, chunks);
+}
+
+PhaseHistory::~PhaseHistory()
+{
+  closeRing(m_ring);
+}
+
+size_t
+PhaseHistory::encodedSize(bool compact)
+{
+  return compact ? sizeof(uint32_t) : sizeof(SUCOMPLEX);
+}
+
+size_t
+PhaseHistory::ringCapacity(size_t capacity, size_t sampleSize)
+{
+  size_t page  = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t bytes = capacity * sampleSize;
+
+  // Both mappings must start at a page boundary
+  bytes = ((bytes + page - 1) / page) * page;
+
+  return bytes / sampleSize;
+}
+
+//
+// Opens a ring of at least `capacity` samples. With an empty `dir`, the
+// ring lives in an anonymous shared memory object instead of a file.
+//
+bool
+PhaseHistory::openRing(
+    std::string const &dir,
+    size_t capacity,
+    size_t sampleSize,
+    Ring &ring)
+{
+  size_t bytes = ringCapacity(capacity, sampleSize) * sampleSize;
+  off_t  length = static_cast<off_t>(bytes);
+  char  *area;
+  void  *map;
+  int    fd, error;
+
+  if (dir.empty()) {
+#ifdef MFD_CLOEXEC
+    fd = memfd_create("phasehistory", MFD_CLOEXEC);
+#else
+    std::string name = "/phasehistory-" + std::to_string(getpid());
+
+    if ((fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600)) != -1)
+      shm_unlink(name.c_str());
+#endif // MFD_CLOEXEC
+    if (fd == -1)
+      return false;
+  } else {
+    std::string path = dir + "/.phasehistory-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+
+    name.push_back('\0');
+
+    if ((fd = mkstemp(name.data())) == -1)
+      return false;
+
+    // Nobody else needs to see it. It is released along with the fd.
+    unlink(name.data());
+  }
+
+  // Sparse: memory (or disk space) is only claimed as the history fills up
+  if (ftruncate(fd, length) == -1) {
+    error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+
+  // Reserve room for both mappings, then place them back to back
+  map = mmap(nullptr, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+
+  area = static_cast<char *>(map);
+
+  if (mmap(
+        area,
+        bytes,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_FIXED,
+        fd,
+        0) == MAP_FAILED
+      || mmap(
+        area + bytes,
+        bytes,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_FIXED,
+        fd,
+        0) == MAP_FAILED) {
+    error = errno;
+    munmap(area, 2 * bytes);
+    close(fd);
+    errno = error;
+    return false;
+  }
+
+  ring.fd       = fd;
+  ring.base     = area;
+  ring.bytes    = bytes;
+  ring.capacity = bytes / sampleSize;
+
+  return true;
+}
+
+void
+PhaseHistory::openMemoryRing(size_t capacity, size_t sampleSize, Ring &ring)
+{
+  if (!openRing(std::string(), capacity, sampleSize, ring))
+    throw std::bad_alloc();
+}
+
+void
+PhaseHistory::closeRing(Ring &ring)
+{
+  if (ring.base != nullptr)
+    munmap(ring.base, 2 * ring.bytes);
+
+  if (ring.fd != -1)
+    close(ring.fd);
+
+  ring = Ring();
+}
+
+//
+// Moves the most recent samples to a new ring, encoded as polar codes if
+// `compact`, and releases the current one.
+//
+void
+PhaseHistory::relocate(Ring const &ring, bool compact)
+{
+  size_t count = size();
+  size_t keep  = std::min(count, m_capacity);
+  size_t first = count - keep;
+
+  if (!compact) {
+    read(first, keep, reinterpret_cast<SUCOMPLEX *>(ring.base));
+  } else if (m_compact) {
+    memcpy(
+          ring.base,
+          m_ring.base + (m_head + first) * sizeof(uint32_t),
+          keep * sizeof(uint32_t));
+  } else {
+    encodePolar(
+          reinterpret_cast<uint32_t *>(ring.base),
+          data() + first,
+          keep);
+  }
+
+  m_offset += first;
+
+  closeRing(m_ring);
+
+  m_compact = compact;
+  m_ring = ring;
+  m_head = 0;
+  m_size = keep;
+}
+
+bool
+PhaseHistory::setCapacity(size_t capacity, unsigned chunks)
+{
+  Ring ring;
+  size_t chunkSize;
+  int error;
+
+  if (chunks < 1)
+    chunks = 1;
+
+  if (capacity < chunks)
+    capacity = chunks;
+
+  chunkSize = (capacity + chunks - 1) / chunks;
+
+  m_chunks    = chunks;
+  m_chunkSize = chunkSize;
+  m_capacity  = chunkSize * chunks;
+
+  if (ringCapacity(m_capacity + m_chunkSize, sampleSize()) == m_ring.capacity)
+    return false;
+
+  // Reserve the whole thing once, keeping the most recent samples
+  if (m_fileBacked
+      && !openRing(m_dir, m_capacity + m_chunkSize, sampleSize(), ring)) {
+    error = errno;
+    m_fileBacked = false;
+    openMemoryRing(m_capacity + m_chunkSize, sampleSize(), ring);
+    errno = error;
+  } else if (!m_fileBacked) {
+    openMemoryRing(m_capacity + m_chunkSize, sampleSize(), ring);
+  }
+
+  relocate(ring, m_compact);
+
+  return true;
+}
+
+bool
+PhaseHistory::setFileBacked(std::string const &dir)
+{
+  Ring ring;
+
+  if (!openRing(dir, m_capacity + m_chunkSize, encodedSize(false), ring))
+    return false;
+
+  m_dir = dir;
+  m_fileBacked = true;
+  relocate(ring, false);
+
+  return true;
+}
+
+void
+PhaseHistory::setMemoryBacked()
+{
+  Ring ring;
+
+  if (!m_fileBacked)
+    return;
+
+  openMemoryRing(m_capacity + m_chunkSize, encodedSize(false), ring);
+  m_fileBacked = false;
+  relocate(ring, false);
+}
+
+bool
+PhaseHistory::fileBacked() const
+{
+  return m_fileBacked;
+}
+
+bool
+PhaseHistory::setCompact(bool compact)
+{
+  Ring ring;
+
+  if (compact == m_compact)
+    return true;
+
+  if (m_fileBacked) {
+    errno = EINVAL;
+    return false;
+  }
+
+  openMemoryRing(m_capacity + m_chunkSize, encodedSize(compact), ring);
+  relocate(ring, compact);
+
+  return true;
+}
+
+bool
+PhaseHistory::compact() const
+{
+  return m_compact;
+}
+
+size_t
+PhaseHistory::sampleSize() const
+{
+  return encodedSize(m_compact);
+}
+
+size_t
+PhaseHistory::capacity() const
+{
+  return m_capacity;
+}
+
+size_t
+PhaseHistory::chunkSize() const
+{
+  return m_chunkSize;
+}
+
+size_t
+PhaseHistory::size() const
+{
+  return m_size;
+}
+
+bool
+PhaseHistory::empty() const
+{
+  return size() == 0;
+}
+
+SUSCOUNT
+PhaseHistory::offset() const
+{
+  return m_offset;
+}
+
+bool
+PhaseHistory::willRecycle(size_t size) const
+{
+  return size > capacity() || this->size() + size > m_ring.capacity;
+}
+
+size_t
+PhaseHistory::append(const SUCOMPLEX *data, size_t size, SUCOMPLEX gain)
+{
+  size_t capacity = this->capacity();
+  size_t dropped = 0;
+  size_t tail;
+
+  // Blocks longer than the whole history only leave their tail
+  if (size > capacity) {
+    dropped   = this->size() + size - capacity;
+    m_offset += dropped;
+    data     += size - capacity;
+    size      = capacity;
+    m_head    = 0;
+    m_size    = 0;
+  }
+
+  if (willRecycle(size)) {
+    // Never more than what we have, as size <= m_capacity. Moving the
+    // head is all it takes.
+    size_t excess = this->size() + size - m_ring.capacity;
+    size_t drop   = (excess + m_chunkSize - 1) / m_chunkSize * m_chunkSize;
+
+    m_head    = (m_head + drop) % m_ring.capacity;
+    m_size   -= drop;
+    m_offset += drop;
+    dropped  += drop;
+  }
+
+  // Past the end of the ring, the second mapping wraps around
+  tail    = m_head + m_size;
+  m_size += size;
+
+  if (m_compact) {
+    SUCOMPLEX block[PHASE_HISTORY_ENCODE_BLOCK];
+    uint32_t *dst = reinterpret_cast<uint32_t *>(m_ring.base) + tail;
+
+    for (size_t i = 0; i < size; i += PHASE_HISTORY_ENCODE_BLOCK) {
+      size_t count = std::min<size_t>(size - i, PHASE_HISTORY_ENCODE_BLOCK);
+
+      for (size_t j = 0; j < count; ++j)
+        block[j] = data[i + j] * gain;
+
+      encodePolar(dst + i, block, count);
+    }
+  } else {
+    SUCOMPLEX *dst = reinterpret_cast<SUCOMPLEX *>(m_ring.base) + tail;
+
+    for (size_t i = 0; i < size; ++i)
+      dst[i] = data[i] * gain;
+  }
+
+  return dropped;
+}
+
+void
+PhaseHistory::clear()
+{
+  m_head   = 0;
+  m_size   = 0;
+  m_offset = 0;
+}
+
+void
+PhaseHistory::read(size_t index, size_t count, SUCOMPLEX *out) const
+{
+  if (m_compact) {
+    decodePolar(
+          out,
+          reinterpret_cast<const uint32_t *>(m_ring.base) + m_head + index,
+          count);
+  } else {
+    const SUCOMPLEX *src = data() + index;
+    std::copy(src, src + count, out);
+  }
+}
+
+const SUCOMPLEX *
+PhaseHistory::data() const
+{
+  if (m_compact)
+    return nullptr;
+
+  return reinterpret_cast<const SUCOMPLEX *>(m_ring.base) + m_head;
+}
@@ -0,0 +1,149 @@
+//
+//    PhaseHistory.h: Bounded phase difference history
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef PHASEHISTORY_H
+#define PHASEHISTORY_H
+
+#include <sigutils/types.h>
+#include <cstdint>
+#include <string>
+
+#define PHASE_HISTORY_DEFAULT_CHUNKS 16
+#define PHASE_HISTORY_ENCODE_BLOCK   256
+
+//
+// Keeps the last `capacity` samples of a phase difference capture in a
+// single allocation, split in fixed-size chunks. The allocation holds one
+// chunk more than the capacity: when it fills up, the oldest chunks are
+// recycled, so the history never falls below `capacity` samples once it
+// has been reached and the buffer is never reallocated.
+//
+// The allocation is a shared memory object (or a file) used as a ring,
+// and mapped twice in a row. Since the second mapping aliases the first
+// one, the samples between the head and the tail are always contiguous
+// in memory, and recycling a chunk is just a matter of moving the head:
+// no sample is ever moved once appended. Absolute sample indices
+// (counted since the last clear()) survive recycling through offset().
+//
+// The ring can also be kept in a sparse file under a given directory
+// (e.g. the autosave directory), so the kernel is free to page cold
+// history out. The file is unlinked right after creation, so it never
+// outlives the history.
+//
+// In memory, the history can also be kept compact: 32-bit polar codes
+// (see encodePolar()) instead of full SUCOMPLEX samples, which makes it
+// 2 (or 4, in double precision) times longer for the same allocation.
+// Samples are then decoded on demand through read(), and data() is not
+// available. read() works in every mode.
+//
+// Running out of memory for an in-memory history throws std::bad_alloc,
+// as a std::vector would.
+//
+
+namespace SigDigger {
+  class PhaseHistory
+  {
+    struct Ring {
+      int    fd       = -1;
+      char  *base     = nullptr;
+      size_t bytes    = 0; // Of each mapping
+      size_t capacity = 0; // Samples
+    };
+
+    bool     m_compact   = false;
+    size_t   m_chunkSize = 0;
+    size_t   m_capacity  = 0;
+    unsigned m_chunks    = PHASE_HISTORY_DEFAULT_CHUNKS;
+    SUSCOUNT m_offset    = 0;
+
+    Ring     m_ring;
+    size_t   m_head = 0;
+    size_t   m_size = 0;
+
+    // File-backed mode
+    std::string m_dir;
+    bool     m_fileBacked = false;
+
+    void     relocate(Ring const &, bool compact);
+
+    static size_t encodedSize(bool compact);
+    static size_t ringCapacity(size_t, size_t sampleSize);
+    static bool   openRing(
+        std::string const &dir,
+        size_t,
+        size_t sampleSize,
+        Ring &);
+    static void   openMemoryRing(size_t, size_t sampleSize, Ring &);
+    static void   closeRing(Ring &);
+
+  public:
+    PhaseHistory(
+        size_t capacity = 0,
+        unsigned chunks = PHASE_HISTORY_DEFAULT_CHUNKS);
+    ~PhaseHistory();
+
+    PhaseHistory(PhaseHistory const &) = delete;
+    PhaseHistory &operator=(PhaseHistory const &) = delete;
+
+    // Reallocates (dropping the oldest samples if the new capacity is
+    // smaller) only if the geometry actually changes. Returns whether it
+    // did. If a file-backed history cannot be remapped, it falls back to
+    // memory and errno tells why.
+    bool     setCapacity(
+        size_t capacity,
+        unsigned chunks = PHASE_HISTORY_DEFAULT_CHUNKS);
+
+    // Keep the samples in a file under `dir`. On failure, the history
+    // is left where it was and errno tells why.
+    bool     setFileBacked(std::string const &dir);
+    void     setMemoryBacked();
+    bool     fileBacked() const;
+
+    // Switching to file-backed storage always leaves compact mode, and
+    // compact mode cannot be entered while file-backed.
+    bool     setCompact(bool);
+    bool     compact() const;
+
+    // Bytes of storage per sample
+    size_t   sampleSize() const;
+
+    size_t   capacity() const;
+    size_t   chunkSize() const;
+    size_t   size() const;
+    bool     empty() const;
+
+    // Absolute index of the first (oldest) sample kept
+    SUSCOUNT offset() const;
+
+    // Whether appending this many samples drops any of the stored ones
+    bool     willRecycle(size_t) const;
+
+    // Returns the number of old samples that were discarded
+    size_t   append(const SUCOMPLEX *, size_t, SUCOMPLEX gain = 1);
+    void     clear();
+
+    // Copies `count` samples starting at the `index`th oldest one
+    void     read(size_t index, size_t count, SUCOMPLEX *out) const;
+
+    // Contiguous samples, from the oldest on (nullptr if compact)
+    const SUCOMPLEX *data() const;
+  };
+}
+
+#endif // PHASEHISTORY_H
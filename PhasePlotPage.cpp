@@ -27,6 +27,10 @@
 #include <QTextStream>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QScrollBar>
 
 using namespace SigDigger;
 
@@ -52,6 +56,20 @@ PhasePlotPageConfig::deserialize(Suscan::Object const &conf)
   LOAD(maxAlloc);
   LOAD(angleOfArrival);
   LOAD(autoSave);
+  LOAD(autoSaveDirectIO);
+  LOAD(autoSaveSync);
+  LOAD(autoSaveSyncPeriod);
+  LOAD(autoSaveFormat);
+  LOAD(autoSaveFullScale);
+  LOAD(autoSaveSigMF);
+  LOAD(autoSaveRotateTime);
+  LOAD(autoSaveRotateSize);
+  LOAD(autoSaveMinFree);
+  LOAD(snippetCapture);
+  LOAD(snippetPreTrigger);
+  LOAD(snippetPostTrigger);
+  LOAD(spillToDisk);
+  LOAD(compactHistory);
   LOAD(saveDir);
   LOAD(doPlot);
   LOAD(dipoleSep);
@@ -77,6 +95,20 @@ PhasePlotPageConfig::serialize()
   STORE(maxAlloc);
   STORE(angleOfArrival);
   STORE(autoSave);
+  STORE(autoSaveDirectIO);
+  STORE(autoSaveSync);
+  STORE(autoSaveSyncPeriod);
+  STORE(autoSaveFormat);
+  STORE(autoSaveFullScale);
+  STORE(autoSaveSigMF);
+  STORE(autoSaveRotateTime);
+  STORE(autoSaveRotateSize);
+  STORE(autoSaveMinFree);
+  STORE(snippetCapture);
+  STORE(snippetPreTrigger);
+  STORE(snippetPostTrigger);
+  STORE(spillToDisk);
+  STORE(compactHistory);
   STORE(saveDir);
   STORE(doPlot);
   STORE(dipoleSep);
@@ -98,16 +130,42 @@ PhasePlotPage::PhasePlotPage(
   ui->waveform->setShowEnvelope(true);
   ui->waveform->setShowPhase(true);
   ui->waveform->setAutoFitToEnvelope(true);
-  ui->waveform->setData(&m_data);
+  ui->waveform->setData(&m_window);
   ui->waveform->setAutoScroll(true);
 
-  ui->phaseView->setHistorySize(100);
+  ui->phaseView->setHistorySize(PHASE_PLOT_PAGE_PHASE_HISTORY);
 
   ui->savePlotButton->setEnabled(false);
 
-  m_data.reserve(1 << 10);
+  m_window.reserve(PHASE_PLOT_PAGE_WINDOW_SIZE);
   m_detector = new CoherentDetector();
 
+  m_log = new EventLogModel(EVENT_LOG_MODEL_DEFAULT_MAX_ROWS, this);
+  ui->logView->setModel(m_log);
+
+  // Disk writes happen in their own thread, away from the plot
+  m_writerThread = new QThread(this);
+  m_writer       = new AutoSaveWriter();
+  m_writer->moveToThread(m_writerThread);
+  m_writerThread->start();
+
+  // So do offline replays, which spawn their own workers from there
+  m_replayThread = new QThread(this);
+  m_replay       = new CoherentReplay();
+  m_replay->moveToThread(m_replayThread);
+  m_replayThread->start();
+
+  // Widget refreshes are coalesced to one per screen frame
+  QScreen *screen = QGuiApplication::primaryScreen();
+  qreal frameRate = screen != nullptr ? screen->refreshRate() : 0;
+
+  if (frameRate <= 0)
+    frameRate = PHASE_PLOT_PAGE_DEFAULT_FRAME_RATE;
+
+  m_refreshTimer = new QTimer(this);
+  m_refreshTimer->setSingleShot(true);
+  m_refreshTimer->setInterval(qMax(1, qRound(1e3 / frameRate)));
+
   connectAll();
 }
 
@@ -210,12 +268,60 @@ PhasePlotPage::connectAll()
         this,
         SLOT(onClearLog()));
 
+  connect(
+        ui->replayButton,
+        SIGNAL(clicked(bool)),
+        this,
+        SLOT(onReplay()));
+
+  connect(
+        m_replay,
+        SIGNAL(progress(qreal)),
+        this,
+        SLOT(onReplayProgress(qreal)));
+
+  connect(
+        m_replay,
+        SIGNAL(finished(bool)),
+        this,
+        SLOT(onReplayFinished(bool)));
+
   connect(
         ui->saveBufferCheck,
         SIGNAL(toggled(bool)),
         this,
         SLOT(onToggleAutoSave()));
 
+  connect(
+        ui->saveFormatCombo,
+        SIGNAL(activated(int)),
+        this,
+        SLOT(onChangeAutoSaveFormat()));
+
+  connect(
+        ui->sigmfCheck,
+        SIGNAL(toggled(bool)),
+        this,
+        SLOT(onChangeAutoSaveFormat()));
+
+  connect(
+        ui->snippetCheck,
+        SIGNAL(toggled(bool)),
+        this,
+        SLOT(onToggleSnippets()));
+
+  connect(
+        ui->spillCheck,
+        SIGNAL(toggled(bool)),
+        this,
+        SLOT(onToggleSpill()));
+
+  connect(
+        ui->compactCheck,
+        SIGNAL(toggled(bool)),
+        this,
+        SLOT(onToggleCompact()));
+
   connect(
         ui->browseButton,
         SIGNAL(clicked(bool)),
@@ -233,10 +339,28 @@ PhasePlotPage::connectAll()
         SIGNAL(valueChanged(double)),
         this,
         SLOT(onChangeDipoleSep()));
+
+  connect(
+        ui->waveform,
+        SIGNAL(horizontalRangeChanged(qint64, qint64)),
+        this,
+        SLOT(onHRangeChanged(qint64, qint64)));
+
+  connect(
+        m_writer,
+        SIGNAL(error(QString)),
+        this,
+        SLOT(onAutoSaveError(QString)));
+
+  connect(
+        m_refreshTimer,
+        SIGNAL(timeout()),
+        this,
+        SLOT(onRefresh()));
 }
 
 QString
-PhasePlotPage::genAutoSaveFileName() const
+PhasePlotPage::genAutoSaveFileName()
 {
   char datetime[17];
   struct tm tm;
@@ -245,20 +369,35 @@ PhasePlotPage::genAutoSaveFileName() const
 
   QString prefix    = "phasediff";
   QString frequency = QString::number(SCAST(qint64, ui->freqSpin->value()));
-  unsigned int number = 1;
+  unsigned int number = m_autoSaveNumber;
   QString hint;
   QString dateStamp = datetime;
   QString dir = QString::fromStdString(m_config->saveDir);
+  QString extension = ".raw";
+
+  // Headerless files carry the sample format in their names. SigMF data
+  // files must be raw, so compressed ones carry their own header instead.
+  if (m_config->autoSaveFormat == AUTO_SAVE_FORMAT_ZCI16)
+    extension = PHASE_RECORDING_COMPRESSED_EXTENSION;
+  else if (m_config->autoSaveSigMF)
+    extension = SIGMF_DATA_EXTENSION;
+  else if (m_config->autoSaveFormat == AUTO_SAVE_FORMAT_CI16)
+    extension = "_ci16.raw";
+  else if (m_config->autoSaveFormat == AUTO_SAVE_FORMAT_CF16)
+    extension = "_cf16.raw";
 
   do {
     hint = prefix + "_"
         + dateStamp + "_"
         + frequency + "_"
         + QString::number(SCAST(qint64, m_sampRate)) + "sps_"
-        + QString::asprintf("%04d", number) + ".raw";
+        + QString::asprintf("%04d", number) + extension;
     ++number;
   } while (QFile::exists(dir + "/" + hint));
 
+  // Prepared files may not exist yet. Never hand out the same name twice.
+  m_autoSaveNumber = number;
+
   return hint;
 }
 
@@ -271,51 +410,313 @@ setElidedLabelText(QLabel *label, QString text)
     label->setText(clippedText);
 }
 
+QString
+PhasePlotPage::nextAutoSavePath()
+{
+  return QString::fromStdString(m_config->saveDir) + "/" + genAutoSaveFileName();
+}
+
+SUFLOAT
+PhasePlotPage::autoSaveFullScale() const
+{
+  // Leave 12 dB of headroom above the current plot range
+  if (m_config->autoSaveFullScale <= 0)
+    return 4 / SU_POWER_MAG_RAW(m_config->gainDb);
+
+  return m_config->autoSaveFullScale;
+}
+
+quint64
+PhasePlotPage::autoSavePreallocation() const
+{
+  quint64 size = 0;
+  quint64 free = m_writer->freeBytes();
+
+  // There is no telling how much a compressed file will take
+  if (m_config->autoSaveFormat == AUTO_SAVE_FORMAT_ZCI16)
+    return 0;
+
+  if (m_config->autoSaveRotateSize > 0)
+    size = SCAST(quint64, m_config->autoSaveRotateSize);
+  else if (m_config->autoSaveRotateTime > 0)
+    size = SCAST(quint64, m_config->autoSaveRotateTime * m_sampRate)
+        * AutoSaveWriter::sampleSize(
+          SCAST(AutoSaveFormat, m_config->autoSaveFormat));
+
+  // Do not let the reservation itself trip the free space watchdog
+  if (size + SCAST(quint64, m_config->autoSaveMinFree) > free)
+    size = 0;
+
+  return size;
+}
+
+bool
+PhasePlotPage::autoSaveRotationDue() const
+{
+  SUSCOUNT bytes = m_savedSamples * AutoSaveWriter::sampleSize(
+        SCAST(AutoSaveFormat, m_config->autoSaveFormat));
+
+  if (m_savedSamples == 0)
+    return false;
+
+  if (m_config->autoSaveRotateSize > 0
+      && bytes >= m_config->autoSaveRotateSize)
+    return true;
+
+  if (m_config->autoSaveRotateTime > 0
+      && m_savedSamples >= m_config->autoSaveRotateTime * m_sampRate)
+    return true;
+
+  return false;
+}
+
 void
-PhasePlotPage::abortAutoSaveFile(int error)
+PhasePlotPage::prepareAutoSaveFile()
 {
-  if (m_autoSaveFp) {
-    fclose(m_autoSaveFp);
-    m_autoSaveFp = nullptr;
-    m_savedSize  = 0;
+  if (m_config->autoSaveRotateSize <= 0 && m_config->autoSaveRotateTime <= 0)
+    return;
+
+  m_nextAutoSavePath = nextAutoSavePath();
+  m_writer->prepare(m_nextAutoSavePath, autoSavePreallocation());
+}
+
+void
+PhasePlotPage::startAutoSaveFile(QString const &path, struct timeval const &tv)
+{
+  AutoSaveFormat format = SCAST(AutoSaveFormat, m_config->autoSaveFormat);
+
+  m_autoSavePath = path;
+  m_savedSamples = 0;
+  m_eventSample  = 0;
+
+  if (path.endsWith(SIGMF_DATA_EXTENSION)) {
+    m_sigmf.clear();
+    m_sigmf.setGlobal("core:datatype", SigMFMetadata::datatype(format));
+    m_sigmf.setGlobal("core:sample_rate", m_sampRate);
+    m_sigmf.setGlobal("core:recorder", "SigDigger AntSDR plugin");
+    m_sigmf.setGlobal(
+          "core:description",
+          "Phase difference between two coherent channels");
+    m_sigmf.setGlobal(
+          SIGMF_ANTSDR_NAMESPACE ":bandwidth",
+          ui->bwSpin->value());
+    m_sigmf.setGlobal(
+          SIGMF_ANTSDR_NAMESPACE ":dipole_separation",
+          m_config->dipoleSep);
+    m_sigmf.setGlobal(
+          SIGMF_ANTSDR_NAMESPACE ":phase_origin",
+          m_config->phaseOrigin);
+    m_sigmf.setGlobal(
+          SIGMF_ANTSDR_NAMESPACE ":gain_db",
+          m_config->gainDb);
+
+    if (format != AUTO_SAVE_FORMAT_NATIVE)
+      m_sigmf.setGlobal(
+            SIGMF_ANTSDR_NAMESPACE ":full_scale",
+            m_writerFullScale);
+
+    m_sigmf.addCapture(0, ui->freqSpin->value(), tv);
+
+    // Written again on close, with the annotations
+    m_sigmf.save(SigMFMetadata::metaPath(path));
   }
 
-  m_config->autoSave = false;
+  // Sidecar index, so readers can seek by time despite dropped samples
+  if (!m_recordingIndex.create(
+        (path + RECORDING_INDEX_EXTENSION).toStdString(),
+        m_sampRate,
+        AutoSaveWriter::sampleSize(format)))
+    logText(
+          tv,
+          "Cannot create recording index for " + path + ": "
+          + QString(strerror(errno)));
 
-  if (error == 0) {
-    ui->currentFileLabel->setText("None");
-    ui->statusLabel->setText("Save aborted: written less data than expected");
-  } else {
-    ui->currentFileLabel->setText("None");
-    ui->statusLabel->setText("Save aborted: " + QString(strerror(errno)));
+  setElidedLabelText(ui->currentFileLabel, QFileInfo(path).fileName());
+  ui->statusLabel->setText("Saving data");
+}
+
+void
+PhasePlotPage::finishAutoSaveFile()
+{
+  // Annotations are only complete now. Samples dropped by the writer
+  // shift them, so tell readers about it. This runs before the writer
+  // rotates, so the count is still that of this file.
+  if (m_autoSavePath.endsWith(SIGMF_DATA_EXTENSION)) {
+    m_sigmf.setGlobal(
+          SIGMF_ANTSDR_NAMESPACE ":dropped_bytes",
+          SCAST(qint64, m_writer->droppedBytes()));
+    m_sigmf.save(SigMFMetadata::metaPath(m_autoSavePath));
   }
 
-  refreshUi();
+  m_recordingIndex.close();
+  m_autoSavePath.clear();
 }
 
 void
-PhasePlotPage::cycleAutoSaveFile()
+PhasePlotPage::closeAutoSaveFile()
+{
+  if (!m_writer->isOpen())
+    return;
+
+  finishAutoSaveFile();
+  m_writer->close();
+  m_nextAutoSavePath.clear();
+}
+
+void
+PhasePlotPage::rotateAutoSaveFile(struct timeval const &tv)
 {
-  bool shouldHaveFile = m_config->autoSave;
+  QString path = m_nextAutoSavePath;
 
-  if (m_autoSaveFp != nullptr) {
-    fclose(m_autoSaveFp);
-    m_autoSaveFp = nullptr;
-    m_savedSize  = 0;
+  if (!m_writer->havePrepared()) {
+    cycleAutoSaveFile();
+    return;
   }
 
-  if (shouldHaveFile) {
-    QString filename = genAutoSaveFileName();
-    std::string asString = m_config->saveDir + "/" + filename.toStdString();
+  // The next file is already open: this just queues a marker
+  finishAutoSaveFile();
+  m_writer->rotate();
 
-    m_autoSaveFp = fopen(asString.c_str(), "wb");
-    if (m_autoSaveFp != nullptr) {
-      setElidedLabelText(ui->currentFileLabel, filename);
-      ui->statusLabel->setText("Saving data");
-    } else {
-      ui->currentFileLabel->setText("None");
-      ui->statusLabel->setText("Error: " + QString(strerror(errno)));
-    }
+  startAutoSaveFile(path, tv);
+  prepareAutoSaveFile();
+}
+
+bool
+PhasePlotPage::snippetMode() const
+{
+  return m_config->autoSave && m_config->snippetCapture;
+}
+
+void
+PhasePlotPage::refreshSnippetRing()
+{
+  size_t size = 0;
+
+  if (snippetMode())
+    size = SCAST(size_t, m_config->snippetPreTrigger * m_sampRate);
+
+  if (size != m_preTrigger.capacity())
+    m_preTrigger.resize(size);
+}
+
+void
+PhasePlotPage::openSnippet(struct timeval const &trigger)
+{
+  const SUCOMPLEX *part[2];
+  size_t length[2];
+  unsigned parts;
+  struct timeval start, pre;
+  qreal preTime;
+  QString path;
+
+  // Triggered again during the post-trigger margin: keep writing
+  if (m_snippetOpen)
+    return;
+
+  parts   = m_preTrigger.last(m_preTrigger.size(), part, length);
+  preTime = m_preTrigger.size() / m_sampRate;
+
+  pre.tv_sec  = SCAST(time_t, std::floor(preTime));
+  pre.tv_usec = SCAST(suseconds_t, (preTime - pre.tv_sec) * 1e6);
+  timersub(&trigger, &pre, &start);
+
+  path = nextAutoSavePath();
+
+  m_writerFullScale = autoSaveFullScale();
+  m_writer->setFormat(
+        SCAST(AutoSaveFormat, m_config->autoSaveFormat),
+        m_writerFullScale);
+  m_writer->open(path);
+
+  startAutoSaveFile(path, start);
+
+  indexAutoSave(start);
+
+  for (unsigned i = 0; i < parts; ++i) {
+    m_writer->writeSamples(part[i], length[i]);
+    m_savedSamples += length[i];
+  }
+
+  m_snippetOpen = true;
+}
+
+void
+PhasePlotPage::closeSnippet()
+{
+  closeAutoSaveFile();
+  m_snippetOpen = false;
+
+  ui->currentFileLabel->setText("None");
+  ui->statusLabel->setText("Waiting for events");
+}
+
+void
+PhasePlotPage::feedSnippet(
+    struct timeval const &tv,
+    const SUCOMPLEX *data,
+    SUSCOUNT from,
+    SUSCOUNT to)
+{
+  SUSCOUNT size = to - from;
+
+  m_preTrigger.push(data + from, size);
+
+  if (!m_snippetOpen)
+    return;
+
+  // Once the event is over, only the post-trigger margin is left
+  if (!m_haveEvent)
+    size = qMin(size, m_postTrigger);
+
+  indexAutoSave(PhaseRecording::sampleTime(tv, from, m_sampRate));
+  m_writer->writeSamples(data + from, size);
+  m_savedSamples += size;
+
+  if (!m_haveEvent) {
+    m_postTrigger -= size;
+    if (m_postTrigger == 0)
+      closeSnippet();
+  }
+}
+
+void
+PhasePlotPage::indexAutoSave(struct timeval const &tv)
+{
+  int64_t time = SCAST(int64_t, tv.tv_sec) * 1000000 + tv.tv_usec;
+
+  if (!m_recordingIndex.isOpen())
+    return;
+
+  if (!m_recordingIndex.update(m_savedSamples, m_writer->fileBytes(), time)) {
+    logText(
+          tv,
+          "Cannot update recording index: " + QString(strerror(errno)));
+    m_recordingIndex.close();
+  }
+}
+
+void
+PhasePlotPage::cycleAutoSaveFile()
+{
+  closeAutoSaveFile();
+
+  m_snippetOpen = false;
+  refreshSnippetRing();
+
+  if (snippetMode()) {
+    ui->currentFileLabel->setText("None");
+    ui->statusLabel->setText("Waiting for events");
+  } else if (m_config->autoSave) {
+    QString path = nextAutoSavePath();
+
+    m_writerFullScale = autoSaveFullScale();
+    m_writer->setFormat(
+          SCAST(AutoSaveFormat, m_config->autoSaveFormat),
+          m_writerFullScale);
+    m_writer->open(path, autoSavePreallocation());
+
+    startAutoSaveFile(path, m_lastTimeStamp);
+    prepareAutoSaveFile();
   } else {
     ui->currentFileLabel->setText("None");
     ui->statusLabel->setText("Idle");
@@ -341,27 +742,41 @@ PhasePlotPage::logText(QString const &text)
 void
 PhasePlotPage::logText(struct timeval const &time, QString const &text)
 {
-  QString prefix;
-  QDateTime timestamp = QDateTime::fromSecsSinceEpoch(time.tv_sec);
-  QString date = timestamp.toUTC().toString();
-  prefix = "[" + date + "] ";
+  EventLogEntry entry;
+
+  entry.time = time;
+  entry.kind = EVENT_LOG_TEXT;
+  entry.text = text;
 
-  ui->logTextEdit->appendPlainText(prefix + text);
+  logEntry(entry);
+}
+
+// Rows show up with the next frame
+void
+PhasePlotPage::logEntry(EventLogEntry const &entry)
+{
+  m_log->append(entry);
+  scheduleRefresh();
 }
 
 void
 PhasePlotPage::feed(struct timeval const &tv, const SUCOMPLEX *data, SUSCOUNT size)
 {
-  SUSCOUNT ptr = 0, got;
-  SUSCOUNT newSize, newAlloc;
+  SUSCOUNT savedBase;
+  SUSCOUNT snippetPtr = 0;
+  bool snippets = snippetMode();
 
-  if (m_autoSaveFp != nullptr) {
-    errno = 0;
-    auto ret = fwrite(data, sizeof(SUCOMPLEX), size, m_autoSaveFp);
-    if (ret != size)
-      abortAutoSaveFile(errno);
-    else
-      m_savedSize += size * sizeof(SUCOMPLEX);
+  // Files are only switched between blocks
+  if (!snippets && m_writer->isOpen() && autoSaveRotationDue())
+    rotateAutoSaveFile(tv);
+
+  savedBase = m_savedSamples;
+
+  // Never blocks. If the disk cannot keep up, the writer drops data.
+  if (!snippets && m_writer->isOpen()) {
+    indexAutoSave(tv);
+    m_writer->writeSamples(data, size);
+    m_savedSamples += size;
   }
 
   for (SUSCOUNT i = 0; i < size; ++i)
@@ -369,49 +784,52 @@ PhasePlotPage::feed(struct timeval const &tv, const SUCOMPLEX *data, SUSCOUNT si
 
   m_accumCount += size;
 
-  if (ui->logTextEdit->document()->isEmpty())
+  if (m_log->empty())
     logDetectorInfo();
 
   if (m_paramsSet) {
-    bool first = m_data.size() == 0;
-    SUSCOUNT orig = m_data.size();
-
-    // Ensure size and rollover
-    newSize = orig + size;
-    if (newSize > m_data.capacity()) {
-      // Time to reallocate!
-      size_t maxAlloc = m_config->maxAlloc / sizeof(SUCOMPLEX);
+    bool first = m_history.empty();
+    bool recycle = m_history.willRecycle(size);
+    SUSCOUNT prev = m_history.size();
+    SUSCOUNT dropped, kept;
+    const SUCOMPLEX *latest;
+
+    // Recycling moves the samples the waveform may be reading
+    if (recycle)
       ui->waveform->safeCancel();
 
-      // Ideally, attempt to double capacity
-      newAlloc = 2 * m_data.capacity();
+    dropped = m_history.append(data, size, m_phaseAdjust);
+    kept = qMin(size, SCAST(SUSCOUNT, m_history.size()));
 
-      if (newAlloc <= maxAlloc) {
-        // We can
-        m_data.reserve(newAlloc);
-      } else {
-        // We are hiting the limit, is it enough?
-        if (newSize < maxAlloc) {
-          // Yes
-          m_data.reserve(maxAlloc);
-        } else {
-          // No, rollover
-          logText(
-                "Maximum buffer size reached (" +
-                SuWidgetsHelpers::formatBinaryQuantity(maxAlloc * sizeof(SUCOMPLEX)) +
-                "), clearing buffer");
-          orig = 0;
-        }
-      }
+    // Trim before feeding, so the pyramid never outgrows its reservation
+    if (dropped > prev) {
+      m_pyramid.clear(m_history.offset());
+      m_sums.clear(m_history.offset());
+    } else if (dropped > 0) {
+      m_pyramid.trim(m_history.offset());
+      m_sums.trim(m_history.offset());
     }
 
-    if (orig == 0)
-      clearData();
-
-    m_data.resize(orig + size);
+    latest = historySamples(m_history.size() - kept, kept);
+    m_pyramid.feed(latest, kept);
+    m_sums.feed(latest, kept);
+
+    followWindow(kept);
+
+    if (recycle) {
+      if (!m_historyFull) {
+        m_historyFull = true;
+        logText(
+              "Maximum buffer size reached (" +
+              SuWidgetsHelpers::formatBinaryQuantity(
+                SCAST(
+                  qint64,
+                  m_history.capacity() * m_history.sampleSize())) +
+              "), discarding oldest samples");
+      }
 
-    for (SUSCOUNT i = 0; i < size; ++i)
-      m_data[i + orig] = data[i] * m_phaseAdjust;
+      setWaveformData(true);
+    }
 
     if (first) {
       ui->waveform->zoomHorizontal(0., 10.);
@@ -422,69 +840,168 @@ PhasePlotPage::feed(struct timeval const &tv, const SUCOMPLEX *data, SUSCOUNT si
     }
 
     if (!m_haveSelection)
-      ui->phaseView->feed(&m_data[orig], SCAST(unsigned, size));
+      feedPhaseView(latest, kept);
   }
 
-  if (m_config->logEvents && m_detector->enabled()) {
-    while (ptr < size) {
-      got = m_detector->feed(data + ptr, size - ptr);
-      if (m_detector->triggered() != m_haveEvent) {
-        struct timeval delta, time;
-        qreal progress = ptr / m_sampRate;
-        m_haveEvent = m_detector->triggered();
-
-        delta.tv_sec  = std::floor(progress);
-        delta.tv_usec = std::floor(progress * 1e6);
-        timeradd(&tv, &delta, &time);
-
-        if (m_haveEvent) {
-          m_lastEvent = time;
-          logText(time, "Coherent event detected.");
-        } else {
-          if (m_detector->haveEvent()) {
-            QString phaseInfoText;
-            timersub(&time, &m_lastEvent, &delta);
-            qreal asSeconds = delta.tv_sec + delta.tv_usec * 1e-6;
-            auto event = m_detector->lastEvent();
-
-            // Log in list
-            event.timeStamp = m_lastEvent;
-            m_eventList.push_back(event);
-
-            if (m_config->angleOfArrival) {
-              phaseInfoText =
-                  "AoA = " + SuWidgetsHelpers::formatQuantity(
-                    SU_RAD2DEG(event.aoa[0]),
-                    4,
-                    "deg",
-                    true) +
-                  " or " + SuWidgetsHelpers::formatQuantity(
-                    SU_RAD2DEG(event.aoa[1]),
-                    4,
-                    "deg",
-                    true);
-            } else {
-              phaseInfoText =
-                  "dPhi = " +SuWidgetsHelpers::formatQuantity(
-                    SU_RAD2DEG(event.meanPhase),
-                    4,
-                    "º");
-            }
-
-            logText(
-                  time,
-                  "Coherent event end. T = " +
-                  SuWidgetsHelpers::formatQuantity(asSeconds, 4, "s") +
-                  ", S = " +
-                  QString::number(SU_POWER_DB_RAW(event.meanPower)) +
-                  " dB, " +
-                  phaseInfoText);
-          }
+  if ((m_config->logEvents || snippets) && m_detector->enabled()) {
+    m_detector->detect(data, size, m_streamSamples, m_transitions);
+
+    for (auto const &transition : m_transitions) {
+      SUSCOUNT ptr = transition.offset;
+      SUSCOUNT split;
+      struct timeval time;
+
+      // Clearing the history drops the event in progress, if any
+      if (transition.triggered == m_haveEvent)
+        continue;
+
+      // Samples before the transition belong to the previous state. The
+      // offset is the first sample of an event, but the last one of an
+      // event that ended.
+      split = transition.triggered ? ptr : ptr + 1;
+
+      if (snippets) {
+        feedSnippet(tv, data, snippetPtr, split);
+        snippetPtr = split;
+      }
+
+      m_haveEvent = transition.triggered;
+
+      // Times are those of the transition sample, not of its processing
+      time = PhaseRecording::sampleTime(tv, ptr, m_sampRate);
+
+      if (m_haveEvent) {
+        if (snippets)
+          openSnippet(time);
+
+        m_lastEvent   = time;
+        m_eventSample = snippets ? m_savedSamples : savedBase + ptr;
+
+        if (m_config->logEvents)
+          logEventStart(time);
+      } else {
+        CoherentEvent event = transition.event;
+        SUSCOUNT end = snippets ? m_savedSamples : savedBase + ptr;
+        qreal asSeconds = (event.end - event.start) / m_sampRate;
+
+        if (snippets)
+          m_postTrigger = SCAST(
+                SUSCOUNT,
+                m_config->snippetPostTrigger * m_sampRate);
+
+        event.timeStamp = m_lastEvent;
+
+        storeEvent(
+              EventStore::record(
+                event,
+                m_lastEvent,
+                event.start,
+                asSeconds));
+        emit eventDetected(event);
+
+        if (m_autoSavePath.endsWith(SIGMF_DATA_EXTENSION)
+            && m_eventSample <= end) {
+          QJsonObject extra;
+
+          extra[SIGMF_ANTSDR_NAMESPACE ":mean_phase"] =
+              SU_RAD2DEG(event.meanPhase);
+          extra[SIGMF_ANTSDR_NAMESPACE ":mean_power_db"] =
+              SU_POWER_DB_RAW(event.meanPower);
+          extra[SIGMF_ANTSDR_NAMESPACE ":aoa"] = QJsonArray {
+              SU_RAD2DEG(event.aoa[0]),
+              SU_RAD2DEG(event.aoa[1])};
+
+          m_sigmf.addAnnotation(
+                m_eventSample,
+                end - m_eventSample,
+                "Coherent event",
+                extra);
         }
+
+        if (m_config->logEvents)
+          logEventEnd(time, asSeconds, event);
       }
-      ptr += got;
     }
   }
+
+  if (snippets)
+    feedSnippet(tv, data, snippetPtr, size);
+
+  m_streamSamples += size;
+}
+
+//
+// Events go to a store file next to the recordings, so they survive a
+// crash. If it cannot be created there, they are kept in memory.
+//
+void
+PhasePlotPage::openEventStore(struct timeval const &tv)
+{
+  char datetime[17];
+  struct tm tm;
+  QString path;
+
+  gmtime_r(&tv.tv_sec, &tm);
+  strftime(datetime, sizeof(datetime), "%Y%m%d_%H%M%S", &tm);
+
+  path = QString::fromStdString(m_config->saveDir)
+      + "/coherent_events_"
+      + datetime + "_"
+      + QString::number(SCAST(qint64, ui->freqSpin->value()))
+      + EVENT_STORE_EXTENSION;
+
+  if (m_events.open(path.toStdString())) {
+    logText(tv, "Storing events in " + path);
+  } else {
+    logText(
+          tv,
+          "Cannot store events in " + path + ": "
+          + QString(strerror(errno)) + ". Keeping them in memory.");
+    m_events.open();
+  }
+}
+
+void
+PhasePlotPage::storeEvent(EventRecord const &record)
+{
+  if (!m_events.isOpen())
+    openEventStore(m_lastEvent);
+
+  if (!m_events.append(record))
+    logText(
+          m_lastEvent,
+          "Cannot store event: " + QString(strerror(errno)));
+}
+
+void
+PhasePlotPage::logEventStart(struct timeval const &time)
+{
+  EventLogEntry entry;
+
+  entry.time = time;
+  entry.kind = EVENT_LOG_EVENT_START;
+
+  logEntry(entry);
+}
+
+void
+PhasePlotPage::logEventEnd(
+    struct timeval const &time,
+    qreal duration,
+    CoherentEvent const &event)
+{
+  EventLogEntry entry;
+
+  entry.time      = time;
+  entry.kind      = EVENT_LOG_EVENT_END;
+  entry.aoa       = m_config->angleOfArrival;
+  entry.duration  = SCAST(float, duration);
+  entry.powerDb   = SU_POWER_DB_RAW(event.meanPower);
+  entry.phase     = event.meanPhase;
+  entry.angles[0] = event.aoa[0];
+  entry.angles[1] = event.aoa[1];
+
+  logEntry(entry);
 }
 
 void
@@ -503,22 +1020,94 @@ PhasePlotPage::logDetectorInfo()
 void
 PhasePlotPage::plotSelectionPhase(qint64 start, qint64 end)
 {
-  size_t sBegin = qBound(SCAST(size_t, 0), SCAST(size_t, start), m_data.size());
-  size_t sEnd   = qBound(SCAST(size_t, 0), SCAST(size_t, end), m_data.size());
+  size_t sBegin = qBound(SCAST(size_t, 0), SCAST(size_t, start), m_history.size());
+  size_t sEnd   = qBound(SCAST(size_t, 0), SCAST(size_t, end), m_history.size());
+  size_t length = sEnd - sBegin;
+  SUCOMPLEX points[PHASE_PLOT_PAGE_PHASE_HISTORY];
+
+  if (length <= PHASE_PLOT_PAGE_PHASE_HISTORY) {
+    m_history.read(sBegin, length, points);
+    ui->phaseView->feed(points, SCAST(unsigned, length));
+    return;
+  }
+
+  // The view only keeps so many points: show the mean of equal slices
+  // of the selection instead of feeding all of it
+  for (size_t i = 0; i < PHASE_PLOT_PAGE_PHASE_HISTORY; ++i) {
+    SUSCOUNT a = m_history.offset() + sBegin
+        + i * length / PHASE_PLOT_PAGE_PHASE_HISTORY;
+    SUSCOUNT b = m_history.offset() + sBegin
+        + (i + 1) * length / PHASE_PLOT_PAGE_PHASE_HISTORY;
+    PhaseSum sum = m_sums.sum(m_history, a, b);
+
+    points[i] = sum.phasor / SCAST(SUFLOAT, sum.count);
+  }
 
-  ui->phaseView->feed(m_data.data() + sBegin, SCAST(unsigned, sEnd - sBegin));
+  ui->phaseView->feed(points, PHASE_PLOT_PAGE_PHASE_HISTORY);
+}
+
+//
+// The phase view only shows the last few points, and redrawing it is
+// expensive: feed it one mean per slice of samples (so it covers the same
+// time at any sample rate), and only once per frame.
+//
+void
+PhasePlotPage::feedPhaseView(const SUCOMPLEX *data, SUSCOUNT size)
+{
+  while (size > 0) {
+    SUSCOUNT chunk = qMin(size, m_phaseDecimation - m_phaseCount);
+
+    for (SUSCOUNT i = 0; i < chunk; ++i)
+      m_phaseAcc += data[i];
+
+    m_phaseCount += chunk;
+    data         += chunk;
+    size         -= chunk;
+
+    if (m_phaseCount == m_phaseDecimation) {
+      // Older points would be pushed out of the view anyway
+      if (m_phasePending.size() == 2 * PHASE_PLOT_PAGE_PHASE_HISTORY)
+        m_phasePending.erase(
+              m_phasePending.begin(),
+              m_phasePending.begin() + PHASE_PLOT_PAGE_PHASE_HISTORY);
+
+      m_phasePending.push_back(
+            m_phaseAcc / SCAST(SUFLOAT, m_phaseDecimation));
+      m_phaseAcc   = 0;
+      m_phaseCount = 0;
+    }
+  }
+
+  if (!m_phasePending.empty())
+    scheduleRefresh();
+}
+
+void
+PhasePlotPage::scheduleRefresh()
+{
+  if (!m_refreshTimer->isActive())
+    m_refreshTimer->start();
 }
 
 void
 PhasePlotPage::clearData()
 {
-  qint64 size = m_data.size() * sizeof(SUCOMPLEX);
-  size_t prevAlloc = m_data.capacity();
+  qint64 size = SCAST(qint64, m_history.size() * m_history.sampleSize());
 
   ui->waveform->safeCancel();
 
-  m_data.resize(0);
-  m_data.reserve(prevAlloc);
+  m_history.clear();
+  m_pyramid.clear();
+  m_sums.clear();
+  m_window.clear();
+  m_windowStart = 0;
+  m_historyFull = false;
+  m_phasePending.clear();
+  m_phaseAcc    = 0;
+  m_phaseCount  = 0;
+
+  if (m_level != 0)
+    setLevel(0);
 
   ui->waveform->refreshData();
   ui->savePlotButton->setEnabled(false);
@@ -533,6 +1122,189 @@ PhasePlotPage::clearData()
   refreshMeasurements();
 }
 
+void
+PhasePlotPage::setWaveformData(bool flush)
+{
+  if (!m_config->doPlot)
+    ui->waveform->setData(&m_empty, true, false);
+  else if (m_level == 0)
+    ui->waveform->setData(&m_window, true, flush);
+  else
+    ui->waveform->setData(m_pyramid.display(m_level), true, flush);
+}
+
+qreal
+PhasePlotPage::levelScale() const
+{
+  // Pyramid levels have two display samples (max and min) per bin
+  return m_level == 0 ? 1 : .5 * SCAST(qreal, m_pyramid.span(m_level));
+}
+
+// Absolute index of the raw sample under the first display sample
+SUSCOUNT
+PhasePlotPage::levelStart() const
+{
+  if (m_level > 0)
+    return m_pyramid.base()
+        + m_pyramid.offset(m_level) * m_pyramid.span(m_level);
+
+  return m_windowStart;
+}
+
+qreal
+PhasePlotPage::displayToHistory(qreal sample) const
+{
+  return SCAST(qreal, levelStart()) - SCAST(qreal, m_history.offset())
+      + sample * levelScale();
+}
+
+qreal
+PhasePlotPage::historyToDisplay(qreal index) const
+{
+  return (index + SCAST(qreal, m_history.offset()) - SCAST(qreal, levelStart()))
+      / levelScale();
+}
+
+bool
+PhasePlotPage::windowCovers(qreal start, qreal end) const
+{
+  qreal first = SCAST(qreal, m_windowStart) - SCAST(qreal, m_history.offset());
+  qreal last  = first + SCAST(qreal, m_window.size());
+
+  // Parts of the view past the end of the history are fine
+  if (end > SCAST(qreal, m_history.size()))
+    end = SCAST(qreal, m_history.size());
+
+  return start >= first && end <= last;
+}
+
+//
+// Samples of the history from the `index`th oldest on. Compact histories
+// are decoded into a scratch buffer, valid until the next call.
+//
+const SUCOMPLEX *
+PhasePlotPage::historySamples(size_t index, size_t count)
+{
+  if (m_history.data() != nullptr)
+    return m_history.data() + index;
+
+  m_decoded.resize(count);
+  m_history.read(index, count, m_decoded.data());
+
+  return m_decoded.data();
+}
+
+//
+// Copies the history samples in [start, end) (history indices, clipped to
+// the history and the window size) into the display window, which is
+// what the waveform reads at full zoom.
+//
+void
+PhasePlotPage::fillWindow(qreal start, qreal end)
+{
+  qreal size = SCAST(qreal, m_history.size());
+  SUSCOUNT from, to;
+
+  start = qBound(0., start, size);
+  end   = qBound(start, end, qMin(size, start + PHASE_PLOT_PAGE_WINDOW_SIZE));
+  from  = SCAST(SUSCOUNT, start);
+  to    = SCAST(SUSCOUNT, end);
+
+  ui->waveform->safeCancel();
+
+  m_window.resize(to - from);
+  m_history.read(from, to - from, m_window.data());
+  m_windowStart = m_history.offset() + from;
+}
+
+//
+// Keeps the display window glued to the end of the history if it was
+// showing it, so the live plot keeps scrolling at full zoom.
+//
+void
+PhasePlotPage::followWindow(SUSCOUNT added)
+{
+  SUSCOUNT end  = m_history.offset() + m_history.size();
+  SUSCOUNT room = m_window.capacity() - m_window.size();
+
+  if (m_windowStart + m_window.size() + added != end)
+    return;
+
+  if (added <= room) {
+    size_t size = m_window.size();
+
+    m_window.resize(size + added);
+    m_history.read(m_history.size() - added, added, m_window.data() + size);
+  } else {
+    // Out of room: keep the last half, so this does not happen too often
+    qreal size = SCAST(qreal, m_history.size());
+
+    fillWindow(size - .5 * PHASE_PLOT_PAGE_WINDOW_SIZE, size);
+
+    if (m_level == 0)
+      setWaveformData(true);
+  }
+}
+
+void
+PhasePlotPage::setLevel(unsigned level)
+{
+  ui->waveform->safeCancel();
+
+  m_level = level;
+
+  if (m_paramsSet)
+    ui->waveform->setSampleRate(m_sampRate / levelScale());
+
+  setWaveformData(true);
+}
+
+void
+PhasePlotPage::refreshLevel(qint64 min, qint64 max)
+{
+  qreal start = displayToHistory(min);
+  qreal end   = displayToHistory(max);
+  qreal selStart = 0, selEnd = 0;
+  bool selection = ui->waveform->getHorizontalSelectionPresent();
+  unsigned level;
+
+  // Coarsest level with at least one bin per pixel
+  level = m_pyramid.levelFor(
+        SCAST(SUSCOUNT, qMax(end - start, 0.)),
+        SCAST(SUSCOUNT, ui->waveform->width()));
+
+  // Full zoom only sees the display window
+  if (level == m_level && (level > 0 || windowCovers(start, end)))
+    return;
+
+  if (selection) {
+    selStart = displayToHistory(ui->waveform->getHorizontalSelectionStart());
+    selEnd   = displayToHistory(ui->waveform->getHorizontalSelectionEnd());
+  }
+
+  m_levelChanging = true;
+
+  if (level == 0 && !windowCovers(start, end)) {
+    qreal center = .5 * (start + end);
+    fillWindow(
+          center - .5 * PHASE_PLOT_PAGE_WINDOW_SIZE,
+          center + .5 * PHASE_PLOT_PAGE_WINDOW_SIZE);
+  }
+
+  setLevel(level);
+
+  ui->waveform->zoomHorizontal(
+        SCAST(qint64, historyToDisplay(start)),
+        SCAST(qint64, historyToDisplay(end)));
+
+  if (selection)
+    ui->waveform->selectHorizontal(
+          historyToDisplay(selStart),
+          historyToDisplay(selEnd));
+
+  m_levelChanging = false;
+}
+
 void
 PhasePlotPage::setFreqencyLimits(SUFREQ min, SUFREQ max)
 {
@@ -551,6 +1323,9 @@ PhasePlotPage::setProperties(
 
   if (!m_paramsSet) {
     m_sampRate = sampRate;
+    m_phaseDecimation = qMax(
+          SCAST(SUSCOUNT, 1),
+          SCAST(SUSCOUNT, qRound64(sampRate / PHASE_PLOT_PAGE_PHASE_RATE)));
     ui->waveform->setSampleRate(sampRate);
     ui->bwSpin->setMinimum(0);
     ui->bwSpin->setMaximum(sampRate);
@@ -623,21 +1398,26 @@ PhasePlotPage::refreshUi()
   BLOCKSIG(ui->phaseAoAButton,         setChecked(m_config->angleOfArrival));
   BLOCKSIG(ui->saveDirEdit,            setText(QString::fromStdString(m_config->saveDir)));
   BLOCKSIG(ui->saveBufferCheck,        setChecked(m_config->autoSave));
+  BLOCKSIG(ui->spillCheck,             setChecked(m_config->spillToDisk));
+  BLOCKSIG(ui->compactCheck,           setChecked(m_config->compactHistory));
+  BLOCKSIG(ui->saveFormatCombo,        setCurrentIndex(m_config->autoSaveFormat));
+  BLOCKSIG(ui->sigmfCheck,             setChecked(m_config->autoSaveSigMF));
+  BLOCKSIG(ui->snippetCheck,           setChecked(m_config->snippetCapture));
   BLOCKSIG(ui->phaseOriginSpin,        setValue(m_config->phaseOrigin));
   BLOCKSIG(ui->dipoleSepSpin,          setValue(m_config->dipoleSep));
 
   ui->phaseView->setAoA(m_config->angleOfArrival);
   ui->gainSpin->setEnabled(!m_config->autoFit);
+  ui->compactCheck->setEnabled(!m_config->spillToDisk);
+  ui->sigmfCheck->setEnabled(
+        m_config->autoSaveFormat != AUTO_SAVE_FORMAT_ZCI16);
   ui->waveform->setAutoFitToEnvelope(m_config->autoFit);
   ui->waveform->setAutoScroll(m_config->autoScroll);
 
   if (!m_dataUpdated) {
     m_dataUpdated = true;
 
-    if (m_config->doPlot)
-      ui->waveform->setData(&m_data, true, true);
-    else
-      ui->waveform->setData(&m_empty, true, false);
+    setWaveformData(true);
   }
 
   if (!m_config->autoFit) {
@@ -667,7 +1447,12 @@ PhasePlotPage::saveLog(QString const &path)
           "Cannot save event file: " + outfile.errorString());
   } else {
     QTextStream out(&outfile);
-    out << ui->logTextEdit->toPlainText() << "\n";
+
+    m_log->flush();
+
+    for (int i = 0; i < m_log->rowCount(); ++i)
+      out << m_log->text(i) << "\n";
+
     done = true;
   }
 
@@ -692,18 +1477,9 @@ PhasePlotPage::saveCSV(QString const &path)
   } else {
     QTextStream out(&outfile);
 
-    for (auto &p : m_eventList) {
-      QString line =
-          QString::number(p.timeStamp.tv_sec) + "," +
-          QString::number(p.timeStamp.tv_usec) + "," +
-          QString::number(SU_RAD2DEG(p.meanPhase), 'e', 7) + "," +
-          "0" + "," + // Placeholder for uncertainty (TODO)
-          QString::number(SU_RAD2DEG(p.aoa[0]), 'e', 7) + "," +
-          QString::number(SU_RAD2DEG(p.aoa[1]), 'e', 7) + "," +
-          QString::number(SU_POWER_DB_RAW(p.meanPower), 'e', 7) + "," +
-          QString::number(p.length / m_sampRate, 'e', 7);
-      out << line << "\n";
-    }
+    for (size_t i = 0; i < m_events.size(); ++i)
+      out << QString::fromStdString(EventStore::csvLine(m_events.at(i)))
+          << "\n";
 
     done = true;
   }
@@ -711,6 +1487,20 @@ PhasePlotPage::saveCSV(QString const &path)
   return done;
 }
 
+bool
+PhasePlotPage::saveTable(QString const &path)
+{
+  if (!m_events.exportTable(path.toStdString())) {
+    QMessageBox::critical(
+          this,
+          "Save event log",
+          "Cannot save event table: " + QString(strerror(errno)));
+    return false;
+  }
+
+  return true;
+}
+
 void
 PhasePlotPage::showEvent(QShowEvent *)
 {
@@ -727,16 +1517,20 @@ PhasePlotPage::refreshMeasurements()
   qreal selStart = 0;
   qreal selEnd   = 0;
   qreal deltaT;
-  WaveLimits limits;
+  SUSCOUNT first, last;
+  PhaseSum sum;
   SUCOMPLEX mean;
   SUFLOAT phase, angle;
 
   bool selection = false;
 
+  // Selection in history samples, regardless of the level on display
   if (ui->waveform->getHorizontalSelectionPresent()) {
-    size_t length = ui->waveform->getDataLength();
-    selStart = ui->waveform->getHorizontalSelectionStart();
-    selEnd   = ui->waveform->getHorizontalSelectionEnd();
+    size_t length = m_history.size();
+    selStart = std::floor(
+          displayToHistory(ui->waveform->getHorizontalSelectionStart()));
+    selEnd   = std::ceil(
+          displayToHistory(ui->waveform->getHorizontalSelectionEnd()));
 
     if (selStart < 0)
       selStart = 0;
@@ -755,6 +1549,7 @@ PhasePlotPage::refreshMeasurements()
     ui->selLengthLabel->setText("N/A");
 
     ui->meanPhaseLabel->setText("N/A");
+    ui->meanPowerLabel->setText("N/A");
     ui->meanAngle1Label->setText("N/A");
     ui->meanAngle2Label->setText("N/A");
 
@@ -763,24 +1558,22 @@ PhasePlotPage::refreshMeasurements()
 
   plotSelectionPhase(SCAST(qint64, selStart), SCAST(qint64, selEnd));
 
-  ui->waveform->computeLimits(
-        SCAST(qint64, selStart),
-        SCAST(qint64, selEnd),
-        limits);
-
-  mean = limits.mean;
+  first = m_history.offset() + SCAST(SUSCOUNT, selStart);
+  last  = m_history.offset() + SCAST(SUSCOUNT, selEnd);
+  sum   = m_sums.sum(m_history, first, last);
+  mean  = sum.phasor / SCAST(SUFLOAT, sum.count);
   deltaT = 1. / SCAST(qreal, m_sampRate);
 
   ui->selStartLabel->setText(
         SuWidgetsHelpers::formatQuantityFromDelta(
-          ui->waveform->samp2t(selStart),
+          ui->waveform->samp2t(historyToDisplay(selStart)),
           deltaT,
           "s",
           true)
         + " (" + SuWidgetsHelpers::formatReal(selStart) + ")");
   ui->selEndLabel->setText(
         SuWidgetsHelpers::formatQuantityFromDelta(
-          ui->waveform->samp2t(selEnd),
+          ui->waveform->samp2t(historyToDisplay(selEnd)),
           deltaT,
           "s",
           true)
@@ -796,6 +1589,12 @@ PhasePlotPage::refreshMeasurements()
   ui->meanPhaseLabel->setText(
         SuWidgetsHelpers::formatQuantity(SU_RAD2DEG(phase), 4, "º"));
 
+  ui->meanPowerLabel->setText(
+        QString::number(
+          SU_POWER_DB_RAW(sum.power / SCAST(SUFLOAT, sum.count)),
+          'f',
+          2) + " dB");
+
   angle = SU_ASIN(phase / m_phaseScale);
   ui->meanAngle1Label->setText(
         SuWidgetsHelpers::formatQuantity(
@@ -814,11 +1613,124 @@ PhasePlotPage::refreshMeasurements()
 }
 
 
+//
+// The history takes up to maxAlloc bytes, whatever its encoding. Compact
+// mode (in memory only) is entered before growing and left after
+// shrinking, so it never takes more than that in between either. Returns
+// whether the history was touched, in which case the pyramid is rebuilt.
+//
+bool
+PhasePlotPage::refreshHistoryCapacity()
+{
+  bool compact = m_config->compactHistory && !m_history.fileBacked();
+  size_t sampleSize = compact ? sizeof(uint32_t) : sizeof(SUCOMPLEX);
+  size_t capacity = SCAST(size_t, m_config->maxAlloc / sampleSize);
+  bool changed = false;
+
+  ui->waveform->safeCancel();
+
+  if (compact && !m_history.compact()) {
+    m_history.setCompact(true);
+    changed = true;
+  }
+
+  if (m_history.setCapacity(capacity)) {
+    // Remapping the file may fail, in which case we are back in memory
+    if (m_config->spillToDisk && !m_history.fileBacked()) {
+      m_config->spillToDisk = false;
+      BLOCKSIG(ui->spillCheck, setChecked(false));
+      ui->statusLabel->setText(
+            "History back in memory: " + QString(strerror(errno)));
+    }
+
+    changed = true;
+  }
+
+  if (!compact && m_history.compact()) {
+    m_history.setCompact(false);
+    changed = true;
+  }
+
+  if (changed)
+    rebuildPyramid();
+
+  return changed;
+}
+
+void
+PhasePlotPage::refreshHistoryBacking()
+{
+  if (m_config->spillToDisk == m_history.fileBacked())
+    return;
+
+  ui->waveform->safeCancel();
+
+  if (!m_config->spillToDisk) {
+    m_history.setMemoryBacked();
+  } else if (!m_history.setFileBacked(m_config->saveDir)) {
+    m_config->spillToDisk = false;
+    BLOCKSIG(ui->spillCheck, setChecked(false));
+    ui->statusLabel->setText(
+          "Cannot keep history on disk: " + QString(strerror(errno)));
+    return;
+  }
+
+  ui->compactCheck->setEnabled(!m_config->spillToDisk);
+
+  // The encoding (and hence the capacity) depends on the backing
+  if (!refreshHistoryCapacity())
+    rebuildPyramid();
+}
+
+void
+PhasePlotPage::rebuildPyramid()
+{
+  qreal size = SCAST(qreal, m_history.size());
+
+  m_pyramid.configure(
+        m_history.capacity(),
+        m_history.fileBacked() || m_history.compact()
+        ? PHASE_PLOT_PAGE_SPILL_PYRAMID_FACTOR
+        : PHASE_PYRAMID_DEFAULT_FACTOR);
+  m_pyramid.clear(m_history.offset());
+
+  m_sums.configure(m_history.capacity());
+  m_sums.clear(m_history.offset());
+
+  // Compact histories are decoded one window at a time
+  for (size_t i = 0; i < m_history.size(); i += PHASE_PLOT_PAGE_WINDOW_SIZE) {
+    size_t count = qMin(
+          m_history.size() - i,
+          SCAST(size_t, PHASE_PLOT_PAGE_WINDOW_SIZE));
+    const SUCOMPLEX *samples = historySamples(i, count);
+
+    m_pyramid.feed(samples, count);
+    m_sums.feed(samples, count);
+  }
+
+  m_decoded.clear();
+  m_decoded.shrink_to_fit();
+
+  fillWindow(size - .5 * PHASE_PLOT_PAGE_WINDOW_SIZE, size);
+
+  m_historyFull = false;
+  setLevel(0);
+  refreshMeasurements();
+}
+
 void
 PhasePlotPage::applyConfig(void)
 {
+  refreshHistoryCapacity();
+  refreshHistoryBacking();
+  refreshSnippetRing();
   refreshUi();
 
+  m_writer->setDirectIO(m_config->autoSaveDirectIO);
+  m_writer->setSyncPolicy(
+        SCAST(AutoSaveSyncPolicy, m_config->autoSaveSync),
+        m_config->autoSaveSyncPeriod);
+
   m_phaseAdjust = SU_C_EXP(-SU_I * SU_DEG2RAD(m_config->phaseOrigin));
   m_detector->resize(m_config->measurementTime * m_sampRate);
   m_detector->setHoldMax(m_config->measurementTime * m_sampRate);
@@ -870,21 +1782,60 @@ PhasePlotPage::setTimeStamp(struct timeval const &ts)
   // Update buffer size
   ui->sizeLabel->setText(
         SuWidgetsHelpers::formatBinaryQuantity(
-          m_data.capacity() * sizeof(SUCOMPLEX)));
+          SCAST(qint64, m_history.size() * m_history.sampleSize()))
+        + (m_history.fileBacked() ? " (disk)" : "")
+        + (m_history.compact() ? " (compact)" : ""));
 
-  if (m_data.size() > 0)
-    ui->waveform->refreshData();
+  m_waveformDirty = true;
+  scheduleRefresh();
 
-  if (m_autoSaveFp != nullptr)
+  // Stop before the disk fills up, rather than with a write error
+  if (m_writer->isOpen()
+      && m_writer->freeBytes() < SCAST(quint64, m_config->autoSaveMinFree)) {
+    closeAutoSaveFile();
+    m_config->autoSave = false;
+
+    ui->currentFileLabel->setText("None");
     ui->statusLabel->setText(
-          "Saving data ("
-          + SuWidgetsHelpers::formatBinaryQuantity(SCAST(qint64, m_savedSize))
-          + ")");
+          "Stopped: less than "
+          + SuWidgetsHelpers::formatBinaryQuantity(
+            SCAST(qint64, m_config->autoSaveMinFree))
+          + " left on disk");
+
+    refreshUi();
+  }
+
+  if (m_writer->isOpen()) {
+    QString status =
+        "Saving data ("
+        + SuWidgetsHelpers::formatBinaryQuantity(
+          SCAST(qint64, m_writer->writtenBytes()));
+
+    if (m_writer->droppedBytes() > 0)
+      status += ", "
+          + SuWidgetsHelpers::formatBinaryQuantity(
+            SCAST(qint64, m_writer->droppedBytes()))
+          + " dropped";
+
+    ui->statusLabel->setText(status + ")");
+  }
 }
 
 PhasePlotPage::~PhasePlotPage()
 {
   ui->waveform->safeCancel();
+
+  // Whatever is still queued is written by the destructor
+  closeAutoSaveFile();
+  m_writerThread->quit();
+  m_writerThread->wait();
+  delete m_writer;
+
+  m_replay->cancel();
+  m_replayThread->quit();
+  m_replayThread->wait();
+  delete m_replay;
+
   delete m_detector;
   delete ui;
 }
@@ -893,13 +1844,22 @@ PhasePlotPage::~PhasePlotPage()
 void
 PhasePlotPage::onSavePlot()
 {
+  const SUCOMPLEX *data = m_history.data();
+
+  // The dialog needs contiguous samples that outlive it
+  if (data == nullptr) {
+    m_export.resize(m_history.size());
+    m_history.read(0, m_history.size(), m_export.data());
+    data = m_export.data();
+  }
+
   SigDiggerHelpers::openSaveSamplesDialog(
         this,
-        m_data.data(),
-        m_data.size(),
+        data,
+        m_history.size(),
         m_sampRate,
         0,
-        m_data.size(),
+        m_history.size(),
         Suscan::Singleton::get_instance()->getBackgroundTaskController());
 }
 
@@ -928,20 +1888,9 @@ PhasePlotPage::onEnablePlotToggled()
 void
 PhasePlotPage::onMaxAllocChanged()
 {
-  bool flush = false;
   m_config->maxAlloc = ui->maxAllocMiBSpin->value() * (1 << 20);
 
-  ui->waveform->safeCancel();
-
-  if (m_data.size() > m_config->maxAlloc) {
-    flush = true;
-    m_data.resize(0);
-  }
-
-  m_data.reserve(m_config->maxAlloc / sizeof(SUCOMPLEX));
-
-  if (flush)
-    ui->waveform->setData(&m_data, true, m_config->doPlot);
+  refreshHistoryCapacity();
 }
 
 
@@ -1022,6 +1971,12 @@ PhasePlotPage::onAoAToggled()
 
 #define EVENT_LOG_FILTER_STRING           "Event log (*.log)"
 #define COHERENT_EVENT_LIST_FILTER_STRING "Coherent event list (*.csv)"
+#define PHASE_RECORDING_FILTER_STRING \
+  "Phase difference recordings (" PHASE_RECORDING_PREFIX "*.raw " \
+  PHASE_RECORDING_PREFIX "*" PHASE_RECORDING_COMPRESSED_EXTENSION " *" \
+  SIGMF_DATA_EXTENSION " *" SIGMF_META_EXTENSION ")"
+#define COHERENT_EVENT_TABLE_FILTER_STRING \
+  "Coherent event table (*" EVENT_STORE_TABLE_EXTENSION ")"
 void
 PhasePlotPage::onSaveLog()
 {
@@ -1037,7 +1992,8 @@ PhasePlotPage::onSaveLog()
     dialog.setWindowTitle(QString("Save event log"));
 
     filters << EVENT_LOG_FILTER_STRING
-            << COHERENT_EVENT_LIST_FILTER_STRING;
+            << COHERENT_EVENT_LIST_FILTER_STRING
+            << COHERENT_EVENT_TABLE_FILTER_STRING;
 
     dialog.setNameFilters(filters);
 
@@ -1050,6 +2006,8 @@ PhasePlotPage::onSaveLog()
         done = saveLog(path);
       else if (filter == COHERENT_EVENT_LIST_FILTER_STRING)
         done = saveCSV(path);
+      else if (filter == COHERENT_EVENT_TABLE_FILTER_STRING)
+        done = saveTable(path);
     } else {
       done = true;
     }
@@ -1059,10 +2017,145 @@ PhasePlotPage::onSaveLog()
 void
 PhasePlotPage::onClearLog()
 {
-  ui->logTextEdit->clear();
-  m_eventList.clear();
+  // Only the visible log: the event store keeps the whole history
+  m_log->clear();
+}
+
+//
+// Replays run the detector with the current settings over a recording,
+// and replace the log and the event list with what it found there, as
+// if it had been captured live.
+//
+void
+PhasePlotPage::onReplay()
+{
+  QString path;
+  SUFLOAT phaseScale = m_phaseScale;
+  SUSCOUNT size;
+
+  if (m_replaying) {
+    m_replay->cancel();
+    return;
+  }
+
+  path = QFileDialog::getOpenFileName(
+        this,
+        "Replay recording",
+        QString::fromStdString(m_config->saveDir),
+        PHASE_RECORDING_FILTER_STRING);
+
+  if (path.isEmpty())
+    return;
 
-  m_infoLogged = false;
+  if (!m_replay->open(path)) {
+    QMessageBox::critical(
+          this,
+          "Replay recording",
+          "Cannot replay recording: "
+          + m_replay->recording().errorString());
+    return;
+  }
+
+  PhaseRecording const &recording = m_replay->recording();
+
+  if (recording.frequency() > 0)
+    phaseScale = SCAST(
+          SUFLOAT,
+          2 * M_PI * m_config->dipoleSep * recording.frequency()
+          / 2.9979246e+08);
+
+  size = SCAST(
+        SUSCOUNT,
+        m_config->measurementTime * recording.sampleRate());
+  m_replay->setDetector(
+        size,
+        size,
+        SU_DEG2RAD(m_config->coherenceThreshold),
+        phaseScale);
+
+  onClearLog();
+
+  logText(
+        recording.start(),
+        "Replaying " + QFileInfo(recording.path()).fileName() + " ("
+        + SuWidgetsHelpers::formatQuantity(
+          SCAST(qreal, recording.size()) / recording.sampleRate(),
+          4,
+          "s")
+        + " at "
+        + SuWidgetsHelpers::formatQuantity(recording.sampleRate(), 4, "sps")
+        + ")");
+  logText(
+        recording.start(),
+        "  Max phase dispersion: "
+        + SuWidgetsHelpers::formatQuantity(m_config->coherenceThreshold, "º"));
+  logText(
+        recording.start(),
+        "  Measuremen interval:  "
+        + SuWidgetsHelpers::formatQuantity(m_config->measurementTime, 4, "s"));
+
+  m_replaying = true;
+  m_replayClock.start();
+  ui->replayButton->setText("Cancel replay");
+
+  QMetaObject::invokeMethod(m_replay, "run", Qt::QueuedConnection);
+}
+
+void
+PhasePlotPage::onReplayProgress(qreal progress)
+{
+  if (m_replaying)
+    ui->replayButton->setText(
+          QString::asprintf("Cancel replay (%d%%)", qRound(100 * progress)));
+}
+
+void
+PhasePlotPage::onReplayFinished(bool completed)
+{
+  PhaseRecording const &recording = m_replay->recording();
+  struct timeval base = recording.start();
+  qreal rate = recording.sampleRate();
+  qreal elapsed = 1e-3 * SCAST(qreal, qMax<qint64>(m_replayClock.elapsed(), 1));
+
+  m_replaying = false;
+  ui->replayButton->setText("&Replay recording...");
+
+  if (!completed) {
+    logText(base, "Replay cancelled");
+    m_replay->close();
+    return;
+  }
+
+  // Replayed events go to a store of their own
+  m_events.close();
+  openEventStore(base);
+
+  for (auto const &replayed : m_replay->events()) {
+    struct timeval const &start = replayed.event.timeStamp;
+    qreal duration = (replayed.end - replayed.start) / rate;
+
+    m_lastEvent = start;
+
+    logEventStart(start);
+    storeEvent(
+          EventStore::record(replayed.event, start, replayed.start, duration));
+    logEventEnd(recording.time(replayed.end), duration, replayed.event);
+  }
+
+  logText(
+        recording.time(recording.size()),
+        "Replay finished: "
+        + QString::number(m_replay->events().size())
+        + " events in "
+        + SuWidgetsHelpers::formatQuantity(elapsed, 4, "s")
+        + " ("
+        + SuWidgetsHelpers::formatQuantity(
+          recording.size() / elapsed,
+          4,
+          "sps")
+        + ")");
+
+  m_replay->close();
 }
 
 void
@@ -1072,6 +2165,53 @@ PhasePlotPage::onToggleAutoSave()
   cycleAutoSaveFile();
 }
 
+void
+PhasePlotPage::onToggleSpill()
+{
+  m_config->spillToDisk = ui->spillCheck->isChecked();
+  refreshHistoryBacking();
+}
+
+void
+PhasePlotPage::onToggleCompact()
+{
+  m_config->compactHistory = ui->compactCheck->isChecked();
+  refreshHistoryCapacity();
+}
+
+void
+PhasePlotPage::onToggleSnippets()
+{
+  m_config->snippetCapture = ui->snippetCheck->isChecked();
+  cycleAutoSaveFile();
+}
+
+void
+PhasePlotPage::onChangeAutoSaveFormat()
+{
+  m_config->autoSaveFormat = ui->saveFormatCombo->currentIndex();
+  m_config->autoSaveSigMF  = ui->sigmfCheck->isChecked();
+
+  ui->sigmfCheck->setEnabled(
+        m_config->autoSaveFormat != AUTO_SAVE_FORMAT_ZCI16);
+
+  // Never mix formats in the same file
+  if (m_writer->isOpen())
+    cycleAutoSaveFile();
+}
+
+void
+PhasePlotPage::onAutoSaveError(QString error)
+{
+  closeAutoSaveFile();
+  m_config->autoSave = false;
+
+  ui->currentFileLabel->setText("None");
+  ui->statusLabel->setText("Save aborted: " + error);
+
+  refreshUi();
+}
+
 void
 PhasePlotPage::onBrowseSaveDir()
 {
@@ -1086,6 +2226,12 @@ PhasePlotPage::onBrowseSaveDir()
     m_config->saveDir = path.toStdString();
     refreshUi();
     cycleAutoSaveFile();
+
+    // The display window is a copy, nothing on screen reads the file
+    if (m_history.fileBacked()
+        && !m_history.setFileBacked(m_config->saveDir))
+      ui->statusLabel->setText(
+            "Cannot move history: " + QString(strerror(errno)));
   }
 }
 
@@ -1094,3 +2240,41 @@ PhasePlotPage::onHSelection(qreal, qreal)
 {
   refreshMeasurements();
 }
+
+void
+PhasePlotPage::onHRangeChanged(qint64 min, qint64 max)
+{
+  if (!m_levelChanging)
+    refreshLevel(min, max);
+}
+
+void
+PhasePlotPage::onRefresh()
+{
+  QScrollBar *logBar = ui->logView->verticalScrollBar();
+  bool followLog = logBar->value() == logBar->maximum();
+
+  // Keep the log scrolling, unless the user went up to read it
+  if (m_log->flush() && followLog)
+    ui->logView->scrollToBottom();
+
+  if (!m_phasePending.empty()) {
+    size_t count = qMin(
+          m_phasePending.size(),
+          SCAST(size_t, PHASE_PLOT_PAGE_PHASE_HISTORY));
+
+    if (!m_haveSelection)
+      ui->phaseView->feed(
+            m_phasePending.data() + m_phasePending.size() - count,
+            SCAST(unsigned, count));
+
+    m_phasePending.clear();
+  }
+
+  if (m_waveformDirty) {
+    m_waveformDirty = false;
+
+    if (!m_history.empty())
+      ui->waveform->refreshData();
+  }
+}
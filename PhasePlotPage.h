@@ -20,10 +20,38 @@
 #define PHASEPLOTPAGE_H
 
 #include <TabWidgetFactory.h>
+#include <QElapsedTimer>
 #include <QShowEvent>
-#include <list>
+#include <QThread>
+#include <QTimer>
 
+#include "AutoSaveWriter.h"
 #include "CoherentDetector.h"
+#include "CoherentReplay.h"
+#include "EventLogModel.h"
+#include "EventStore.h"
+#include "PhaseHistory.h"
+#include "PhasePrefixSums.h"
+#include "PhasePyramid.h"
+#include "RecordingIndex.h"
+#include "SampleRing.h"
+#include "SigMFMetadata.h"
+
+// Raw samples on display at full zoom, copied out of the history ring
+#define PHASE_PLOT_PAGE_WINDOW_SIZE          (1 << 20)
+
+// Coarser first level, to keep the pyramid small next to a disk or
+// compact history
+#define PHASE_PLOT_PAGE_SPILL_PYRAMID_FACTOR 64
+
+// Points on the phase view
+#define PHASE_PLOT_PAGE_PHASE_HISTORY        100
+
+// Points per second fed to the phase view, each the mean of a slice
+#define PHASE_PLOT_PAGE_PHASE_RATE           1000
+
+// Display refresh rate, when the screen does not tell
+#define PHASE_PLOT_PAGE_DEFAULT_FRAME_RATE   60
 
 namespace Ui {
   class PhasePlotPage;
@@ -46,6 +74,20 @@ namespace SigDigger {
     float  dipoleSep          = 1.1; // meters
     bool   angleOfArrival     = false;
     bool   autoSave           = false;
+    bool   autoSaveDirectIO   = false;
+    int    autoSaveSync       = AUTO_SAVE_SYNC_ON_CLOSE;
+    int    autoSaveSyncPeriod = AUTO_SAVE_WRITER_DEFAULT_SYNC_INTERVAL; // ms
+    int    autoSaveFormat     = AUTO_SAVE_FORMAT_NATIVE;
+    float  autoSaveFullScale  = 0; // 0: from the plot gain
+    bool   autoSaveSigMF      = false;
+    float  autoSaveRotateTime = 0; // seconds, 0: never
+    double autoSaveRotateSize = 0; // bytes, 0: never
+    double autoSaveMinFree    = 1 << 30;
+    bool   snippetCapture     = false;
+    float  snippetPreTrigger  = .5; // seconds
+    float  snippetPostTrigger = .5; // seconds
+    bool   spillToDisk        = false;
+    bool   compactHistory     = false;
     std::string saveDir       = "";
 
     // Overriden methods
@@ -61,10 +103,26 @@ namespace SigDigger {
     PhaseComparator *m_owner      = nullptr;
     CoherentDetector *m_detector  = nullptr;
     PhasePlotPageConfig *m_config = nullptr;
+    std::vector<CoherentTransition> m_transitions;
+
+    PhaseHistory           m_history;
+    PhasePyramid           m_pyramid;
+    PhasePrefixSums        m_sums;
+    std::vector<SUCOMPLEX> m_window;
+    SUSCOUNT               m_windowStart = 0;
+    std::vector<SUCOMPLEX> m_decoded;
+    std::vector<SUCOMPLEX> m_export;
 
-    std::vector<SUCOMPLEX> m_data;
+    // Display refresh
+    QTimer                *m_refreshTimer = nullptr;
+    std::vector<SUCOMPLEX> m_phasePending;
+    SUCOMPLEX              m_phaseAcc        = 0;
+    SUSCOUNT               m_phaseCount      = 0;
+    SUSCOUNT               m_phaseDecimation = 1;
+    bool                   m_waveformDirty   = false;
     std::vector<SUCOMPLEX> m_empty;
-    std::list<CoherentEvent> m_eventList;
+    EventStore             m_events;
+    EventLogModel         *m_log = nullptr;
 
     SUFLOAT   m_sampRate;
     SUCOMPLEX m_accumulated;
@@ -74,32 +132,93 @@ namespace SigDigger {
     SUCOMPLEX m_phaseAdjust = 1;
     SUFLOAT   m_wavelength;
     SUFLOAT   m_phaseScale;
-    FILE     *m_autoSaveFp = nullptr;
-    SUSCOUNT  m_savedSize  = 0;
+    AutoSaveWriter *m_writer       = nullptr;
+    QThread        *m_writerThread = nullptr;
+    SigMFMetadata   m_sigmf;
+    RecordingIndex  m_recordingIndex;
+    QString         m_autoSavePath;
+    QString         m_nextAutoSavePath;
+    unsigned        m_autoSaveNumber  = 1;
+    SUFLOAT         m_writerFullScale = 1;
+    SUSCOUNT        m_savedSamples    = 0;
+    SUSCOUNT        m_eventSample     = 0;
+    SUSCOUNT        m_streamSamples   = 0;
+    SampleRing      m_preTrigger;
+    SUSCOUNT        m_postTrigger     = 0;
+    bool            m_snippetOpen     = false;
+
+    // Offline replay
+    CoherentReplay *m_replay       = nullptr;
+    QThread        *m_replayThread = nullptr;
+    QElapsedTimer   m_replayClock;
+    bool            m_replaying    = false;
 
     struct timeval m_lastTimeStamp;
     struct timeval m_lastEvent;
     struct timeval m_firstSamples;
 
     bool      m_haveFirstSamples = false;
-    bool      m_infoLogged       = false;
     bool      m_haveEvent        = false;
     bool      m_haveSelection    = false;
     bool      m_dataUpdated      = false;
+    bool      m_historyFull      = false;
+    bool      m_levelChanging    = false;
+    unsigned  m_level            = 0;
 
+    QString nextAutoSavePath();
+    SUFLOAT autoSaveFullScale() const;
+    quint64 autoSavePreallocation() const;
+    bool autoSaveRotationDue() const;
+    void prepareAutoSaveFile();
+    void startAutoSaveFile(QString const &, struct timeval const &);
+    void finishAutoSaveFile();
+    void closeAutoSaveFile();
+    void rotateAutoSaveFile(struct timeval const &);
+    bool snippetMode() const;
+    void refreshSnippetRing();
+    void openSnippet(struct timeval const &);
+    void closeSnippet();
+    void feedSnippet(
+        struct timeval const &,
+        const SUCOMPLEX *,
+        SUSCOUNT from,
+        SUSCOUNT to);
+    void indexAutoSave(struct timeval const &);
     void refreshMeasurements();
     void logDetectorInfo();
     void clearData();
+    void setWaveformData(bool flush);
+    bool refreshHistoryCapacity();
+    void refreshHistoryBacking();
+    void rebuildPyramid();
+    const SUCOMPLEX *historySamples(size_t index, size_t count);
+    void fillWindow(qreal, qreal);
+    void followWindow(SUSCOUNT);
+    bool windowCovers(qreal, qreal) const;
+    SUSCOUNT levelStart() const;
+    void setLevel(unsigned);
+    void refreshLevel(qint64, qint64);
+    qreal levelScale() const;
+    qreal displayToHistory(qreal) const;
+    qreal historyToDisplay(qreal) const;
     void refreshUi();
     void plotSelectionPhase(qint64, qint64);
+    void feedPhaseView(const SUCOMPLEX *, SUSCOUNT);
+    void scheduleRefresh();
     void connectAll();
     void logText(QString const &);
     void logText(struct timeval const &, QString const &);
+    void logEntry(EventLogEntry const &);
     void refreshPhaseScale();
     void showEvent(QShowEvent *) override;
 
     bool saveLog(QString const &);
     bool saveCSV(QString const &);
+    bool saveTable(QString const &);
+    void openEventStore(struct timeval const &);
+    void storeEvent(EventRecord const &);
+    void logEventStart(struct timeval const &);
+    void logEventEnd(struct timeval const &, qreal, CoherentEvent const &);
 
   public:
     explicit PhasePlotPage(
@@ -109,12 +228,12 @@ namespace SigDigger {
 
     ~PhasePlotPage() override;
 
+    // tv is the source time of the first sample of the block
     void feed(struct timeval const &tv, const SUCOMPLEX *, SUSCOUNT);
     void setFreqencyLimits(SUFREQ min, SUFREQ max);
 
-    QString genAutoSaveFileName() const;
+    QString genAutoSaveFileName();
 
-    void abortAutoSaveFile(int error);
     void cycleAutoSaveFile();
 
     void setProperties(
@@ -138,6 +257,7 @@ namespace SigDigger {
     void closeReq();
     void frequencyChanged(qreal);
     void bandwidthChanged(qreal);
+    void eventDetected(CoherentEvent const &);
 
   public slots:
     void onSavePlot();
@@ -157,10 +277,20 @@ namespace SigDigger {
     void onLogEnableToggled();
     void onSaveLog();
     void onClearLog();
+    void onReplay();
+    void onReplayProgress(qreal);
+    void onReplayFinished(bool);
 
     void onToggleAutoSave();
+    void onToggleSnippets();
+    void onChangeAutoSaveFormat();
+    void onAutoSaveError(QString);
+    void onToggleSpill();
+    void onToggleCompact();
     void onBrowseSaveDir();
     void onHSelection(qreal, qreal);
+    void onHRangeChanged(qint64, qint64);
+    void onRefresh();
   };
 
 }
@@ -0,0 +1,195 @@
+//
+//    PhasePrefixSums.cpp: Blocked prefix sums of a phase difference history
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "PhasePrefixSums.h"
+#include <algorithm>
+
+using namespace SigDigger;
+
+void
+PhasePrefixSums::accumulate(Boundary &acc, const SUCOMPLEX *data, size_t size)
+{
+  for (size_t i = 0; i < size; ++i) {
+    double re = SU_C_REAL(data[i]);
+    double im = SU_C_IMAG(data[i]);
+
+    acc.re    += re;
+    acc.im    += im;
+    acc.power += re * re + im * im;
+  }
+}
+
+//
+// Compact histories have no raw samples to point at: decode them a few
+// at a time on the stack.
+//
+void
+PhasePrefixSums::accumulate(
+    Boundary &acc,
+    PhaseHistory const &history,
+    size_t index,
+    size_t size)
+{
+  SUCOMPLEX block[PHASE_HISTORY_ENCODE_BLOCK];
+
+  if (history.data() != nullptr) {
+    accumulate(acc, history.data() + index, size);
+    return;
+  }
+
+  while (size > 0) {
+    size_t chunk = std::min<size_t>(size, PHASE_HISTORY_ENCODE_BLOCK);
+
+    history.read(index, chunk, block);
+    accumulate(acc, block, chunk);
+
+    index += chunk;
+    size  -= chunk;
+  }
+}
+
+void
+PhasePrefixSums::configure(size_t capacity, unsigned block)
+{
+  if (block < 1)
+    block = 1;
+
+  m_block = block;
+  m_sums.clear();
+  m_sums.shrink_to_fit();
+
+  // Trimming happens before feeding, so the history never exceeds twice
+  // its capacity here
+  m_sums.reserve(2 * capacity / block + 2);
+
+  clear();
+}
+
+unsigned
+PhasePrefixSums::block() const
+{
+  return m_block;
+}
+
+PhaseSum
+PhasePrefixSums::sum(
+    PhaseHistory const &history,
+    SUSCOUNT start,
+    SUSCOUNT end) const
+{
+  SUSCOUNT first = history.offset();
+  SUSCOUNT last  = first + history.size();
+  Boundary acc;
+  PhaseSum result;
+
+  start = std::max(start, first);
+  end   = std::min(end, last);
+
+  if (start >= end)
+    return result;
+
+  result.count = end - start;
+
+  if (start >= m_base && !m_sums.empty()) {
+    SUSCOUNT lo = (start - m_base + m_block - 1) / m_block;
+    SUSCOUNT hi = (end - m_base) / m_block;
+
+    if (lo < hi && lo >= m_offset && hi < m_offset + m_sums.size()) {
+      Boundary const &a = m_sums[lo - m_offset];
+      Boundary const &b = m_sums[hi - m_offset];
+      SUSCOUNT loSample = m_base + lo * m_block;
+      SUSCOUNT hiSample = m_base + hi * m_block;
+
+      acc.re    = b.re - a.re;
+      acc.im    = b.im - a.im;
+      acc.power = b.power - a.power;
+
+      accumulate(acc, history, start - first, loSample - start);
+      accumulate(acc, history, hiSample - first, end - hiSample);
+
+      start = end;
+    }
+  }
+
+  // Short ranges (or ranges not covered by the boundaries)
+  accumulate(acc, history, start - first, end - start);
+
+  result.phasor = SUCOMPLEX(static_cast<SUFLOAT>(acc.re), static_cast<SUFLOAT>(acc.im));
+  result.power  = static_cast<SUFLOAT>(acc.power);
+
+  return result;
+}
+
+void
+PhasePrefixSums::feed(const SUCOMPLEX *data, size_t size)
+{
+  while (size > 0) {
+    size_t chunk = std::min<size_t>(size, m_block - m_count);
+
+    accumulate(m_acc, data, chunk);
+
+    m_count += chunk;
+    data    += chunk;
+    size    -= chunk;
+
+    if (m_count == m_block) {
+      // Never outgrow the reservation: give up the oldest boundary instead
+      if (m_sums.size() == m_sums.capacity()) {
+        m_sums.erase(m_sums.begin());
+        ++m_offset;
+      }
+
+      m_sums.push_back(m_acc);
+      m_count = 0;
+    }
+  }
+}
+
+void
+PhasePrefixSums::trim(SUSCOUNT start)
+{
+  SUSCOUNT first;
+  size_t drop;
+
+  if (start < m_base)
+    return;
+
+  // Keep the boundary at or right before `start`
+  first = (start - m_base) / m_block;
+
+  if (first > m_offset) {
+    drop = static_cast<size_t>(
+          std::min<SUSCOUNT>(first - m_offset, m_sums.size()));
+
+    m_sums.erase(m_sums.begin(), m_sums.begin() + static_cast<ptrdiff_t>(drop));
+    m_offset += drop;
+  }
+}
+
+void
+PhasePrefixSums::clear(SUSCOUNT base)
+{
+  m_base   = base;
+  m_offset = 0;
+  m_acc    = Boundary();
+  m_count  = 0;
+
+  m_sums.clear();
+  m_sums.push_back(m_acc);
+}
@@ -0,0 +1,89 @@
+//
+//    PhasePrefixSums.h: Blocked prefix sums of a phase difference history
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef PHASEPREFIXSUMS_H
+#define PHASEPREFIXSUMS_H
+
+#include <sigutils/types.h>
+#include <vector>
+#include "PhaseHistory.h"
+
+#define PHASE_PREFIX_SUMS_DEFAULT_BLOCK 64
+
+//
+// Running sums of the phasor and the power of a PhaseHistory, taken every
+// `block` samples. The sum over any range is the difference of the two
+// block boundaries inside it, plus less than two blocks of raw samples
+// at its ends, so it costs the same no matter how long the range is.
+//
+// Sums are kept in double precision, since they grow with the capture.
+// Boundaries are indexed in absolute terms from the raw index passed to
+// clear(), and the storage is reserved in configure() for twice the
+// history capacity, so trimming before feeding keeps it from growing.
+//
+
+namespace SigDigger {
+  struct PhaseSum {
+    SUCOMPLEX phasor = 0; // Sum of the samples
+    SUFLOAT   power  = 0; // Sum of their squared magnitudes
+    SUSCOUNT  count  = 0;
+  };
+
+  class PhasePrefixSums
+  {
+    struct Boundary {
+      double re    = 0;
+      double im    = 0;
+      double power = 0;
+    };
+
+    unsigned              m_block  = PHASE_PREFIX_SUMS_DEFAULT_BLOCK;
+    SUSCOUNT              m_base   = 0;
+    SUSCOUNT              m_offset = 0; // First boundary kept
+    std::vector<Boundary> m_sums;
+
+    Boundary              m_acc;    // Up to the last sample fed
+    unsigned              m_count = 0;
+
+    static void accumulate(Boundary &, const SUCOMPLEX *, size_t);
+    static void accumulate(
+        Boundary &,
+        PhaseHistory const &,
+        size_t index,
+        size_t size);
+
+  public:
+    void     configure(
+        size_t capacity,
+        unsigned block = PHASE_PREFIX_SUMS_DEFAULT_BLOCK);
+
+    unsigned block() const;
+
+    // Sums over the history samples in the absolute range [start, end)
+    PhaseSum sum(PhaseHistory const &, SUSCOUNT start, SUSCOUNT end) const;
+
+    void     feed(const SUCOMPLEX *, size_t);
+
+    // Drop the boundaries no longer needed for ranges starting at `start`
+    void     trim(SUSCOUNT start);
+    void     clear(SUSCOUNT base = 0);
+  };
+}
+
+#endif // PHASEPREFIXSUMS_H
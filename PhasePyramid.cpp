@@ -0,0 +1,219 @@
+//
+//    PhasePyramid.cpp: Multi-resolution summary of a phase difference history
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "PhasePyramid.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace SigDigger;
+
+PhasePyramid::PhasePyramid()
+{
+  configure(0);
+}
+
+void
+PhasePyramid::configure(size_t capacity, unsigned factor)
+{
+  SUSCOUNT span;
+
+  if (factor < 2)
+    factor = 2;
+
+  m_factor = factor;
+  m_base   = 0;
+  m_levels.clear();
+
+  span = factor;
+  do {
+    Level level;
+
+    // Trimming happens before feeding, so the history never exceeds
+    // twice its capacity here. Leave room for partial bins on both ends.
+    size_t bins = 2 * capacity / span + 2;
+
+    level.span = span;
+    level.bins.reserve(bins);
+    level.display.reserve(2 * bins);
+
+    m_levels.push_back(std::move(level));
+
+    span *= factor;
+  } while (capacity / (span / factor) > PHASE_PYRAMID_MAX_BINS);
+}
+
+unsigned
+PhasePyramid::levels() const
+{
+  return static_cast<unsigned>(m_levels.size());
+}
+
+unsigned
+PhasePyramid::factor() const
+{
+  return m_factor;
+}
+
+SUSCOUNT
+PhasePyramid::span(unsigned level) const
+{
+  return level == 0 ? 1 : m_levels[level - 1].span;
+}
+
+SUSCOUNT
+PhasePyramid::base() const
+{
+  return m_base;
+}
+
+SUSCOUNT
+PhasePyramid::offset(unsigned level) const
+{
+  return m_levels[level - 1].offset;
+}
+
+size_t
+PhasePyramid::size(unsigned level) const
+{
+  return m_levels[level - 1].bins.size();
+}
+
+const PhasePyramidBin &
+PhasePyramid::bin(unsigned level, size_t index) const
+{
+  return m_levels[level - 1].bins[index];
+}
+
+const std::vector<SUCOMPLEX> *
+PhasePyramid::display(unsigned level) const
+{
+  return &m_levels[level - 1].display;
+}
+
+unsigned
+PhasePyramid::levelFor(SUSCOUNT rawSpan, SUSCOUNT bins) const
+{
+  unsigned level = 0;
+
+  for (unsigned i = 1; i <= levels(); ++i)
+    if (rawSpan / span(i) >= bins)
+      level = i;
+
+  return level;
+}
+
+void
+PhasePyramid::push(unsigned index, PhasePyramidBin const &bin)
+{
+  Level &level = m_levels[index];
+  SUCOMPLEX phasor = 1;
+  SUFLOAT mag = SU_C_ABS(bin.mean);
+
+  if (mag > 0)
+    phasor = bin.mean / mag;
+
+  // Never outgrow the reservation: the waveform may be reading these
+  if (level.bins.size() == level.bins.capacity())
+    return;
+
+  level.bins.push_back(bin);
+  level.display.push_back(bin.max * phasor);
+  level.display.push_back(bin.min * phasor);
+
+  if (index + 1 < m_levels.size()) {
+    Level &next = m_levels[index + 1];
+
+    if (next.count == 0) {
+      next.partial = bin;
+    } else {
+      next.partial.min   = std::min(next.partial.min, bin.min);
+      next.partial.max   = std::max(next.partial.max, bin.max);
+      next.partial.mean += bin.mean;
+    }
+
+    if (++next.count == m_factor) {
+      next.partial.mean /= static_cast<SUFLOAT>(m_factor);
+      next.count = 0;
+      push(index + 1, next.partial);
+    }
+  }
+}
+
+void
+PhasePyramid::feed(const SUCOMPLEX *data, size_t size)
+{
+  Level &first = m_levels[0];
+
+  for (size_t i = 0; i < size; ++i) {
+    SUFLOAT mag = SU_C_ABS(data[i]);
+
+    if (first.count == 0) {
+      first.partial.min  = first.partial.max = mag;
+      first.partial.mean = data[i];
+    } else {
+      first.partial.min   = std::min(first.partial.min, mag);
+      first.partial.max   = std::max(first.partial.max, mag);
+      first.partial.mean += data[i];
+    }
+
+    if (++first.count == m_factor) {
+      first.partial.mean /= static_cast<SUFLOAT>(m_factor);
+      first.count = 0;
+      push(0, first.partial);
+    }
+  }
+}
+
+void
+PhasePyramid::trim(SUSCOUNT start)
+{
+  if (start < m_base)
+    return;
+
+  for (auto &level : m_levels) {
+    SUSCOUNT first = (start - m_base) / level.span;
+
+    if (first > level.offset) {
+      size_t drop = static_cast<size_t>(
+            std::min<SUSCOUNT>(first - level.offset, level.bins.size()));
+
+      level.bins.erase(
+            level.bins.begin(),
+            level.bins.begin() + static_cast<ptrdiff_t>(drop));
+      level.display.erase(
+            level.display.begin(),
+            level.display.begin() + static_cast<ptrdiff_t>(2 * drop));
+
+      level.offset += drop;
+    }
+  }
+}
+
+void
+PhasePyramid::clear(SUSCOUNT base)
+{
+  m_base = base;
+
+  for (auto &level : m_levels) {
+    level.bins.clear();
+    level.display.clear();
+    level.offset = 0;
+    level.count  = 0;
+  }
+}
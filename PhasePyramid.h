@@ -0,0 +1,101 @@
+//
+//    PhasePyramid.h: Multi-resolution summary of a phase difference history
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef PHASEPYRAMID_H
+#define PHASEPYRAMID_H
+
+#include <sigutils/types.h>
+#include <vector>
+
+#define PHASE_PYRAMID_DEFAULT_FACTOR 16
+#define PHASE_PYRAMID_MAX_BINS       (1 << 16)
+
+//
+// Level-of-detail pyramid built incrementally on top of a PhaseHistory.
+// Each bin of level l summarizes factor^l raw samples with the minimum
+// and maximum magnitude and the mean phasor. Levels are added until the
+// coarsest one holds at most PHASE_PYRAMID_MAX_BINS bins for the whole
+// history capacity, so plotting it costs the same no matter how long the
+// capture has been running.
+//
+// Bins are indexed in absolute terms: bin i of level l covers the raw
+// samples [base + i * span(l), base + (i + 1) * span(l)), where base is
+// the raw index of the first sample fed after clear(). Every level also
+// keeps a display vector with two samples per bin (maximum and minimum
+// magnitude, both with the phase of the mean) that can be handed to the
+// waveform widget as is. All vectors are reserved in configure() and
+// never reallocated afterwards.
+//
+
+namespace SigDigger {
+  struct PhasePyramidBin {
+    SUFLOAT   min  = 0;
+    SUFLOAT   max  = 0;
+    SUCOMPLEX mean = 0;
+  };
+
+  class PhasePyramid
+  {
+    struct Level {
+      SUSCOUNT span   = 0;
+      SUSCOUNT offset = 0;
+      std::vector<PhasePyramidBin> bins;
+      std::vector<SUCOMPLEX>       display;
+
+      PhasePyramidBin partial;
+      unsigned        count = 0;
+    };
+
+    unsigned           m_factor = PHASE_PYRAMID_DEFAULT_FACTOR;
+    SUSCOUNT           m_base   = 0;
+    std::vector<Level> m_levels; // m_levels[0] is level 1
+
+    void push(unsigned index, PhasePyramidBin const &);
+
+  public:
+    PhasePyramid();
+
+    // Invalidates the display vectors handed out so far
+    void     configure(
+        size_t capacity,
+        unsigned factor = PHASE_PYRAMID_DEFAULT_FACTOR);
+
+    // Level 0 is the raw history itself, which is not stored here
+    unsigned levels() const;
+    unsigned factor() const;
+    SUSCOUNT span(unsigned level) const;
+    SUSCOUNT base() const;
+    SUSCOUNT offset(unsigned level) const;
+    size_t   size(unsigned level) const;
+
+    const PhasePyramidBin &bin(unsigned level, size_t) const;
+    const std::vector<SUCOMPLEX> *display(unsigned level) const;
+
+    // Coarsest level that still has `bins` bins along `rawSpan` samples
+    unsigned levelFor(SUSCOUNT rawSpan, SUSCOUNT bins) const;
+
+    void     feed(const SUCOMPLEX *, size_t);
+
+    // Drop the bins that end before the absolute raw index `start`
+    void     trim(SUSCOUNT start);
+    void     clear(SUSCOUNT base = 0);
+  };
+}
+
+#endif // PHASEPYRAMID_H
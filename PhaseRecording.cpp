@@ -0,0 +1,455 @@
+//
+//    PhaseRecording.cpp: Read-only view of a phase difference recording
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "PhaseRecording.h"
+#include "SigMFMetadata.h"
+#include "SignalKernels.h"
+#include <QDateTime>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace SigDigger;
+
+PhaseRecording::PhaseRecording()
+{
+  m_start.tv_sec  = 0;
+  m_start.tv_usec = 0;
+}
+
+PhaseRecording::~PhaseRecording()
+{
+  close();
+}
+
+bool
+PhaseRecording::parseName(QString const &path)
+{
+  QRegularExpression re(
+        "^" PHASE_RECORDING_PREFIX
+        "(\\d{8}_\\d{6})_(-?\\d+)_(\\d+)sps_\\d+"
+        "(?:(_ci16|_cf16)?\\.raw"
+        "|(\\" PHASE_RECORDING_COMPRESSED_EXTENSION "))$");
+  QRegularExpressionMatch match = re.match(QFileInfo(path).fileName());
+  QDateTime time;
+
+  if (!match.hasMatch()) {
+    m_error = "Cannot tell the sample rate and format from the file name";
+    return false;
+  }
+
+  time = QDateTime::fromString(match.captured(1), "yyyyMMdd_HHmmss");
+  time.setTimeSpec(Qt::UTC);
+
+  m_start.tv_sec  = static_cast<time_t>(time.toSecsSinceEpoch());
+  m_start.tv_usec = 0;
+  m_frequency     = match.captured(2).toDouble();
+  m_sampRate      = match.captured(3).toDouble();
+
+  if (!match.captured(5).isEmpty()) {
+    // The full scale comes from the header
+    m_format = AUTO_SAVE_FORMAT_ZCI16;
+  } else if (match.captured(4) == "_ci16") {
+    m_format = AUTO_SAVE_FORMAT_CI16;
+    m_scale  = 1.f / 32767;
+  } else if (match.captured(4) == "_cf16") {
+    m_format = AUTO_SAVE_FORMAT_CF16;
+    m_scale  = 1;
+  } else {
+    m_format = AUTO_SAVE_FORMAT_NATIVE;
+  }
+
+  return true;
+}
+
+bool
+PhaseRecording::parseMetadata(QString const &path)
+{
+  SigMFMetadata meta;
+  QJsonObject capture;
+  SUFLOAT fullScale;
+
+  if (!meta.load(path)) {
+    m_error = "Cannot read SigMF metadata from " + path;
+    return false;
+  }
+
+  if (!SigMFMetadata::format(
+        meta.global()["core:datatype"].toString(),
+        m_format)) {
+    m_error = "Unsupported SigMF datatype "
+        + meta.global()["core:datatype"].toString();
+    return false;
+  }
+
+  m_sampRate = meta.global()["core:sample_rate"].toDouble();
+  fullScale  = static_cast<SUFLOAT>(
+        meta.global()[SIGMF_ANTSDR_NAMESPACE ":full_scale"].toDouble(1));
+
+  if (m_format == AUTO_SAVE_FORMAT_CI16)
+    m_scale = fullScale / 32767;
+  else if (m_format == AUTO_SAVE_FORMAT_CF16)
+    m_scale = fullScale;
+
+  if (!meta.captures().isEmpty()) {
+    capture     = meta.captures()[0].toObject();
+    m_frequency = capture["core:frequency"].toDouble();
+    SigMFMetadata::parseDateTime(capture["core:datetime"].toString(), m_start);
+  }
+
+  return true;
+}
+
+bool
+PhaseRecording::map(QString const &path)
+{
+  QByteArray name = path.toLocal8Bit();
+  struct stat sbuf;
+  void *data;
+  size_t sampleSize = AutoSaveWriter::sampleSize(m_format);
+
+  if ((m_fd = ::open(name.data(), O_RDONLY)) == -1)
+    goto fail;
+
+  if (fstat(m_fd, &sbuf) == -1)
+    goto fail;
+
+  m_bytes = static_cast<size_t>(sbuf.st_size);
+  m_size  = m_bytes / sampleSize;
+
+  if (m_bytes == 0) {
+    m_error = path + " holds no samples";
+    return false;
+  }
+
+  data = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (data == MAP_FAILED)
+    goto fail;
+
+  // Replays read each chunk of the file once, front to back
+  madvise(data, m_bytes, MADV_SEQUENTIAL);
+  m_data = static_cast<const char *>(data);
+
+  if (m_format == AUTO_SAVE_FORMAT_ZCI16 && !loadBlocks(path))
+    return false;
+
+  if (m_size == 0) {
+    m_error = path + " holds no samples";
+    return false;
+  }
+
+  // The index is optional, and useless if it does not match
+  if (m_index.load((path + RECORDING_INDEX_EXTENSION).toStdString())
+      && (m_index.sampleSize() != sampleSize || m_index.empty()))
+    m_index.clear();
+
+  return true;
+
+fail:
+  m_error = "Cannot map " + path + ": " + strerror(errno);
+  return false;
+}
+
+bool
+PhaseRecording::loadBlocks(QString const &path)
+{
+  SampleCodecHeader header;
+  uint64_t samples;
+
+  if (!SampleCodec::load(m_data, m_bytes, header, m_blocks, samples)) {
+    m_error = path + " is not a compressed phase recording";
+    return false;
+  }
+
+  m_size  = samples;
+  m_scale = static_cast<SUFLOAT>(header.fullScale / 32767);
+
+  return true;
+}
+
+bool
+PhaseRecording::open(QString const &path)
+{
+  QString dataPath = path;
+  bool ok;
+
+  close();
+
+  if (path.endsWith(SIGMF_META_EXTENSION))
+    dataPath = SigMFMetadata::dataPath(path);
+
+  if (dataPath.endsWith(SIGMF_DATA_EXTENSION))
+    ok = parseMetadata(SigMFMetadata::metaPath(dataPath));
+  else
+    ok = parseName(dataPath);
+
+  if (ok && m_sampRate <= 0) {
+    m_error = "Invalid sample rate";
+    ok = false;
+  }
+
+  if (ok)
+    ok = map(dataPath);
+
+  if (!ok) {
+    QString error = m_error;
+    close();
+    m_error = error;
+    return false;
+  }
+
+  m_path = dataPath;
+
+  return true;
+}
+
+void
+PhaseRecording::close()
+{
+  if (m_data != nullptr)
+    munmap(const_cast<char *>(m_data), m_bytes);
+
+  if (m_fd != -1)
+    ::close(m_fd);
+
+  m_fd        = -1;
+  m_data      = nullptr;
+  m_bytes     = 0;
+  m_size      = 0;
+  m_format    = AUTO_SAVE_FORMAT_NATIVE;
+  m_scale     = 1;
+  m_sampRate  = 0;
+  m_frequency = 0;
+  m_start.tv_sec  = 0;
+  m_start.tv_usec = 0;
+  m_index.clear();
+  m_blocks.clear();
+  m_path.clear();
+  m_error.clear();
+}
+
+bool
+PhaseRecording::isOpen() const
+{
+  return m_data != nullptr;
+}
+
+QString const &
+PhaseRecording::path() const
+{
+  return m_path;
+}
+
+QString const &
+PhaseRecording::errorString() const
+{
+  return m_error;
+}
+
+AutoSaveFormat
+PhaseRecording::format() const
+{
+  return m_format;
+}
+
+SUSCOUNT
+PhaseRecording::size() const
+{
+  return m_size;
+}
+
+qreal
+PhaseRecording::sampleRate() const
+{
+  return m_sampRate;
+}
+
+qreal
+PhaseRecording::frequency() const
+{
+  return m_frequency;
+}
+
+struct timeval
+PhaseRecording::start() const
+{
+  return m_start;
+}
+
+bool
+PhaseRecording::indexed() const
+{
+  return !m_index.empty();
+}
+
+struct timeval
+PhaseRecording::time(SUSCOUNT sample) const
+{
+  struct timeval tv;
+  int64_t time;
+
+  if (m_index.empty())
+    return sampleTime(m_start, sample, m_sampRate);
+
+  time = m_index.timeOfOffset(sample * AutoSaveWriter::sampleSize(m_format));
+  tv.tv_sec  = static_cast<time_t>(time / 1000000);
+  tv.tv_usec = static_cast<suseconds_t>(time % 1000000);
+
+  if (tv.tv_usec < 0) {
+    tv.tv_usec += 1000000;
+    --tv.tv_sec;
+  }
+
+  return tv;
+}
+
+SUSCOUNT
+PhaseRecording::sampleAt(struct timeval const &tv) const
+{
+  int64_t time = static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+  int64_t base = static_cast<int64_t>(m_start.tv_sec) * 1000000
+      + m_start.tv_usec;
+  size_t sampleSize = AutoSaveWriter::sampleSize(m_format);
+  qreal sample;
+
+  if (m_index.empty()) {
+    sample = (time - base) * 1e-6 * m_sampRate;
+  } else {
+    size_t index = m_index.findTime(time);
+    RecordingIndexEntry const &entry = m_index.at(index);
+    qreal run = static_cast<qreal>(m_index.runLength(index));
+
+    // Times in a gap map to the first sample after it
+    sample = qMin((time - entry.time) * 1e-6 * m_sampRate, run);
+    sample = entry.offset / sampleSize + qMax<qreal>(sample, 0);
+  }
+
+  return static_cast<SUSCOUNT>(
+        qBound<qreal>(0, std::round(sample), static_cast<qreal>(m_size)));
+}
+
+struct timeval
+PhaseRecording::sampleTime(
+    struct timeval const &base,
+    SUSCOUNT sample,
+    qreal sampRate)
+{
+  struct timeval delta, time;
+  SUSCOUNT rate = static_cast<SUSCOUNT>(sampRate);
+
+  // Whole seconds in integers, so long recordings do not lose precision
+  if (rate > 0 && static_cast<qreal>(rate) == sampRate) {
+    delta.tv_sec  = static_cast<time_t>(sample / rate);
+    delta.tv_usec = static_cast<suseconds_t>(
+          (sample % rate) * 1000000 / rate);
+  } else {
+    qreal seconds = sample / sampRate;
+
+    delta.tv_sec  = static_cast<time_t>(std::floor(seconds));
+    delta.tv_usec = static_cast<suseconds_t>(
+          std::floor((seconds - std::floor(seconds)) * 1e6));
+  }
+
+  timeradd(&base, &delta, &time);
+
+  return time;
+}
+
+void
+PhaseRecording::decompress(
+    SUSCOUNT index,
+    size_t count,
+    SUCOMPLEX *out) const
+{
+  std::vector<int16_t> samples(2 * SAMPLE_CODEC_BLOCK_SAMPLES);
+  auto block = std::upper_bound(
+        m_blocks.begin(),
+        m_blocks.end(),
+        index,
+        [] (SUSCOUNT index, SampleCodecIndexEntry const &entry) {
+          return index < entry.first;
+        }) - 1;
+
+  while (count > 0) {
+    SampleCodecBlock header;
+    size_t skip, chunk;
+
+    memcpy(&header, m_data + block->offset, sizeof(SampleCodecBlock));
+
+    // Blocks must be decoded from their start, but only up to what we need
+    skip  = static_cast<size_t>(index - block->first);
+    chunk = std::min<size_t>(count, header.samples - skip);
+
+    if (header.samples > samples.size() / 2)
+      samples.resize(2 * header.samples);
+
+    if (SampleCodec::decode(
+          samples.data(),
+          skip + chunk,
+          reinterpret_cast<const uint8_t *>(m_data + block->offset)
+            + sizeof(SampleCodecBlock),
+          header.bytes))
+      dequantizeInt16(out, samples.data() + 2 * skip, m_scale, chunk);
+    else
+      std::fill(out, out + chunk, SUCOMPLEX(0));
+
+    index += chunk;
+    out   += chunk;
+    count -= chunk;
+    ++block;
+  }
+}
+
+void
+PhaseRecording::read(SUSCOUNT index, size_t count, SUCOMPLEX *out) const
+{
+  const char *data = m_data + index * AutoSaveWriter::sampleSize(m_format);
+
+  switch (m_format) {
+    case AUTO_SAVE_FORMAT_CI16:
+      dequantizeInt16(
+            out,
+            reinterpret_cast<const int16_t *>(data),
+            m_scale,
+            count);
+      break;
+
+    case AUTO_SAVE_FORMAT_ZCI16:
+      decompress(index, count, out);
+      break;
+
+    case AUTO_SAVE_FORMAT_CF16:
+      dequantizeHalf(
+            out,
+            reinterpret_cast<const uint16_t *>(data),
+            m_scale,
+            count);
+      break;
+
+    default:
+      memcpy(out, data, count * sizeof(SUCOMPLEX));
+  }
+}
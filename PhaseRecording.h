@@ -0,0 +1,119 @@
+//
+//    PhaseRecording.h: Read-only view of a phase difference recording
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef PHASERECORDING_H
+#define PHASERECORDING_H
+
+#include <QString>
+#include <sigutils/types.h>
+#include <sys/time.h>
+#include "AutoSaveWriter.h"
+#include "RecordingIndex.h"
+#include "SampleCodec.h"
+#include <vector>
+
+#define PHASE_RECORDING_PREFIX               "phasediff_"
+#define PHASE_RECORDING_COMPRESSED_EXTENSION ".zraw"
+
+//
+// Maps an autosaved phase difference recording in memory, read-only, and
+// hands out its samples as SUCOMPLEX whatever format they were stored in.
+//
+// The sample format, rate, center frequency and start time come from the
+// .sigmf-meta companion of SigMF recordings (either the data or the meta
+// file can be opened), or from the name of headerless ones:
+//
+//   phasediff_YYYYmmdd_HHMMSS_<frequency>_<rate>sps_NNNN[_ci16|_cf16].raw
+//   phasediff_YYYYmmdd_HHMMSS_<frequency>_<rate>sps_NNNN.zraw
+//
+// Headerless ci16 and cf16 files do not record their full scale, so their
+// samples are returned normalized to it. The phase of the samples (which
+// is all the coherent detector looks at) is not affected.
+//
+// .zraw files are compressed ci16 recordings (see SampleCodec), which do
+// carry their full scale. Reads decode the blocks they touch on the fly,
+// starting from the block index.
+//
+// If the recording has a sidecar index (see RecordingIndex), times are
+// taken from it, so they account for dropped samples and clock jumps.
+// Otherwise, they are extrapolated from the start time.
+//
+// read() does not touch any state, so several threads can read different
+// parts of the same recording at once.
+//
+
+namespace SigDigger {
+  class PhaseRecording
+  {
+    int            m_fd        = -1;
+    const char    *m_data      = nullptr;
+    size_t         m_bytes     = 0;
+    SUSCOUNT       m_size      = 0;
+    AutoSaveFormat m_format    = AUTO_SAVE_FORMAT_NATIVE;
+    SUFLOAT        m_scale     = 1;
+    qreal          m_sampRate  = 0;
+    qreal          m_frequency = 0;
+    struct timeval m_start;
+    RecordingIndex m_index;
+    std::vector<SampleCodecIndexEntry> m_blocks;
+    QString        m_path;
+    QString        m_error;
+
+    bool parseName(QString const &);
+    bool parseMetadata(QString const &);
+    bool map(QString const &);
+    bool loadBlocks(QString const &);
+    void decompress(SUSCOUNT index, size_t count, SUCOMPLEX *out) const;
+
+  public:
+    PhaseRecording();
+    ~PhaseRecording();
+
+    PhaseRecording(PhaseRecording const &) = delete;
+    PhaseRecording &operator=(PhaseRecording const &) = delete;
+
+    // On failure, the recording is left closed and errorString() says why
+    bool     open(QString const &path);
+    void     close();
+    bool     isOpen() const;
+
+    QString const &path() const;
+    QString const &errorString() const;
+
+    AutoSaveFormat format() const;
+    SUSCOUNT size() const;
+    qreal    sampleRate() const;
+    qreal    frequency() const; // 0 if unknown
+    struct timeval start() const;
+    bool     indexed() const;
+
+    // Time of a sample of the file, and the sample closest to a time
+    struct timeval time(SUSCOUNT sample) const;
+    SUSCOUNT sampleAt(struct timeval const &) const;
+    static struct timeval sampleTime(
+        struct timeval const &base,
+        SUSCOUNT sample,
+        qreal sampRate);
+
+    // Copies `count` samples starting at `index`
+    void     read(SUSCOUNT index, size_t count, SUCOMPLEX *out) const;
+  };
+}
+
+#endif // PHASERECORDING_H
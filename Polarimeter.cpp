@@ -40,6 +40,7 @@ void
 PolarimeterConfig::deserialize(Suscan::Object const &conf)
 {
   LOAD(collapsed);
+  LOAD(compensateDelay);
 }
 
 Suscan::Object &&
@@ -50,6 +51,7 @@ PolarimeterConfig::serialize()
   obj.setClass("PolarimeterConfig");
 
   STORE(collapsed);
+  STORE(compensateDelay);
 
   return persist(obj);
 }
@@ -70,6 +72,8 @@ Polarimeter::Polarimeter(
   m_mediator  = mediator;
   m_spectrum  = mediator->getMainSpectrum();
 
+  m_forwarder->setDelayEstimation(true);
+
   setProperty("collapsed", m_panelConfig->collapsed);
 
   refreshUi();
@@ -108,6 +112,18 @@ Polarimeter::connectAll()
         this,
         SLOT(onAdjustBandwidth()));
 
+  connect(
+        ui->delayCompensationCheck,
+        SIGNAL(toggled(bool)),
+        this,
+        SLOT(onToggleDelayCompensation()));
+
+  connect(
+        m_forwarder,
+        SIGNAL(delayChanged(qreal)),
+        this,
+        SLOT(onDelayChanged(qreal)));
+
   connect(
         m_spectrum,
         SIGNAL(frequencyChanged(qint64)),
@@ -143,6 +159,12 @@ Polarimeter::connectAll()
         SIGNAL(stateChanged(int,int,QString)),
         this,
         SLOT(onComparatorStateChanged(int, int, QString)));
+
+  connect(
+        m_forwarder,
+        SIGNAL(dataShed(quint64, quint64)),
+        this,
+        SLOT(onDataShed(quint64, quint64)));
 }
 
 void
@@ -275,6 +297,11 @@ Polarimeter::applyConfig()
 {
   setProperty("collapsed", m_panelConfig->collapsed);
 
+  BLOCKSIG(
+        ui->delayCompensationCheck,
+        setChecked(m_panelConfig->compensateDelay));
+  m_forwarder->setDelayCompensation(m_panelConfig->compensateDelay);
+
   refreshUi();
 }
 
@@ -433,6 +460,20 @@ Polarimeter::onAdjustBandwidth()
   refreshNamedChannel();
 }
 
+void
+Polarimeter::onToggleDelayCompensation()
+{
+  m_panelConfig->compensateDelay = ui->delayCompensationCheck->isChecked();
+  m_forwarder->setDelayCompensation(m_panelConfig->compensateDelay);
+}
+
+void
+Polarimeter::onDelayChanged(qreal delay)
+{
+  ui->delayLabel->setText(
+        QString::asprintf("%+.3f samples", delay));
+}
+
 void
 Polarimeter::onSpectrumFrequencyChanged(qint64)
 {
@@ -475,12 +516,12 @@ Polarimeter::onComparatorError(QString error)
 void
 Polarimeter::onComparatorData()
 {
-  auto hiData = m_forwarder->hiData();
-  auto loData = m_forwarder->loData();
+  auto const &hiData = m_forwarder->hiData();
+  auto const &loData = m_forwarder->loData();
 
-  if (m_plotPage != nullptr && m_analyzer != nullptr) {
+  if (m_plotPage != nullptr) {
     m_plotPage->feed(
-          m_analyzer->getSourceTimeStamp(),
+          m_forwarder->dataTime(),
           hiData.data(),
           loData.data(),
           loData.size());
@@ -518,3 +559,11 @@ Polarimeter::onClosePlotPage()
 
   delete sender;
 }
+
+void
+Polarimeter::onDataShed(quint64 dropped, quint64 late)
+{
+  ui->stateLabel->setText(
+        QString::number(dropped) + " blocks dropped, " +
+        QString::number(late) + " late");
+}
@@ -40,6 +40,7 @@ namespace SigDigger {
   class PolarimeterConfig : public Suscan::Serializable {
   public:
     bool collapsed = false;
+    bool compensateDelay = false;
 
     // Overriden methods
     void deserialize(Suscan::Object const &conf) override;
@@ -100,6 +101,8 @@ namespace SigDigger {
     void onCloseChannel();
     void onAdjustFrequency();
     void onAdjustBandwidth();
+    void onToggleDelayCompensation();
+    void onDelayChanged(qreal);
 
     void onAdjustFrequencyRequested(qreal);
     void onAdjustBandwidthRequested(qreal);
@@ -109,6 +112,7 @@ namespace SigDigger {
     void onComparatorError(QString);
     void onComparatorData();
     void onComparatorStateChanged(int, int, QString);
+    void onDataShed(quint64, quint64);
 
     void onSpectrumFrequencyChanged(qint64);
     void onClosePlotPage();
@@ -0,0 +1,196 @@
+//
+//    PolyphaseChannelizer.cpp: Uniform polyphase filter bank
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "PolyphaseChannelizer.h"
+#include "SignalKernels.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace SigDigger;
+
+PolyphaseChannelizer::PolyphaseChannelizer(unsigned channels, unsigned taps)
+{
+  configure(channels, taps);
+}
+
+PolyphaseChannelizer::~PolyphaseChannelizer()
+{
+  release();
+}
+
+void
+PolyphaseChannelizer::release()
+{
+  if (m_plan != nullptr)
+    SU_FFTW(_destroy_plan)(m_plan);
+
+  if (m_fftBuf != nullptr)
+    SU_FFTW(_free)(m_fftBuf);
+
+  m_plan   = nullptr;
+  m_fftBuf = nullptr;
+}
+
+//
+// Arm r holds h[r + p * M], p = 0 ... taps - 1. With this ordering, the
+// output of arm r at frame m is the dot product of its taps against the
+// samples x[(m - p) * M - r], which is exactly what its delay line keeps.
+//
+void
+PolyphaseChannelizer::computeArms()
+{
+  size_t  length = static_cast<size_t>(m_channels) * m_taps;
+  SUFLOAT center = .5f * static_cast<SUFLOAT>(length - 1);
+  SUFLOAT sum = 0;
+  std::vector<SUFLOAT> h(length);
+
+  for (size_t n = 0; n < length; ++n) {
+    SUFLOAT t = (static_cast<SUFLOAT>(n) - center) / m_channels;
+    SUFLOAT x = static_cast<SUFLOAT>(n) / static_cast<SUFLOAT>(length - 1);
+    SUFLOAT sinc = std::fabs(t) < 1e-6f
+        ? 1.f
+        : static_cast<SUFLOAT>(std::sin(M_PI * t) / (M_PI * t));
+    SUFLOAT w = static_cast<SUFLOAT>(
+          .42 - .5 * std::cos(2 * M_PI * x) + .08 * std::cos(4 * M_PI * x));
+
+    h[n] = sinc * w;
+    sum += h[n];
+  }
+
+  // Unity gain at the center of each channel
+  for (auto &t : h)
+    t /= sum;
+
+  m_arms.resize(length);
+
+  for (unsigned r = 0; r < m_channels; ++r)
+    for (unsigned p = 0; p < m_taps; ++p)
+      m_arms[r * m_taps + p] = h[r + p * m_channels];
+}
+
+void
+PolyphaseChannelizer::configure(unsigned channels, unsigned taps)
+{
+  if (channels < 2)
+    channels = 2;
+
+  if (taps < 1)
+    taps = 1;
+
+  release();
+
+  m_channels = channels;
+  m_taps     = taps;
+
+  m_fftBuf = SU_FFTW(_alloc_complex)(channels);
+  m_plan   = SU_FFTW(_plan_dft_1d)(
+        static_cast<int>(channels),
+        m_fftBuf,
+        m_fftBuf,
+        FFTW_BACKWARD,
+        FFTW_ESTIMATE);
+
+  m_delay.resize(static_cast<size_t>(channels) * taps);
+  m_outputs.resize(channels);
+
+  computeArms();
+  reset();
+}
+
+unsigned
+PolyphaseChannelizer::channels() const
+{
+  return m_channels;
+}
+
+unsigned
+PolyphaseChannelizer::taps() const
+{
+  return m_taps;
+}
+
+unsigned
+PolyphaseChannelizer::phase() const
+{
+  return m_phase;
+}
+
+void
+PolyphaseChannelizer::reset()
+{
+  std::fill(m_delay.begin(), m_delay.end(), 0);
+
+  for (auto &out : m_outputs)
+    out.clear();
+
+  m_phase = 0;
+}
+
+void
+PolyphaseChannelizer::processFrame()
+{
+  SUCOMPLEX *buf = reinterpret_cast<SUCOMPLEX *>(m_fftBuf);
+
+  for (unsigned r = 0; r < m_channels; ++r)
+    buf[r] = realDotProduct(
+          m_delay.data() + r * m_taps,
+          m_arms.data() + r * m_taps,
+          m_taps);
+
+  // Backward transform: y_k = sum(v_r * exp(+j 2 pi k r / M))
+  SU_FFTW(_execute)(m_plan);
+
+  for (unsigned k = 0; k < m_channels; ++k)
+    m_outputs[k].push_back(buf[k]);
+}
+
+size_t
+PolyphaseChannelizer::feed(const SUCOMPLEX *data, size_t size)
+{
+  size_t frames = 0;
+
+  for (auto &out : m_outputs)
+    out.clear();
+
+  for (size_t i = 0; i < size; ++i) {
+    // Sample n goes to arm (-n) mod M
+    unsigned   arm  = m_phase == 0 ? 0 : m_channels - m_phase;
+    SUCOMPLEX *line = m_delay.data() + arm * m_taps;
+
+    std::copy_backward(line, line + m_taps - 1, line + m_taps);
+    line[0] = data[i];
+
+    // Arm 0 is the last one to be updated in each frame
+    if (arm == 0) {
+      processFrame();
+      ++frames;
+    }
+
+    if (++m_phase == m_channels)
+      m_phase = 0;
+  }
+
+  return frames;
+}
+
+const std::vector<SUCOMPLEX> &
+PolyphaseChannelizer::channel(unsigned k) const
+{
+  return m_outputs[k % m_channels];
+}
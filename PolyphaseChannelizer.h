@@ -0,0 +1,88 @@
+//
+//    PolyphaseChannelizer.h: Uniform polyphase filter bank
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef POLYPHASECHANNELIZER_H
+#define POLYPHASECHANNELIZER_H
+
+#include <sigutils/types.h>
+#include <fftw3.h>
+#include <vector>
+
+#define POLYPHASE_CHANNELIZER_DEFAULT_CHANNELS 64
+#define POLYPHASE_CHANNELIZER_DEFAULT_TAPS     8
+
+//
+// Critically sampled analysis filter bank. The input is split into M
+// uniformly spaced sub-channels, each one decimated by M. Channel k is
+// centered at k * fs / M (channels above M / 2 are the negative
+// frequencies), and all channels share the same time reference, so
+// samples with the same index in two different channels are simultaneous.
+//
+// The prototype filter is a Blackman-windowed sinc of M * taps
+// coefficients, split into M arms of `taps` coefficients each. Every M
+// input samples, each arm is run as a dot product against its own
+// delay line and the M arm outputs are combined by an M-point IFFT.
+//
+
+namespace SigDigger {
+  class PolyphaseChannelizer
+  {
+    unsigned               m_channels = 0;
+    unsigned               m_taps     = 0;
+    unsigned               m_phase    = 0; // Input sample index modulo M
+
+    std::vector<SUFLOAT>   m_arms;  // Arm-major, m_taps per arm
+    std::vector<SUCOMPLEX> m_delay; // Arm-major, newest sample first
+    std::vector<std::vector<SUCOMPLEX>> m_outputs;
+
+    SU_FFTW(_complex)     *m_fftBuf = nullptr;
+    SU_FFTW(_plan)         m_plan   = nullptr;
+
+    void computeArms();
+    void processFrame();
+    void release();
+
+  public:
+    PolyphaseChannelizer(
+        unsigned channels = POLYPHASE_CHANNELIZER_DEFAULT_CHANNELS,
+        unsigned taps = POLYPHASE_CHANNELIZER_DEFAULT_TAPS);
+    ~PolyphaseChannelizer();
+
+    PolyphaseChannelizer(PolyphaseChannelizer const &) = delete;
+    PolyphaseChannelizer &operator=(PolyphaseChannelizer const &) = delete;
+
+    void     configure(unsigned channels, unsigned taps);
+    unsigned channels() const;
+    unsigned taps() const;
+
+    // Input samples fed since the last frame, modulo M. The next frame is
+    // computed when the (M - phase()) % M-th next input sample arrives.
+    unsigned phase() const;
+
+    void     reset();
+
+    // Returns the number of samples produced in each channel
+    size_t   feed(const SUCOMPLEX *, size_t);
+
+    // Output of the last call to feed()
+    const std::vector<SUCOMPLEX> &channel(unsigned) const;
+  };
+}
+
+#endif // POLYPHASECHANNELIZER_H
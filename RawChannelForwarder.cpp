@@ -17,6 +17,7 @@
 //    <http://www.gnu.org/licenses/>
 //
 #include "RawChannelForwarder.h"
+#include "PhaseRecording.h"
 #include <UIMediator.h>
 #include <SuWidgetsHelpers.h>
 #include <Suscan/AnalyzerRequestTracker.h>
@@ -31,6 +32,9 @@ RawChannelForwarder::RawChannelForwarder(UIMediator *mediator, QObject *parent)
   m_mediator = mediator;
   m_tracker = new Suscan::AnalyzerRequestTracker(this);
 
+  m_notifyTimer = new QTimer(this);
+  m_notifyTimer->setSingleShot(true);
+
   this->connectAll();
 
   this->setState(RAW_CHANNEL_FORWARDER_IDLE, "Idle");
@@ -60,6 +64,12 @@ RawChannelForwarder::connectAll()
         SIGNAL(error(Suscan::AnalyzerRequest const &, const std::string &)),
         this,
         SLOT(onError(Suscan::AnalyzerRequest const &, const std::string &)));
+
+  connect(
+        this->m_notifyTimer,
+        SIGNAL(timeout()),
+        this,
+        SLOT(onDeliver()));
 }
 
 qreal
@@ -104,6 +114,140 @@ RawChannelForwarder::closeChannel()
   m_inspHandle = -1;
 }
 
+void
+RawChannelForwarder::recycle(RawChannelBlock &block)
+{
+  block.samples.clear();
+
+  if (m_spare.size() <= m_maxPending)
+    m_spare.push_back(std::move(block.samples));
+}
+
+void
+RawChannelForwarder::shed(RawChannelBlock &block)
+{
+  ++m_droppedBlocks;
+  m_droppedSamples += block.samples.size();
+
+  recycle(block);
+}
+
+void
+RawChannelForwarder::resetQueue()
+{
+  for (auto &block : m_pending)
+    recycle(block);
+
+  m_pending.clear();
+  m_notifyTimer->stop();
+
+  m_received        = 0;
+  m_lastIndex       = 0;
+  m_droppedBlocks   = 0;
+  m_droppedSamples  = 0;
+  m_lateBlocks      = 0;
+  m_reportedDropped = 0;
+  m_reportedLate    = 0;
+  m_haveEpoch       = false;
+
+  m_clock.start();
+}
+
+void
+RawChannelForwarder::enqueue(const SUCOMPLEX *samples, unsigned int count)
+{
+  RawChannelBlock block;
+
+  // The source time is roughly that of the end of the first message.
+  // Every other sample is timed by its index from there on.
+  if (!m_haveEpoch && m_analyzer != nullptr && m_equivSampleRate > 0) {
+    struct timeval now = m_analyzer->getSourceTimeStamp();
+    struct timeval zero = {0, 0};
+    struct timeval lead = PhaseRecording::sampleTime(
+          zero,
+          count,
+          m_equivSampleRate);
+
+    timersub(&now, &lead, &m_epoch);
+    m_haveEpoch = true;
+  }
+
+  block.index   = m_received;
+  block.arrival = m_clock.elapsed();
+
+  m_received += count;
+
+  if (m_pending.size() >= m_maxPending) {
+    switch (m_dropPolicy) {
+      case RAW_CHANNEL_FORWARDER_DROP_NEWEST:
+        ++m_droppedBlocks;
+        m_droppedSamples += count;
+        return;
+
+      case RAW_CHANNEL_FORWARDER_DROP_OLDEST:
+        shed(m_pending.front());
+        m_pending.pop_front();
+        break;
+
+      case RAW_CHANNEL_FORWARDER_DECIMATE: {
+        // Keep every other block, counting backwards from the newest one
+        std::deque<RawChannelBlock> kept;
+        size_t n = m_pending.size();
+
+        for (size_t i = 0; i < n; ++i) {
+          if ((n - 1 - i) % 2 == 1)
+            kept.push_back(std::move(m_pending[i]));
+          else
+            shed(m_pending[i]);
+        }
+
+        m_pending.swap(kept);
+        break;
+      }
+    }
+  }
+
+  if (!m_spare.empty()) {
+    block.samples = std::move(m_spare.back());
+    m_spare.pop_back();
+  }
+
+  block.samples.assign(samples, samples + count);
+  m_pending.push_back(std::move(block));
+}
+
+size_t
+RawChannelForwarder::pendingSamples() const
+{
+  size_t count = 0;
+
+  for (auto &block : m_pending)
+    count += block.samples.size();
+
+  return count;
+}
+
+void
+RawChannelForwarder::scheduleDelivery()
+{
+  bool now = true;
+
+  if (m_notifyRate > 0) {
+    // Flush early if the size threshold is hit or the queue is about
+    // to start shedding blocks
+    now = (m_notifySize > 0 && pendingSamples() >= m_notifySize)
+        || 2 * m_pending.size() >= m_maxPending;
+
+    if (!now && !m_notifyTimer->isActive())
+      m_notifyTimer->start(qMax(1, qRound(1e3 / m_notifyRate)));
+  }
+
+  if (now && !m_deliveryPending) {
+    m_deliveryPending = true;
+    QMetaObject::invokeMethod(this, "onDeliver", Qt::QueuedConnection);
+  }
+}
+
 void
 RawChannelForwarder::setFFTSizeHint(unsigned int fftSize)
 {
@@ -130,6 +274,7 @@ RawChannelForwarder::setState(RawChannelForwarderState state, QString const &msg
         m_fullSampleRate = 0;
         m_decimation = 0;
         m_chanRBW = 0;
+        resetQueue();
         break;
 
       case RAW_CHANNEL_FORWARDER_CONFIGURING:
@@ -284,6 +429,7 @@ RawChannelForwarder::open(SUFREQ f_off, SUFLOAT bw)
 
   this->setFrequency(f_off);
   this->setBandwidth(SCAST(qreal, bw));
+  this->resetQueue();
 
   return openChannel();
 }
@@ -333,10 +479,8 @@ RawChannelForwarder::onInspectorSamples(Suscan::SamplesMessage const &msg)
     unsigned int count = msg.getCount();
 
     if (m_state == RAW_CHANNEL_FORWARDER_RUNNING) {
-      m_lastBuffer.resize(count);
-      m_lastBuffer.assign(samples, samples + count);
-
-      emit dataAvailable();
+      enqueue(samples, count);
+      scheduleDelivery();
     }
   }
 }
@@ -347,6 +491,90 @@ RawChannelForwarder::data() const
   return m_lastBuffer;
 }
 
+quint64
+RawChannelForwarder::dataIndex() const
+{
+  return m_lastIndex;
+}
+
+struct timeval
+RawChannelForwarder::sampleTime(quint64 index) const
+{
+  return PhaseRecording::sampleTime(m_epoch, index, m_equivSampleRate);
+}
+
+void
+RawChannelForwarder::setDropPolicy(RawChannelForwarderDropPolicy policy)
+{
+  m_dropPolicy = policy;
+}
+
+RawChannelForwarderDropPolicy
+RawChannelForwarder::dropPolicy() const
+{
+  return m_dropPolicy;
+}
+
+void
+RawChannelForwarder::setMaxPendingBlocks(unsigned blocks)
+{
+  m_maxPending = blocks < 1 ? 1 : blocks;
+}
+
+unsigned
+RawChannelForwarder::maxPendingBlocks() const
+{
+  return m_maxPending;
+}
+
+void
+RawChannelForwarder::setLatenessThreshold(qint64 ms)
+{
+  m_latenessMs = ms;
+}
+
+void
+RawChannelForwarder::setNotifyRate(qreal rate)
+{
+  m_notifyRate = rate < 0 ? 0 : rate;
+}
+
+qreal
+RawChannelForwarder::notifyRate() const
+{
+  return m_notifyRate;
+}
+
+void
+RawChannelForwarder::setNotifySize(size_t size)
+{
+  m_notifySize = size;
+}
+
+size_t
+RawChannelForwarder::notifySize() const
+{
+  return m_notifySize;
+}
+
+quint64
+RawChannelForwarder::droppedBlocks() const
+{
+  return m_droppedBlocks;
+}
+
+quint64
+RawChannelForwarder::droppedSamples() const
+{
+  return m_droppedSamples;
+}
+
+quint64
+RawChannelForwarder::lateBlocks() const
+{
+  return m_lateBlocks;
+}
+
 ////////////////////////////// RawChannelor slots ////////////////////////////////
 void
 RawChannelForwarder::onOpened(Suscan::AnalyzerRequest const &req)
@@ -387,3 +615,80 @@ RawChannelForwarder::onError(Suscan::AnalyzerRequest const &, std::string const
         RAW_CHANNEL_FORWARDER_IDLE,
         "Failed to open inspector: " + QString::fromStdString(err));
 }
+
+void
+RawChannelForwarder::deliverSingle()
+{
+  RawChannelBlock &block = m_pending.front();
+
+  if (m_clock.elapsed() - block.arrival > m_latenessMs)
+    ++m_lateBlocks;
+
+  m_lastBuffer.swap(block.samples);
+  m_lastIndex = block.index;
+  recycle(block);
+  m_pending.pop_front();
+}
+
+//
+// Concatenates all pending blocks up to the first gap left by a shed
+// block. Whatever comes after the gap is delivered in the next call.
+//
+void
+RawChannelForwarder::deliverCoalesced()
+{
+  quint64 next = m_pending.front().index;
+  qint64  now  = m_clock.elapsed();
+
+  m_lastBuffer.clear();
+  m_lastIndex = next;
+
+  while (!m_pending.empty() && m_pending.front().index == next) {
+    RawChannelBlock &block = m_pending.front();
+
+    if (now - block.arrival > m_latenessMs)
+      ++m_lateBlocks;
+
+    m_lastBuffer.insert(
+          m_lastBuffer.end(),
+          block.samples.begin(),
+          block.samples.end());
+    next += block.samples.size();
+
+    recycle(block);
+    m_pending.pop_front();
+  }
+}
+
+//
+// Without coalescing, one block is delivered per call: if several
+// forwarders are active, their deliveries interleave in the event loop
+// the same way their samples messages did.
+//
+void
+RawChannelForwarder::onDeliver()
+{
+  m_deliveryPending = false;
+  m_notifyTimer->stop();
+
+  if (m_pending.empty() || m_state != RAW_CHANNEL_FORWARDER_RUNNING)
+    return;
+
+  if (m_notifyRate > 0)
+    deliverCoalesced();
+  else
+    deliverSingle();
+
+  if (!m_pending.empty()) {
+    m_deliveryPending = true;
+    QMetaObject::invokeMethod(this, "onDeliver", Qt::QueuedConnection);
+  }
+
+  if (m_droppedBlocks != m_reportedDropped || m_lateBlocks != m_reportedLate) {
+    m_reportedDropped = m_droppedBlocks;
+    m_reportedLate    = m_lateBlocks;
+    emit blocksShed(m_droppedBlocks, m_lateBlocks);
+  }
+
+  emit dataAvailable();
+}
@@ -20,6 +20,10 @@
 #define RAW_CHANNEL_FORWARDER_H
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <deque>
+#include <sys/time.h>
 #include <Suscan/Library.h>
 #include <Suscan/Analyzer.h>
 
@@ -29,6 +33,10 @@ namespace Suscan {
   struct AnalyzerRequest;
 };
 
+#define RAW_CHANNEL_FORWARDER_DEFAULT_MAX_PENDING  64
+#define RAW_CHANNEL_FORWARDER_DEFAULT_LATENESS_MS 500
+#define RAW_CHANNEL_FORWARDER_DEFAULT_NOTIFY_RATE 50
+
 namespace SigDigger {
   class UIMediator;
 
@@ -39,6 +47,26 @@ namespace SigDigger {
     RAW_CHANNEL_FORWARDER_RUNNING,      // set_params ack, starting sample delivery (hold)
   };
 
+  //
+  // What to do with an incoming block when the number of blocks pending
+  // delivery has reached the budget:
+  //
+  //   DROP_OLDEST: discard the oldest pending block (lowest latency)
+  //   DROP_NEWEST: discard the incoming block (longest gapless runs)
+  //   DECIMATE:    discard every other pending block (keeps the time span)
+  //
+  enum RawChannelForwarderDropPolicy {
+    RAW_CHANNEL_FORWARDER_DROP_OLDEST,
+    RAW_CHANNEL_FORWARDER_DROP_NEWEST,
+    RAW_CHANNEL_FORWARDER_DECIMATE
+  };
+
+  struct RawChannelBlock {
+    std::vector<SUCOMPLEX> samples;
+    quint64                index;   // Absolute index of the first sample
+    qint64                 arrival; // Milliseconds since the channel opened
+  };
+
   class RawChannelForwarder : public QObject
   {
     Q_OBJECT
@@ -65,6 +93,46 @@ namespace SigDigger {
     // These are only set during streaming
     qreal               m_trueBandwidth;
     std::vector<SUCOMPLEX> m_lastBuffer;
+    quint64             m_lastIndex = 0;
+
+    // Delivery queue. Samples messages are only copied here; consumers
+    // are notified from a separate (queued) delivery step, so that a slow
+    // consumer makes blocks pile up in a bounded queue instead of in the
+    // event loop.
+    //
+    // If a notification rate is set, deliveries are coalesced: consumers
+    // are notified at most m_notifyRate times per second (or as soon as
+    // m_notifySize samples are pending) and data() holds every contiguous
+    // sample received since the previous notification.
+    std::deque<RawChannelBlock>         m_pending;
+    std::vector<std::vector<SUCOMPLEX>> m_spare;
+    RawChannelForwarderDropPolicy m_dropPolicy = RAW_CHANNEL_FORWARDER_DROP_OLDEST;
+    unsigned            m_maxPending  = RAW_CHANNEL_FORWARDER_DEFAULT_MAX_PENDING;
+    qint64              m_latenessMs  = RAW_CHANNEL_FORWARDER_DEFAULT_LATENESS_MS;
+    bool                m_deliveryPending = false;
+    qreal               m_notifyRate = RAW_CHANNEL_FORWARDER_DEFAULT_NOTIFY_RATE;
+    size_t              m_notifySize = 0;
+    QTimer             *m_notifyTimer = nullptr;
+    QElapsedTimer       m_clock;
+    quint64             m_received       = 0;
+    quint64             m_droppedBlocks  = 0;
+    quint64             m_droppedSamples = 0;
+    quint64             m_lateBlocks     = 0;
+    quint64             m_reportedDropped = 0;
+    quint64             m_reportedLate    = 0;
+
+    // Source time of sample 0, taken when the first samples arrive
+    struct timeval      m_epoch     = {0, 0};
+    bool                m_haveEpoch = false;
+
+    void resetQueue();
+    void recycle(RawChannelBlock &);
+    void shed(RawChannelBlock &);
+    void enqueue(const SUCOMPLEX *, unsigned int);
+    size_t pendingSamples() const;
+    void scheduleDelivery();
+    void deliverSingle();
+    void deliverCoalesced();
 
     qreal adjustBandwidth(qreal desired) const;
     void disconnectAnalyzer();
@@ -99,6 +167,27 @@ namespace SigDigger {
     unsigned getDecimation() const;
 
     const std::vector<SUCOMPLEX> &data() const;
+    quint64 dataIndex() const;
+
+    // Source time of the sample with the given absolute index (as in
+    // dataIndex()), no matter when it was delivered
+    struct timeval sampleTime(quint64 index) const;
+
+    void  setDropPolicy(RawChannelForwarderDropPolicy);
+    RawChannelForwarderDropPolicy dropPolicy() const;
+    void  setMaxPendingBlocks(unsigned);
+    unsigned maxPendingBlocks() const;
+    void  setLatenessThreshold(qint64 ms);
+
+    // Zero rate disables coalescing (one notification per message)
+    void  setNotifyRate(qreal);
+    qreal notifyRate() const;
+    void  setNotifySize(size_t);
+    size_t notifySize() const;
+
+    quint64 droppedBlocks() const;
+    quint64 droppedSamples() const;
+    quint64 lateBlocks() const;
 
   public slots:
     void onInspectorMessage(Suscan::InspectorMessage const &);
@@ -106,10 +195,12 @@ namespace SigDigger {
     void onOpened(Suscan::AnalyzerRequest const &);
     void onCancelled(Suscan::AnalyzerRequest const &);
     void onError(Suscan::AnalyzerRequest const &, std::string const &);
+    void onDeliver();
 
   signals:
     void stateChanged(int, QString const &);
     void dataAvailable();
+    void blocksShed(quint64 dropped, quint64 late);
   };
 }
 
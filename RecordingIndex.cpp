@@ -0,0 +1,387 @@
+//
+//    RecordingIndex.cpp: Sidecar time and offset index of a recording
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "RecordingIndex.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RECORDING_INDEX_MAGIC   "ANTSDRIX"
+#define RECORDING_INDEX_VERSION 1
+
+using namespace SigDigger;
+
+namespace {
+  struct IndexHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t sampleSize;
+    double   sampleRate;
+    uint64_t reserved;
+  };
+
+  int64_t
+  entryTime(RecordingIndexEntry const &entry)
+  {
+    return entry.time;
+  }
+
+  uint64_t
+  entrySample(RecordingIndexEntry const &entry)
+  {
+    return entry.sample;
+  }
+
+  uint64_t
+  entryOffset(RecordingIndexEntry const &entry)
+  {
+    return entry.offset;
+  }
+
+  bool
+  writeAll(int fd, const void *data, size_t size)
+  {
+    const char *p = static_cast<const char *>(data);
+
+    while (size > 0) {
+      ssize_t got = ::write(fd, p, size);
+
+      if (got < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+
+      p    += got;
+      size -= static_cast<size_t>(got);
+    }
+
+    return true;
+  }
+}
+
+RecordingIndex::RecordingIndex()
+{
+}
+
+RecordingIndex::~RecordingIndex()
+{
+  close();
+}
+
+bool
+RecordingIndex::create(
+    std::string const &path,
+    double sampRate,
+    size_t sampleSize)
+{
+  IndexHeader header;
+  int error;
+
+  close();
+  clear();
+
+  if ((m_fd = ::open(
+         path.c_str(),
+         O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+         0644)) == -1)
+    return false;
+
+  memset(&header, 0, sizeof(IndexHeader));
+  memcpy(header.magic, RECORDING_INDEX_MAGIC, sizeof(header.magic));
+  header.version    = RECORDING_INDEX_VERSION;
+  header.sampleSize = static_cast<uint32_t>(sampleSize);
+  header.sampleRate = sampRate;
+
+  if (!writeAll(m_fd, &header, sizeof(IndexHeader))) {
+    error = errno;
+    close();
+    errno = error;
+    return false;
+  }
+
+  m_sampRate   = sampRate;
+  m_sampleSize = header.sampleSize;
+  m_interval   = std::max<uint64_t>(
+        1,
+        static_cast<uint64_t>(RECORDING_INDEX_INTERVAL * sampRate));
+
+  return true;
+}
+
+bool
+RecordingIndex::isOpen() const
+{
+  return m_fd != -1;
+}
+
+void
+RecordingIndex::close()
+{
+  if (m_fd != -1)
+    ::close(m_fd);
+
+  m_fd = -1;
+}
+
+bool
+RecordingIndex::update(uint64_t sample, uint64_t offset, int64_t time)
+{
+  RecordingIndexEntry entry;
+
+  if (m_fd == -1) {
+    errno = EBADF;
+    return false;
+  }
+
+  if (!m_entries.empty()) {
+    RecordingIndexEntry const &last = m_entries.back();
+    uint64_t elapsed = sample - last.sample;
+    int64_t expected = last.time + static_cast<int64_t>(
+          std::llround(static_cast<double>(elapsed) * 1e6 / m_sampRate));
+
+    if (elapsed < m_interval
+        && offset == last.offset + elapsed * m_sampleSize
+        && std::llabs(time - expected) <= RECORDING_INDEX_TIME_TOLERANCE)
+      return true;
+  }
+
+  entry.time   = time;
+  entry.sample = sample;
+  entry.offset = offset;
+
+  m_entries.push_back(entry);
+
+  return writeAll(m_fd, &entry, sizeof(RecordingIndexEntry));
+}
+
+bool
+RecordingIndex::load(std::string const &path)
+{
+  IndexHeader header;
+  struct stat sbuf;
+  size_t count;
+  int fd, error;
+  bool ok = false;
+
+  close();
+  clear();
+
+  if ((fd = ::open(path.c_str(), O_RDONLY)) == -1)
+    return false;
+
+  if (fstat(fd, &sbuf) == -1
+      || ::read(fd, &header, sizeof(IndexHeader))
+      != static_cast<ssize_t>(sizeof(IndexHeader)))
+    goto done;
+
+  if (memcmp(header.magic, RECORDING_INDEX_MAGIC, sizeof(header.magic)) != 0
+      || header.version != RECORDING_INDEX_VERSION
+      || header.sampleSize == 0
+      || !(header.sampleRate > 0)) {
+    errno = EINVAL;
+    goto done;
+  }
+
+  // An entry cut short by a crash is simply ignored
+  count = (static_cast<size_t>(sbuf.st_size) - sizeof(IndexHeader))
+      / sizeof(RecordingIndexEntry);
+  m_entries.resize(count);
+
+  if (count > 0
+      && ::read(fd, m_entries.data(), count * sizeof(RecordingIndexEntry))
+      != static_cast<ssize_t>(count * sizeof(RecordingIndexEntry))) {
+    m_entries.clear();
+    goto done;
+  }
+
+  m_sampRate   = header.sampleRate;
+  m_sampleSize = header.sampleSize;
+  m_interval   = std::max<uint64_t>(
+        1,
+        static_cast<uint64_t>(RECORDING_INDEX_INTERVAL * m_sampRate));
+  ok = true;
+
+done:
+  error = errno;
+  ::close(fd);
+  errno = error;
+
+  return ok;
+}
+
+void
+RecordingIndex::clear()
+{
+  m_entries.clear();
+  m_sampRate   = 0;
+  m_sampleSize = 0;
+  m_interval   = 0;
+}
+
+double
+RecordingIndex::sampleRate() const
+{
+  return m_sampRate;
+}
+
+size_t
+RecordingIndex::sampleSize() const
+{
+  return m_sampleSize;
+}
+
+size_t
+RecordingIndex::size() const
+{
+  return m_entries.size();
+}
+
+bool
+RecordingIndex::empty() const
+{
+  return m_entries.empty();
+}
+
+RecordingIndexEntry const &
+RecordingIndex::at(size_t index) const
+{
+  return m_entries[index];
+}
+
+//
+// Entries are spread almost evenly along every key, so interpolating
+// between the first and the last one lands on (or right next to) the
+// right entry. Clustered entries (many gaps in a row) make the walk
+// long: give up after a few steps and bisect instead.
+//
+template <typename Key>
+size_t
+RecordingIndex::search(Key key, Key (*get)(RecordingIndexEntry const &)) const
+{
+  size_t n = m_entries.size();
+  Key first, last;
+  size_t i;
+  unsigned steps = 0;
+
+  if (n == 0)
+    return 0;
+
+  first = get(m_entries.front());
+  last  = get(m_entries.back());
+
+  if (key <= first)
+    return 0;
+
+  if (key >= last)
+    return n - 1;
+
+  i = static_cast<size_t>(
+        static_cast<double>(key - first) / static_cast<double>(last - first)
+        * static_cast<double>(n - 1));
+  i = std::min(i, n - 1);
+
+  while (steps++ < RECORDING_INDEX_MAX_WALK) {
+    if (get(m_entries[i]) > key)
+      --i;
+    else if (i + 1 < n && get(m_entries[i + 1]) <= key)
+      ++i;
+    else
+      return i;
+  }
+
+  return static_cast<size_t>(
+        std::upper_bound(
+          m_entries.begin(),
+          m_entries.end(),
+          key,
+          [get] (Key k, RecordingIndexEntry const &entry) {
+            return k < get(entry);
+          }) - m_entries.begin()) - 1;
+}
+
+size_t
+RecordingIndex::findSample(uint64_t sample) const
+{
+  return search(sample, entrySample);
+}
+
+size_t
+RecordingIndex::findOffset(uint64_t offset) const
+{
+  return search(offset, entryOffset);
+}
+
+size_t
+RecordingIndex::findTime(int64_t time) const
+{
+  return search(time, entryTime);
+}
+
+uint64_t
+RecordingIndex::runLength(size_t index) const
+{
+  if (index + 1 >= m_entries.size())
+    return std::numeric_limits<uint64_t>::max();
+
+  return (m_entries[index + 1].offset - m_entries[index].offset)
+      / m_sampleSize;
+}
+
+bool
+RecordingIndex::offsetOf(uint64_t sample, uint64_t &offset) const
+{
+  size_t index;
+
+  if (m_entries.empty())
+    return false;
+
+  index = findSample(sample);
+  RecordingIndexEntry const &entry = m_entries[index];
+
+  if (sample < entry.sample || sample - entry.sample >= runLength(index))
+    return false;
+
+  offset = entry.offset + (sample - entry.sample) * m_sampleSize;
+
+  return true;
+}
+
+int64_t
+RecordingIndex::timeOfOffset(uint64_t offset) const
+{
+  double samples;
+
+  if (m_entries.empty())
+    return 0;
+
+  RecordingIndexEntry const &entry = m_entries[findOffset(offset)];
+
+  // Negative before the first entry
+  samples = (static_cast<double>(offset) - static_cast<double>(entry.offset))
+      / m_sampleSize;
+
+  return entry.time
+      + static_cast<int64_t>(std::llround(samples * 1e6 / m_sampRate));
+}
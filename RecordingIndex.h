@@ -0,0 +1,131 @@
+//
+//    RecordingIndex.h: Sidecar time and offset index of a recording
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef RECORDINGINDEX_H
+#define RECORDINGINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define RECORDING_INDEX_EXTENSION      ".idx"
+#define RECORDING_INDEX_INTERVAL       1.     // s between checkpoints
+#define RECORDING_INDEX_TIME_TOLERANCE 10000  // us
+#define RECORDING_INDEX_MAX_WALK       16
+
+//
+// Sidecar index of a recording, written next to it as it grows. Each
+// entry starts a run of samples that are contiguous both in the stream
+// and in the file:
+//
+// - the stream index of its first sample (counting the samples that
+//   never made it to the file),
+// - the byte offset of that sample in the file, and
+// - its time stamp.
+//
+// A new entry is added at least every RECORDING_INDEX_INTERVAL seconds
+// of samples, and whenever the recording is not contiguous anymore:
+// samples dropped by the writer (the offset falls behind) or a jump in
+// the capture clock larger than RECORDING_INDEX_TIME_TOLERANCE. Samples
+// between the end of a run (where the next one starts in the file) and
+// the next entry are a gap.
+//
+// Lookups guess the entry by interpolation and walk from there, which
+// takes constant time unless gaps cluster (then it falls back to a
+// binary search). Time lookups assume the clock never goes back.
+//
+// The file is a header followed by the entries, appended one at a time
+// with no further bookkeeping, so it stays valid if the program dies:
+//
+//   char     magic[8]    "ANTSDRIX"
+//   uint32_t version     1
+//   uint32_t sampleSize  Bytes per sample in the recording
+//   double   sampleRate
+//   uint64_t reserved    0
+//   Entries:
+//     int64_t  time      us since the epoch (UTC)
+//     uint64_t sample
+//     uint64_t offset
+//
+// All fields are little endian.
+//
+
+namespace SigDigger {
+  struct RecordingIndexEntry {
+    int64_t  time   = 0;
+    uint64_t sample = 0;
+    uint64_t offset = 0;
+  };
+
+  class RecordingIndex
+  {
+    int      m_fd         = -1;
+    double   m_sampRate   = 0;
+    uint32_t m_sampleSize = 0;
+    uint64_t m_interval   = 0;
+    std::vector<RecordingIndexEntry> m_entries;
+
+    template <typename Key>
+    size_t   search(Key key, Key (*get)(RecordingIndexEntry const &)) const;
+
+  public:
+    RecordingIndex();
+    ~RecordingIndex();
+
+    RecordingIndex(RecordingIndex const &) = delete;
+    RecordingIndex &operator=(RecordingIndex const &) = delete;
+
+    // Writing. On failure, errno tells why
+    bool     create(
+        std::string const &path,
+        double sampRate,
+        size_t sampleSize);
+    bool     isOpen() const;
+    void     close();
+
+    // Called before every write to the recording, with the stream index,
+    // file offset and time of its first sample. Adds an entry if needed
+    bool     update(uint64_t sample, uint64_t offset, int64_t time);
+
+    // Reading
+    bool     load(std::string const &path);
+    void     clear();
+
+    double   sampleRate() const;
+    size_t   sampleSize() const;
+    size_t   size() const;
+    bool     empty() const;
+    RecordingIndexEntry const &at(size_t) const;
+
+    // Last entry at or before the given key (0 if there is none)
+    size_t   findSample(uint64_t sample) const;
+    size_t   findOffset(uint64_t offset) const;
+    size_t   findTime(int64_t time) const;
+
+    // Samples of the run of an entry (unbounded for the last one)
+    uint64_t runLength(size_t) const;
+
+    // False if the sample falls in a gap
+    bool     offsetOf(uint64_t sample, uint64_t &offset) const;
+    int64_t  timeOfOffset(uint64_t offset) const;
+  };
+}
+
+#endif // RECORDINGINDEX_H
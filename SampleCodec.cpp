@@ -0,0 +1,410 @@
+//
+//    SampleCodec.cpp: Lossless coding of quantized phase recordings
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "SampleCodec.h"
+#include <algorithm>
+#include <cstring>
+
+#define SAMPLE_CODEC_MAGIC         "ANTSDRZ1"
+#define SAMPLE_CODEC_INDEX_MAGIC   "ANTSDRZX"
+#define SAMPLE_CODEC_BLOCK_MAGIC   0x4b4c425a // "ZBLK"
+#define SAMPLE_CODEC_VERSION       1
+#define SAMPLE_CODEC_MAX_PARAMETER 16
+#define SAMPLE_CODEC_VERBATIM_BITS 17         // zigzag of a 16-bit delta
+
+using namespace SigDigger;
+
+namespace {
+  // Bits are packed LSB first, 32 at a time
+  class BitWriter
+  {
+    uint8_t *m_out;
+    size_t   m_pos  = 0;
+    uint64_t m_acc  = 0;
+    unsigned m_bits = 0;
+
+  public:
+    explicit BitWriter(uint8_t *out) : m_out(out) {}
+
+    // Up to 32 bits at a time
+    inline void
+    put(uint64_t value, unsigned bits)
+    {
+      m_acc  |= value << m_bits;
+      m_bits += bits;
+
+      if (m_bits >= 32) {
+        uint32_t word = static_cast<uint32_t>(m_acc);
+
+        memcpy(m_out + m_pos, &word, sizeof(uint32_t));
+        m_pos  += sizeof(uint32_t);
+        m_acc >>= 32;
+        m_bits -= 32;
+      }
+    }
+
+    size_t
+    flush()
+    {
+      while (m_bits > 0) {
+        m_out[m_pos++] = static_cast<uint8_t>(m_acc);
+        m_acc >>= 8;
+        m_bits = m_bits > 8 ? m_bits - 8 : 0;
+      }
+
+      return m_pos;
+    }
+  };
+
+  // Reads past the end of the data return zeros. overrun() tells whether
+  // that happened.
+  class BitReader
+  {
+    const uint8_t *m_in;
+    size_t         m_size;
+    size_t         m_pos  = 0;
+    uint64_t       m_acc  = 0;
+    unsigned       m_bits = 0;
+
+  public:
+    BitReader(const uint8_t *in, size_t size) : m_in(in), m_size(size) {}
+
+    // Leaves at least 56 bits in the accumulator
+    inline void
+    refill()
+    {
+      if (m_pos + sizeof(uint64_t) <= m_size) {
+        uint64_t word;
+
+        memcpy(&word, m_in + m_pos, sizeof(uint64_t));
+        m_acc  |= word << m_bits;
+        m_pos  += (63 - m_bits) >> 3;
+        m_bits |= 56;
+      } else {
+        while (m_bits <= 56) {
+          uint64_t byte = m_pos < m_size ? m_in[m_pos] : 0;
+
+          m_acc  |= byte << m_bits;
+          m_bits += 8;
+          ++m_pos;
+        }
+      }
+    }
+
+    inline uint64_t
+    peek() const
+    {
+      return m_acc;
+    }
+
+    inline void
+    skip(unsigned bits)
+    {
+      m_acc >>= bits;
+      m_bits -= bits;
+    }
+
+    inline uint32_t
+    get(unsigned bits)
+    {
+      uint32_t value = static_cast<uint32_t>(
+            m_acc & ((static_cast<uint64_t>(1) << bits) - 1));
+
+      skip(bits);
+
+      return value;
+    }
+
+    bool
+    overrun() const
+    {
+      return m_pos * 8 - m_bits > m_size * 8;
+    }
+  };
+
+  inline uint32_t
+  zigzag(int32_t value)
+  {
+    return (static_cast<uint32_t>(value) << 1)
+        ^ static_cast<uint32_t>(value >> 31);
+  }
+
+  inline int32_t
+  unzigzag(uint32_t value)
+  {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+  }
+
+  bool
+  validBlock(
+      const char *data,
+      uint64_t end,
+      uint64_t offset,
+      SampleCodecHeader const &header,
+      uint64_t first,
+      SampleCodecBlock &block)
+  {
+    if (offset + sizeof(SampleCodecBlock) > end)
+      return false;
+
+    memcpy(&block, data + offset, sizeof(SampleCodecBlock));
+
+    return block.magic == SAMPLE_CODEC_BLOCK_MAGIC
+        && block.samples > 0
+        && block.samples <= header.blockSamples
+        && block.first == first
+        && offset + sizeof(SampleCodecBlock) + block.bytes <= end;
+  }
+}
+
+size_t
+SampleCodec::bound(size_t samples)
+{
+  size_t values = 2 * samples;
+  size_t groups = (values + SAMPLE_CODEC_GROUP - 1) / SAMPLE_CODEC_GROUP;
+
+  // Plus the word the writer may store in one go
+  return (values * (SAMPLE_CODEC_ESCAPE + SAMPLE_CODEC_VERBATIM_BITS)
+          + groups * 6 + 7) / 8 + sizeof(uint32_t);
+}
+
+size_t
+SampleCodec::encode(uint8_t *out, const int16_t *in, size_t samples)
+{
+  BitWriter writer(out);
+  uint32_t residuals[SAMPLE_CODEC_GROUP];
+  uint32_t deltas[SAMPLE_CODEC_GROUP];
+  int32_t prev[2] = {0, 0};
+  size_t values = 2 * samples;
+
+  for (size_t g = 0; g < values; g += SAMPLE_CODEC_GROUP) {
+    size_t count = std::min<size_t>(SAMPLE_CODEC_GROUP, values - g);
+    uint64_t sum = 0, deltaSum = 0;
+    unsigned delta, k = 0;
+
+    // Groups start at even values, so i & 1 tells I from Q
+    for (size_t i = 0; i < count; ++i) {
+      int32_t value = in[g + i];
+
+      residuals[i] = zigzag(value);
+      deltas[i]    = zigzag(value - prev[i & 1]);
+      prev[i & 1]  = value;
+      sum      += residuals[i];
+      deltaSum += deltas[i];
+    }
+
+    // White noise is cheaper to store as is
+    delta = deltaSum < sum;
+    if (delta) {
+      memcpy(residuals, deltas, count * sizeof(uint32_t));
+      sum = deltaSum;
+    }
+
+    // Roughly log2 of the mean residual
+    while (k < SAMPLE_CODEC_MAX_PARAMETER && (count << (k + 1)) <= sum)
+      ++k;
+
+    writer.put(k | (delta << 5), 6);
+
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t q = residuals[i] >> k;
+
+      if (q < SAMPLE_CODEC_ESCAPE) {
+        // q ones and a zero, then the remainder
+        writer.put((static_cast<uint64_t>(1) << q) - 1, q + 1);
+        writer.put(residuals[i] & ((1u << k) - 1), k);
+      } else {
+        writer.put(
+              (static_cast<uint64_t>(1) << SAMPLE_CODEC_ESCAPE) - 1,
+              SAMPLE_CODEC_ESCAPE);
+        writer.put(residuals[i], SAMPLE_CODEC_VERBATIM_BITS);
+      }
+    }
+  }
+
+  return writer.flush();
+}
+
+bool
+SampleCodec::decode(
+    int16_t *out,
+    size_t samples,
+    const uint8_t *in,
+    size_t bytes)
+{
+  BitReader reader(in, bytes);
+  int32_t prev[2] = {0, 0};
+  size_t values = 2 * samples;
+
+  for (size_t g = 0; g < values; g += SAMPLE_CODEC_GROUP) {
+    size_t count = std::min<size_t>(SAMPLE_CODEC_GROUP, values - g);
+    unsigned k, delta;
+
+    reader.refill();
+    k     = reader.get(5);
+    delta = reader.get(1);
+
+    if (k > SAMPLE_CODEC_MAX_PARAMETER)
+      return false;
+
+    for (size_t i = 0; i < count; ++i) {
+      uint64_t ones;
+      unsigned q;
+      uint32_t residual;
+
+      reader.refill();
+      ones = ~reader.peek();
+      q = ones != 0
+          ? static_cast<unsigned>(__builtin_ctzll(ones))
+          : SAMPLE_CODEC_ESCAPE;
+
+      if (q < SAMPLE_CODEC_ESCAPE) {
+        reader.skip(q + 1);
+        residual = (q << k) | reader.get(k);
+      } else {
+        reader.skip(SAMPLE_CODEC_ESCAPE);
+        residual = reader.get(SAMPLE_CODEC_VERBATIM_BITS);
+      }
+
+      prev[i & 1] = unzigzag(residual) + (delta ? prev[i & 1] : 0);
+      out[g + i]  = static_cast<int16_t>(prev[i & 1]);
+    }
+  }
+
+  return !reader.overrun();
+}
+
+void
+SampleCodec::header(SampleCodecHeader &header, double fullScale)
+{
+  memset(&header, 0, sizeof(SampleCodecHeader));
+  memcpy(header.magic, SAMPLE_CODEC_MAGIC, sizeof(header.magic));
+  header.version      = SAMPLE_CODEC_VERSION;
+  header.blockSamples = SAMPLE_CODEC_BLOCK_SAMPLES;
+  header.fullScale    = fullScale;
+}
+
+void
+SampleCodec::block(
+    SampleCodecBlock &block,
+    size_t samples,
+    size_t bytes,
+    uint64_t first)
+{
+  block.magic    = SAMPLE_CODEC_BLOCK_MAGIC;
+  block.samples  = static_cast<uint32_t>(samples);
+  block.bytes    = static_cast<uint32_t>(bytes);
+  block.reserved = 0;
+  block.first    = first;
+}
+
+void
+SampleCodec::trailer(
+    SampleCodecTrailer &trailer,
+    uint64_t blocks,
+    uint64_t offset)
+{
+  trailer.blocks = blocks;
+  trailer.offset = offset;
+  memcpy(trailer.magic, SAMPLE_CODEC_INDEX_MAGIC, sizeof(trailer.magic));
+}
+
+bool
+SampleCodec::load(
+    const char *data,
+    size_t bytes,
+    SampleCodecHeader &header,
+    std::vector<SampleCodecIndexEntry> &blocks,
+    uint64_t &samples)
+{
+  SampleCodecTrailer trailer;
+  SampleCodecBlock block;
+  uint64_t offset, first = 0;
+  bool indexed = false;
+
+  blocks.clear();
+  samples = 0;
+
+  if (bytes < sizeof(SampleCodecHeader))
+    return false;
+
+  memcpy(&header, data, sizeof(SampleCodecHeader));
+
+  if (memcmp(header.magic, SAMPLE_CODEC_MAGIC, sizeof(header.magic)) != 0
+      || header.version != SAMPLE_CODEC_VERSION
+      || header.blockSamples == 0
+      || !(header.fullScale > 0))
+    return false;
+
+  // Use the index if the file was closed properly and it checks out
+  if (bytes >= sizeof(SampleCodecHeader) + sizeof(SampleCodecTrailer)) {
+    uint64_t end = bytes - sizeof(SampleCodecTrailer);
+
+    memcpy(&trailer, data + end, sizeof(SampleCodecTrailer));
+
+    if (memcmp(trailer.magic, SAMPLE_CODEC_INDEX_MAGIC, sizeof(trailer.magic))
+          == 0
+        && trailer.offset >= sizeof(SampleCodecHeader)
+        && trailer.offset <= end
+        && (end - trailer.offset) / sizeof(SampleCodecIndexEntry)
+          == trailer.blocks
+        && (end - trailer.offset) % sizeof(SampleCodecIndexEntry) == 0) {
+      blocks.resize(trailer.blocks);
+      if (trailer.blocks > 0)
+        memcpy(
+              blocks.data(),
+              data + trailer.offset,
+              trailer.blocks * sizeof(SampleCodecIndexEntry));
+
+      indexed = true;
+      for (auto const &entry : blocks) {
+        if (!validBlock(
+              data,
+              trailer.offset,
+              entry.offset,
+              header,
+              entry.first,
+              block)
+            || entry.first != first) {
+          indexed = false;
+          break;
+        }
+
+        first += block.samples;
+      }
+    }
+  }
+
+  // Otherwise, walk the blocks until they stop making sense
+  if (!indexed) {
+    blocks.clear();
+    offset = sizeof(SampleCodecHeader);
+    first  = 0;
+
+    while (validBlock(data, bytes, offset, header, first, block)) {
+      blocks.push_back(SampleCodecIndexEntry {offset, first});
+      offset += sizeof(SampleCodecBlock) + block.bytes;
+      first  += block.samples;
+    }
+  }
+
+  samples = first;
+
+  return true;
+}
@@ -0,0 +1,142 @@
+//
+//    SampleCodec.h: Lossless coding of quantized phase recordings
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef SAMPLECODEC_H
+#define SAMPLECODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define SAMPLE_CODEC_BLOCK_SAMPLES 16384
+#define SAMPLE_CODEC_GROUP         64   // values sharing a Rice parameter
+#define SAMPLE_CODEC_ESCAPE        24   // unary prefix of verbatim values
+
+//
+// Lossless compression of ci16 phase difference samples. The phase
+// varies slowly and the magnitude sits at the noise floor most of the
+// time, so the samples are coded as small residuals: every group of
+// SAMPLE_CODEC_GROUP values (in-phase and quadrature components taken
+// separately) is either delta coded or, if that does not pay off (white
+// noise), stored as is. The zigzag-mapped residuals are Rice coded, with
+// a parameter per group taken from their mean, so the code follows the
+// signal as it comes and goes. Residuals whose quotient does not fit in
+// SAMPLE_CODEC_ESCAPE bits are stored verbatim after the escape prefix,
+// which bounds the size of any block (see bound()).
+//
+// Blocks are independent of each other, so they can be compressed in
+// parallel and decoded starting at any of them. A compressed recording
+// is a header, the blocks, and an index of the blocks at the end:
+//
+//   Header:
+//     char     magic[8]     "ANTSDRZ1"
+//     uint32_t version      1
+//     uint32_t blockSamples Maximum samples per block
+//     double   fullScale    Magnitude mapped to 32767
+//     uint64_t reserved     0
+//   Blocks:
+//     uint32_t magic        "ZBLK"
+//     uint32_t samples
+//     uint32_t bytes        Of coded data, right after this header
+//     uint32_t reserved     0
+//     uint64_t first        Index of the first sample of the block
+//   Index:
+//     uint64_t offset       Of the block header
+//     uint64_t first
+//   Trailer:
+//     uint64_t blocks
+//     uint64_t offset       Of the index
+//     char     magic[8]     "ANTSDRZX"
+//
+// The index is only written when the file is closed. If it is missing
+// (e.g. the program died), load() rebuilds it by walking the block
+// headers, and stops at the first one that was not completely written.
+//
+// All fields are little endian.
+//
+
+namespace SigDigger {
+  struct SampleCodecHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t blockSamples;
+    double   fullScale;
+    uint64_t reserved;
+  };
+
+  struct SampleCodecBlock {
+    uint32_t magic;
+    uint32_t samples;
+    uint32_t bytes;
+    uint32_t reserved;
+    uint64_t first;
+  };
+
+  struct SampleCodecIndexEntry {
+    uint64_t offset;
+    uint64_t first;
+  };
+
+  struct SampleCodecTrailer {
+    uint64_t blocks;
+    uint64_t offset;
+    char     magic[8];
+  };
+
+  class SampleCodec
+  {
+  public:
+    // Worst case size of a coded block, header excluded
+    static size_t bound(size_t samples);
+
+    // Returns the bytes written to `out`
+    static size_t encode(uint8_t *out, const int16_t *in, size_t samples);
+
+    // Decodes the first `samples` samples of a block. Fails if the coded
+    // data ends before them
+    static bool   decode(
+        int16_t *out,
+        size_t samples,
+        const uint8_t *in,
+        size_t bytes);
+
+    // Container
+    static void   header(SampleCodecHeader &, double fullScale);
+    static void   block(
+        SampleCodecBlock &,
+        size_t samples,
+        size_t bytes,
+        uint64_t first);
+    static void   trailer(
+        SampleCodecTrailer &,
+        uint64_t blocks,
+        uint64_t offset);
+
+    // Reads the header and the block index of a compressed recording
+    // held in memory. The samples of block i are [first, next first)
+    static bool   load(
+        const char *data,
+        size_t bytes,
+        SampleCodecHeader &,
+        std::vector<SampleCodecIndexEntry> &,
+        uint64_t &samples);
+  };
+}
+
+#endif // SAMPLECODEC_H
@@ -0,0 +1,104 @@
+//
+//    SampleRing.cpp: Fixed-size ring of the most recent samples
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "SampleRing.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace SigDigger;
+
+void
+SampleRing::resize(size_t capacity)
+{
+  m_buffer.resize(capacity);
+  clear();
+}
+
+void
+SampleRing::clear()
+{
+  m_head = 0;
+  m_size = 0;
+}
+
+size_t
+SampleRing::capacity() const
+{
+  return m_buffer.size();
+}
+
+size_t
+SampleRing::size() const
+{
+  return m_size;
+}
+
+void
+SampleRing::push(const SUCOMPLEX *data, size_t size)
+{
+  size_t capacity = m_buffer.size();
+
+  if (capacity == 0)
+    return;
+
+  // Only the tail survives
+  if (size > capacity) {
+    data += size - capacity;
+    size  = capacity;
+  }
+
+  while (size > 0) {
+    size_t chunk = std::min(size, capacity - m_head);
+
+    memcpy(m_buffer.data() + m_head, data, chunk * sizeof(SUCOMPLEX));
+
+    m_head  = (m_head + chunk) % capacity;
+    m_size  = std::min(m_size + chunk, capacity);
+    data   += chunk;
+    size   -= chunk;
+  }
+}
+
+unsigned
+SampleRing::last(
+    size_t count,
+    const SUCOMPLEX *part[2],
+    size_t length[2]) const
+{
+  size_t capacity = m_buffer.size();
+  size_t start;
+
+  count = std::min(count, m_size);
+
+  if (count == 0)
+    return 0;
+
+  start = (m_head + capacity - count) % capacity;
+
+  part[0]   = m_buffer.data() + start;
+  length[0] = std::min(count, capacity - start);
+
+  if (length[0] == count)
+    return 1;
+
+  part[1]   = m_buffer.data();
+  length[1] = count - length[0];
+
+  return 2;
+}
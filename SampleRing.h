@@ -0,0 +1,57 @@
+//
+//    SampleRing.h: Fixed-size ring of the most recent samples
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <sigutils/types.h>
+#include <vector>
+
+//
+// Keeps the last `capacity` samples pushed to it, overwriting the oldest
+// ones. It is meant to be written and read from the same thread (e.g. as
+// the pre-trigger buffer of a capture), so there is no locking at all:
+// pushing is one or two memcpy()s and reading hands out pointers to (at
+// most) two contiguous parts of the buffer.
+//
+
+namespace SigDigger {
+  class SampleRing
+  {
+    std::vector<SUCOMPLEX> m_buffer;
+    size_t m_head = 0; // Where the next sample goes
+    size_t m_size = 0;
+
+  public:
+    // Drops the current contents
+    void     resize(size_t capacity);
+    void     clear();
+
+    size_t   capacity() const;
+    size_t   size() const;
+
+    void     push(const SUCOMPLEX *, size_t);
+
+    // The last `count` samples (or all of them, if there are fewer), oldest
+    // first. Returns the number of parts they are split in (0, 1 or 2).
+    unsigned last(size_t count, const SUCOMPLEX *part[2], size_t length[2]) const;
+  };
+}
+
+#endif // SAMPLERING_H
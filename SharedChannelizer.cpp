@@ -0,0 +1,240 @@
+//
+//    SharedChannelizer.cpp: Full-band channelizer shared by several taps
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "SharedChannelizer.h"
+#include <cmath>
+
+using namespace SigDigger;
+
+SharedChannelizer::SharedChannelizer(UIMediator *mediator, QObject *parent)
+  : QObject(parent)
+{
+  m_forwarder = new RawChannelForwarder(mediator, this);
+
+  connectAll();
+}
+
+SharedChannelizer::~SharedChannelizer()
+{
+}
+
+void
+SharedChannelizer::connectAll()
+{
+  connect(
+        m_forwarder,
+        SIGNAL(stateChanged(int,QString)),
+        this,
+        SLOT(onStateChanged(int,QString)));
+
+  connect(
+        m_forwarder,
+        SIGNAL(dataAvailable()),
+        this,
+        SLOT(onDataAvailable()));
+
+  connect(
+        m_forwarder,
+        SIGNAL(blocksShed(quint64, quint64)),
+        this,
+        SIGNAL(blocksShed(quint64, quint64)));
+}
+
+void
+SharedChannelizer::setAnalyzer(Suscan::Analyzer *analyzer)
+{
+  m_analyzer = analyzer;
+  m_forwarder->setAnalyzer(analyzer);
+}
+
+void
+SharedChannelizer::setFFTSizeHint(unsigned int fftSize)
+{
+  m_forwarder->setFFTSizeHint(fftSize);
+}
+
+bool
+SharedChannelizer::setChannels(unsigned channels)
+{
+  // Odd channel counts would break the LO / HI bin pairing
+  channels &= ~1u;
+
+  if (isRunning() || channels < 2)
+    return false;
+
+  if (channels != m_channelizer.channels())
+    m_channelizer.configure(channels, m_channelizer.taps());
+
+  return true;
+}
+
+unsigned
+SharedChannelizer::channels() const
+{
+  return m_channelizer.channels();
+}
+
+bool
+SharedChannelizer::acquire()
+{
+  if (m_users == 0) {
+    if (m_analyzer == nullptr)
+      return false;
+
+    m_channelizer.reset();
+
+    if (!m_forwarder->open(
+          0,
+          static_cast<SUFLOAT>(m_analyzer->getSampleRate())))
+      return false;
+  }
+
+  ++m_users;
+
+  return true;
+}
+
+void
+SharedChannelizer::release()
+{
+  if (m_users > 0 && --m_users == 0)
+    m_forwarder->close();
+}
+
+bool
+SharedChannelizer::isRunning() const
+{
+  return m_forwarder->isRunning();
+}
+
+bool
+SharedChannelizer::isReady() const
+{
+  return m_forwarder->state() == RAW_CHANNEL_FORWARDER_RUNNING;
+}
+
+qreal
+SharedChannelizer::inputRate() const
+{
+  return m_forwarder->getEquivFs();
+}
+
+qreal
+SharedChannelizer::channelRate() const
+{
+  return inputRate() / m_channelizer.channels();
+}
+
+unsigned
+SharedChannelizer::decimation() const
+{
+  return m_forwarder->getDecimation() * m_channelizer.channels();
+}
+
+unsigned
+SharedChannelizer::binOf(qreal offset) const
+{
+  qreal    fs = inputRate();
+  unsigned M  = m_channelizer.channels();
+  long     k;
+
+  if (fs <= 0 && m_analyzer != nullptr)
+    fs = m_analyzer->getSampleRate();
+
+  if (fs <= 0)
+    return 0;
+
+  k = std::lround(offset / fs * M) % static_cast<long>(M);
+  if (k < 0)
+    k += M;
+
+  return static_cast<unsigned>(k);
+}
+
+qreal
+SharedChannelizer::binFrequency(unsigned bin) const
+{
+  qreal    fs = inputRate();
+  unsigned M  = m_channelizer.channels();
+  long     k  = bin % M;
+
+  if (fs <= 0 && m_analyzer != nullptr)
+    fs = m_analyzer->getSampleRate();
+
+  if (k >= static_cast<long>(M / 2))
+    k -= M;
+
+  return k * fs / M;
+}
+
+const std::vector<SUCOMPLEX> &
+SharedChannelizer::channel(unsigned bin) const
+{
+  return m_channelizer.channel(bin);
+}
+
+struct timeval
+SharedChannelizer::channelTime() const
+{
+  return m_channelTime;
+}
+
+quint64
+SharedChannelizer::droppedBlocks() const
+{
+  return m_forwarder->droppedBlocks();
+}
+
+quint64
+SharedChannelizer::lateBlocks() const
+{
+  return m_forwarder->lateBlocks();
+}
+
+////////////////////////////// Slots ///////////////////////////////////////////
+void
+SharedChannelizer::onStateChanged(int state, QString const &message)
+{
+  if (state == RAW_CHANNEL_FORWARDER_RUNNING) {
+    emit opened();
+  } else if (state == RAW_CHANNEL_FORWARDER_IDLE) {
+    bool hadUsers = m_users > 0;
+
+    m_users = 0;
+
+    if (message.startsWith("Failed"))
+      emit error(message);
+    else if (hadUsers)
+      emit closed();
+  }
+}
+
+void
+SharedChannelizer::onDataAvailable()
+{
+  auto const &data = m_forwarder->data();
+  unsigned M = m_channelizer.channels();
+
+  // The first frame of this block is computed on this input sample
+  m_channelTime = m_forwarder->sampleTime(
+        m_forwarder->dataIndex() + (M - m_channelizer.phase()) % M);
+
+  if (m_channelizer.feed(data.data(), data.size()) > 0)
+    emit dataAvailable();
+}
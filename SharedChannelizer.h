@@ -0,0 +1,95 @@
+//
+//    SharedChannelizer.h: Full-band channelizer shared by several taps
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef SHAREDCHANNELIZER_H
+#define SHAREDCHANNELIZER_H
+
+#include <QObject>
+#include "RawChannelForwarder.h"
+#include "PolyphaseChannelizer.h"
+
+//
+// Opens a single raw inspector spanning the whole combined 2RX spectrum
+// and splits it with a PolyphaseChannelizer. Users acquire() the
+// channelizer when they start tapping it and release() it when they are
+// done: the inspector is opened with the first user and closed with the
+// last one.
+//
+// Since the LO and HI copies of a channel are fs / 2 apart, with an even
+// number of channels they always fall in bins k and k + M / 2, whose
+// samples are aligned by construction.
+//
+
+namespace SigDigger {
+  class SharedChannelizer : public QObject
+  {
+    Q_OBJECT
+
+    Suscan::Analyzer    *m_analyzer  = nullptr;
+    RawChannelForwarder *m_forwarder = nullptr;
+    PolyphaseChannelizer m_channelizer;
+    unsigned             m_users     = 0;
+    struct timeval       m_channelTime = {0, 0};
+
+    void connectAll();
+
+  public:
+    explicit SharedChannelizer(UIMediator *, QObject *parent = nullptr);
+    ~SharedChannelizer() override;
+
+    void     setAnalyzer(Suscan::Analyzer *);
+    void     setFFTSizeHint(unsigned int);
+    bool     setChannels(unsigned);
+    unsigned channels() const;
+
+    bool     acquire();
+    void     release();
+    bool     isRunning() const;
+    bool     isReady() const;
+
+    qreal    inputRate() const;
+    qreal    channelRate() const;
+    unsigned decimation() const;
+
+    // Frequencies are relative to the center of the spectrum
+    unsigned binOf(qreal offset) const;
+    qreal    binFrequency(unsigned) const;
+
+    const std::vector<SUCOMPLEX> &channel(unsigned) const;
+
+    // Source time of the first sample of the channel() buffers
+    struct timeval channelTime() const;
+
+    quint64  droppedBlocks() const;
+    quint64  lateBlocks() const;
+
+  public slots:
+    void onStateChanged(int, QString const &);
+    void onDataAvailable();
+
+  signals:
+    void opened();
+    void closed();
+    void error(QString);
+    void dataAvailable();
+    void blocksShed(quint64 dropped, quint64 late);
+  };
+}
+
+#endif // SHAREDCHANNELIZER_H
@@ -0,0 +1,221 @@
+//
+//    SigMFMetadata.cpp: SigMF metadata file writer
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "SigMFMetadata.h"
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <cstring>
+#include <sys/time.h>
+
+using namespace SigDigger;
+
+SigMFMetadata::SigMFMetadata()
+{
+  clear();
+}
+
+QString
+SigMFMetadata::datatype(AutoSaveFormat format)
+{
+  switch (format) {
+    case AUTO_SAVE_FORMAT_CI16:
+      return "ci16_le";
+
+    case AUTO_SAVE_FORMAT_CF16:
+      return "cf16_le";
+
+    default:
+      return sizeof(SUFLOAT) == 8 ? "cf64_le" : "cf32_le";
+  }
+}
+
+QString
+SigMFMetadata::metaPath(QString const &dataPath)
+{
+  QString base = dataPath;
+
+  if (base.endsWith(SIGMF_DATA_EXTENSION))
+    base.chop(static_cast<int>(strlen(SIGMF_DATA_EXTENSION)));
+
+  return base + SIGMF_META_EXTENSION;
+}
+
+QString
+SigMFMetadata::dataPath(QString const &metaPath)
+{
+  QString base = metaPath;
+
+  if (base.endsWith(SIGMF_META_EXTENSION))
+    base.chop(static_cast<int>(strlen(SIGMF_META_EXTENSION)));
+
+  return base + SIGMF_DATA_EXTENSION;
+}
+
+QString
+SigMFMetadata::dateTime(struct timeval const &tv)
+{
+  QDateTime time = QDateTime::fromMSecsSinceEpoch(
+        static_cast<qint64>(tv.tv_sec) * 1000 + tv.tv_usec / 1000);
+
+  return time.toUTC().toString(Qt::ISODateWithMs);
+}
+
+bool
+SigMFMetadata::format(QString const &datatype, AutoSaveFormat &format)
+{
+  if (datatype == "ci16_le")
+    format = AUTO_SAVE_FORMAT_CI16;
+  else if (datatype == "cf16_le")
+    format = AUTO_SAVE_FORMAT_CF16;
+  else if (datatype == SigMFMetadata::datatype(AUTO_SAVE_FORMAT_NATIVE))
+    format = AUTO_SAVE_FORMAT_NATIVE;
+  else
+    return false;
+
+  return true;
+}
+
+bool
+SigMFMetadata::parseDateTime(QString const &text, struct timeval &tv)
+{
+  QDateTime time = QDateTime::fromString(text, Qt::ISODateWithMs);
+  qint64 msecs;
+
+  if (!time.isValid())
+    return false;
+
+  msecs = time.toMSecsSinceEpoch();
+  tv.tv_sec  = static_cast<time_t>(msecs / 1000);
+  tv.tv_usec = static_cast<suseconds_t>((msecs % 1000) * 1000);
+
+  return true;
+}
+
+QJsonObject const &
+SigMFMetadata::global() const
+{
+  return m_global;
+}
+
+QJsonArray const &
+SigMFMetadata::captures() const
+{
+  return m_captures;
+}
+
+void
+SigMFMetadata::setGlobal(QString const &key, QJsonValue const &value)
+{
+  m_global[key] = value;
+}
+
+void
+SigMFMetadata::addCapture(
+    quint64 start,
+    qreal frequency,
+    struct timeval const &tv)
+{
+  QJsonObject capture;
+
+  capture["core:sample_start"] = static_cast<qint64>(start);
+  capture["core:frequency"]    = frequency;
+  capture["core:datetime"]     = dateTime(tv);
+
+  m_captures.append(capture);
+}
+
+void
+SigMFMetadata::addAnnotation(
+    quint64 start,
+    quint64 count,
+    QString const &comment,
+    QJsonObject const &extra)
+{
+  QJsonObject annotation = extra;
+
+  annotation["core:sample_start"] = static_cast<qint64>(start);
+  annotation["core:sample_count"] = static_cast<qint64>(count);
+
+  if (!comment.isEmpty())
+    annotation["core:comment"] = comment;
+
+  m_annotations.append(annotation);
+}
+
+void
+SigMFMetadata::clear()
+{
+  QJsonObject extension;
+
+  extension["name"]     = SIGMF_ANTSDR_NAMESPACE;
+  extension["version"]  = SIGMF_VERSION;
+  extension["optional"] = true;
+
+  m_global      = QJsonObject();
+  m_captures    = QJsonArray();
+  m_annotations = QJsonArray();
+
+  m_global["core:version"]    = SIGMF_VERSION;
+  m_global["core:extensions"] = QJsonArray {extension};
+}
+
+bool
+SigMFMetadata::load(QString const &path)
+{
+  QFile file(path);
+  QJsonDocument doc;
+  QJsonObject root;
+
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  doc = QJsonDocument::fromJson(file.readAll());
+  if (!doc.isObject())
+    return false;
+
+  root = doc.object();
+  if (!root["global"].isObject())
+    return false;
+
+  m_global      = root["global"].toObject();
+  m_captures    = root["captures"].toArray();
+  m_annotations = root["annotations"].toArray();
+
+  return true;
+}
+
+bool
+SigMFMetadata::save(QString const &path) const
+{
+  QJsonObject root;
+  QSaveFile file(path);
+
+  root["global"]      = m_global;
+  root["captures"]    = m_captures;
+  root["annotations"] = m_annotations;
+
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  file.write(QJsonDocument(root).toJson());
+
+  return file.commit();
+}
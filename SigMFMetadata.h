@@ -0,0 +1,79 @@
+//
+//    SigMFMetadata.h: SigMF metadata file writer
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef SIGMFMETADATA_H
+#define SIGMFMETADATA_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include "AutoSaveWriter.h"
+
+#define SIGMF_VERSION          "1.0.0"
+#define SIGMF_DATA_EXTENSION   ".sigmf-data"
+#define SIGMF_META_EXTENSION   ".sigmf-meta"
+
+// Namespace of the fields that are specific to this plugin
+#define SIGMF_ANTSDR_NAMESPACE "antsdr"
+
+//
+// Builds the .sigmf-meta companion of a recording: a global object, a
+// single capture segment and one annotation per coherent event. Fields
+// outside the core namespace go under SIGMF_ANTSDR_NAMESPACE, which is
+// declared as an optional extension so generic readers can ignore it.
+// load() reads them back, for replaying recordings.
+//
+
+namespace SigDigger {
+  class SigMFMetadata
+  {
+    QJsonObject m_global;
+    QJsonArray  m_captures;
+    QJsonArray  m_annotations;
+
+  public:
+    SigMFMetadata();
+
+    static QString datatype(AutoSaveFormat);
+    static QString metaPath(QString const &dataPath);
+    static QString dataPath(QString const &metaPath);
+    static QString dateTime(struct timeval const &);
+
+    // Inverses of the above. Return false on unsupported values
+    static bool    format(QString const &datatype, AutoSaveFormat &);
+    static bool    parseDateTime(QString const &, struct timeval &);
+
+    QJsonObject const &global() const;
+    QJsonArray  const &captures() const;
+
+    void setGlobal(QString const &key, QJsonValue const &);
+    void addCapture(quint64 start, qreal frequency, struct timeval const &);
+    void addAnnotation(
+        quint64 start,
+        quint64 count,
+        QString const &comment,
+        QJsonObject const &extra = QJsonObject());
+    void clear();
+
+    bool load(QString const &path);
+    bool save(QString const &path) const;
+  };
+}
+
+#endif // SIGMFMETADATA_H
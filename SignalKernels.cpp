@@ -0,0 +1,1069 @@
+//
+//    SignalKernels.cpp: Vectorized sample processing kernels
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "SignalKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+using namespace SigDigger;
+
+//
+// The generic implementations work on the real and imaginary parts
+// directly. Single precision versions are provided as overloads, so the
+// right one is picked at compile time depending on what SUFLOAT is.
+//
+namespace {
+  template <typename T>
+  inline void
+  crossProductImpl(T *out, const T *lo, const T *hi, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i) {
+      T a = lo[2 * i], b = lo[2 * i + 1];
+      T c = hi[2 * i], d = hi[2 * i + 1];
+
+      out[2 * i]     = -(a * c + b * d);
+      out[2 * i + 1] = a * d - b * c;
+    }
+  }
+
+  template <typename T>
+  inline void
+  crossProductSumImpl(T *re, T *im, const T *lo, const T *hi, size_t size)
+  {
+    T accRe = 0, accIm = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+      T a = lo[2 * i], b = lo[2 * i + 1];
+      T c = hi[2 * i], d = hi[2 * i + 1];
+
+      accRe -= a * c + b * d;
+      accIm += a * d - b * c;
+    }
+
+    *re = accRe;
+    *im = accIm;
+  }
+
+  template <typename T>
+  inline T
+  powerSumImpl(const T *x, size_t size)
+  {
+    T acc = 0;
+
+    for (size_t i = 0; i < 2 * size; ++i)
+      acc += x[i] * x[i];
+
+    return acc;
+  }
+
+  template <typename T>
+  inline void
+  realDotProductImpl(T *re, T *im, const T *x, const T *taps, size_t size)
+  {
+    T accRe = 0, accIm = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+      accRe += taps[i] * x[2 * i];
+      accIm += taps[i] * x[2 * i + 1];
+    }
+
+    *re = accRe;
+    *im = accIm;
+  }
+
+  template <typename T>
+  inline void
+  firFilterImpl(T *out, const T *in, const T *taps, size_t order, size_t size)
+  {
+    for (size_t n = 0; n < size; ++n) {
+      T accRe = 0, accIm = 0;
+      const T *x = in + 2 * n;
+
+      for (size_t k = 0; k < order; ++k) {
+        accRe += taps[k] * x[-2 * static_cast<ptrdiff_t>(k)];
+        accIm += taps[k] * x[-2 * static_cast<ptrdiff_t>(k) + 1];
+      }
+
+      out[2 * n]     = accRe;
+      out[2 * n + 1] = accIm;
+    }
+  }
+
+  template <typename T>
+  inline void
+  quantizeInt16Impl(int16_t *out, const T *x, T scale, size_t size)
+  {
+    for (size_t i = 0; i < 2 * size; ++i) {
+      T v = scale * x[i];
+
+      if (v > 32767)
+        v = 32767;
+      else if (v < -32768)
+        v = -32768;
+
+      out[i] = static_cast<int16_t>(std::lrint(v));
+    }
+  }
+
+  //
+  // Branchless float to half conversion, rounding to nearest even. Values
+  // below the smallest normal half are rounded by the FPU itself, by adding
+  // a constant that pushes the bits we want to the bottom of the mantissa.
+  //
+  inline uint16_t
+  floatToHalf(float value)
+  {
+    const uint32_t infinity   = 255u << 23;
+    const uint32_t halfMax    = (127u + 16) << 23;
+    const uint32_t minNormal  = 113u << 23;
+    const uint32_t denormBias = ((127u - 15) + (23 - 10) + 1) << 23;
+    uint32_t f, sign, half;
+
+    memcpy(&f, &value, sizeof(uint32_t));
+
+    sign = f & 0x80000000u;
+    f   ^= sign;
+
+    if (f >= halfMax) {
+      half = f > infinity ? 0x7e00 : 0x7c00;
+    } else if (f < minNormal) {
+      float biased, magic;
+
+      memcpy(&magic, &denormBias, sizeof(float));
+      memcpy(&biased, &f, sizeof(float));
+      biased += magic;
+      memcpy(&f, &biased, sizeof(uint32_t));
+
+      half = f - denormBias;
+    } else {
+      uint32_t odd = (f >> 13) & 1;
+
+      f   += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + odd;
+      half = f >> 13;
+    }
+
+    return static_cast<uint16_t>(half | (sign >> 16));
+  }
+
+  template <typename T>
+  inline void
+  quantizeHalfImpl(uint16_t *out, const T *x, T scale, size_t size)
+  {
+    for (size_t i = 0; i < 2 * size; ++i)
+      out[i] = floatToHalf(static_cast<float>(scale * x[i]));
+  }
+
+  template <typename T>
+  inline void
+  dequantizeInt16Impl(T *out, const int16_t *x, T scale, size_t size)
+  {
+    for (size_t i = 0; i < 2 * size; ++i)
+      out[i] = scale * static_cast<T>(x[i]);
+  }
+
+  //
+  // Half to float conversion. The exponent is rebiased by shifting the
+  // bits into place and multiplying by 2^112, which also turns half
+  // denormals into the right float normals. Infinities and NaNs (whose
+  // exponent would be 143 after the shift) are patched afterwards.
+  //
+  inline float
+  halfToFloat(uint16_t value)
+  {
+    const uint32_t rebias  = (254u - 15) << 23;
+    const uint32_t halfInf = 143u << 23;
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t f    = static_cast<uint32_t>(value & 0x7fff) << 13;
+    float magic, result;
+
+    memcpy(&magic, &rebias, sizeof(float));
+    memcpy(&result, &f, sizeof(float));
+    result *= magic;
+    memcpy(&f, &result, sizeof(uint32_t));
+
+    if (f >= halfInf)
+      f |= 255u << 23;
+
+    f |= sign;
+    memcpy(&result, &f, sizeof(float));
+
+    return result;
+  }
+
+  template <typename T>
+  inline void
+  dequantizeHalfImpl(T *out, const uint16_t *x, T scale, size_t size)
+  {
+    for (size_t i = 0; i < 2 * size; ++i)
+      out[i] = scale * static_cast<T>(halfToFloat(x[i]));
+  }
+
+  //
+  // Polar codes: phase in the upper half (2^16 steps per turn), and
+  // 512 log2|x| + 32768 in the lower one, 0 meaning zero. Powers below
+  // the smallest normal float are stored as zero.
+  //
+  template <typename T>
+  inline void
+  encodePolarImpl(uint32_t *out, const T *x, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i) {
+      T re = x[2 * i], im = x[2 * i + 1];
+      T power = re * re + im * im;
+      uint32_t code = 0;
+
+      if (power >= std::numeric_limits<float>::min()) {
+        T level = 256 * std::log2(power) + 32768;
+        T phase = std::atan2(im, re) * static_cast<T>(32768 / M_PI);
+
+        level = std::min<T>(std::max<T>(level, 1), 65535);
+        code  = static_cast<uint32_t>(std::lrint(phase)) << 16;
+        code |= static_cast<uint32_t>(std::lrint(level));
+      }
+
+      out[i] = code;
+    }
+  }
+
+  template <typename T>
+  inline void
+  decodePolarImpl(T *out, const uint32_t *x, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i) {
+      uint32_t level = x[i] & 0xffff;
+      int      phase = static_cast<int>(x[i] >> 16);
+      T mag = 0, angle;
+
+      if (phase >= 32768)
+        phase -= 65536;
+
+      if (level != 0)
+        mag = std::exp2(static_cast<T>(level) / 512 - 64);
+
+      angle = static_cast<T>(phase) * static_cast<T>(M_PI / 32768);
+
+      out[2 * i]     = mag * std::cos(angle);
+      out[2 * i + 1] = mag * std::sin(angle);
+    }
+  }
+
+  template <typename T>
+  inline void
+  phaseIncrementImpl(T *out, const T *x, T prevRe, T prevIm, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i) {
+      T re = x[2 * i], im = x[2 * i + 1];
+      T zr = re * prevRe + im * prevIm;
+      T zi = im * prevRe - re * prevIm;
+      T angle = std::atan2(zi, zr);
+
+      // atan2(0, 0) depends on the signs of the zeros. Be consistent.
+      if ((zr == 0 && zi == 0) || std::isnan(angle))
+        angle = static_cast<T>(M_PI);
+
+      out[i] = angle;
+      prevRe = re;
+      prevIm = im;
+    }
+  }
+
+  template <typename T>
+  inline T
+  singlePoleFilterImpl(T *out, const T *x, T alpha, T state, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i) {
+      state += alpha * (x[i] - state);
+      out[i] = state;
+    }
+
+    return state;
+  }
+
+#ifdef __SSE2__
+  //
+  // Two complex samples per register: lo = [a0 b0 a1 b1], hi = [c0 d0 c1 d1]
+  //
+  //   t1 = lo * hi           = [a0c0 b0d0 a1c1 b1d1]
+  //   t2 = lo * swap(hi)     = [a0d0 b0c0 a1d1 b1c1]
+  //
+  // Real parts are -(ac + bd) and imaginary parts are ad - bc.
+  //
+  inline void
+  crossProductImpl(float *out, const float *lo, const float *hi, size_t size)
+  {
+    size_t i = 0;
+    __m128 zero = _mm_setzero_ps();
+
+    for (; i + 2 <= size; i += 2) {
+      __m128 l  = _mm_loadu_ps(lo + 2 * i);
+      __m128 h  = _mm_loadu_ps(hi + 2 * i);
+      __m128 hs = _mm_shuffle_ps(h, h, _MM_SHUFFLE(2, 3, 0, 1));
+      __m128 t1 = _mm_mul_ps(l, h);
+      __m128 t2 = _mm_mul_ps(l, hs);
+
+      __m128 A  = _mm_shuffle_ps(t1, t2, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 B  = _mm_shuffle_ps(t1, t2, _MM_SHUFFLE(3, 1, 3, 1));
+
+      __m128 S  = _mm_sub_ps(zero, _mm_add_ps(A, B)); // [re0 re1 x x]
+      __m128 D  = _mm_sub_ps(A, B);                   // [x x im0 im1]
+      __m128 R  = _mm_shuffle_ps(S, D, _MM_SHUFFLE(3, 2, 1, 0));
+
+      _mm_storeu_ps(out + 2 * i, _mm_shuffle_ps(R, R, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    if (i < size)
+      crossProductImpl<float>(out + 2 * i, lo + 2 * i, hi + 2 * i, size - i);
+  }
+
+  inline void
+  crossProductSumImpl(
+      float *re,
+      float *im,
+      const float *lo,
+      const float *hi,
+      size_t size)
+  {
+    size_t i = 0;
+    float  tailRe, tailIm;
+    float  acc1[4], acc2[4];
+    __m128 s1 = _mm_setzero_ps();
+    __m128 s2 = _mm_setzero_ps();
+
+    for (; i + 2 <= size; i += 2) {
+      __m128 l  = _mm_loadu_ps(lo + 2 * i);
+      __m128 h  = _mm_loadu_ps(hi + 2 * i);
+      __m128 hs = _mm_shuffle_ps(h, h, _MM_SHUFFLE(2, 3, 0, 1));
+
+      s1 = _mm_add_ps(s1, _mm_mul_ps(l, h));
+      s2 = _mm_add_ps(s2, _mm_mul_ps(l, hs));
+    }
+
+    _mm_storeu_ps(acc1, s1);
+    _mm_storeu_ps(acc2, s2);
+
+    crossProductSumImpl<float>(
+          &tailRe,
+          &tailIm,
+          lo + 2 * i,
+          hi + 2 * i,
+          size - i);
+
+    *re = tailRe - (acc1[0] + acc1[1] + acc1[2] + acc1[3]);
+    *im = tailIm + (acc2[0] + acc2[2]) - (acc2[1] + acc2[3]);
+  }
+
+  inline float
+  powerSumImpl(const float *x, size_t size)
+  {
+    size_t i = 0;
+    float  acc[4];
+    __m128 s = _mm_setzero_ps();
+
+    for (; i + 2 <= size; i += 2) {
+      __m128 v = _mm_loadu_ps(x + 2 * i);
+      s = _mm_add_ps(s, _mm_mul_ps(v, v));
+    }
+
+    _mm_storeu_ps(acc, s);
+
+    return acc[0] + acc[1] + acc[2] + acc[3]
+        + powerSumImpl<float>(x + 2 * i, size - i);
+  }
+
+  //
+  // Taps are paired with the real and imaginary parts of two samples at
+  // once: [h0 h0 h1 h1] * [x0r x0i x1r x1i]
+  //
+  inline void
+  realDotProductImpl(
+      float *re,
+      float *im,
+      const float *x,
+      const float *taps,
+      size_t size)
+  {
+    size_t i = 0;
+    float  tailRe, tailIm;
+    float  acc[4];
+    __m128 s = _mm_setzero_ps();
+
+    for (; i + 2 <= size; i += 2) {
+      __m128 h = _mm_set_ps(taps[i + 1], taps[i + 1], taps[i], taps[i]);
+      s = _mm_add_ps(s, _mm_mul_ps(h, _mm_loadu_ps(x + 2 * i)));
+    }
+
+    _mm_storeu_ps(acc, s);
+
+    realDotProductImpl<float>(&tailRe, &tailIm, x + 2 * i, taps + i, size - i);
+
+    *re = tailRe + acc[0] + acc[2];
+    *im = tailIm + acc[1] + acc[3];
+  }
+
+  //
+  // Vectorized over the output index: each tap is broadcast and multiplied
+  // by four consecutive (shifted) input samples at once.
+  //
+  inline void
+  firFilterImpl(
+      float *out,
+      const float *in,
+      const float *taps,
+      size_t order,
+      size_t size)
+  {
+    size_t n = 0;
+
+    for (; n + 4 <= size; n += 4) {
+      __m128 acc0 = _mm_setzero_ps();
+      __m128 acc1 = _mm_setzero_ps();
+      const float *x = in + 2 * n;
+
+      for (size_t k = 0; k < order; ++k) {
+        __m128 h = _mm_set1_ps(taps[k]);
+        const float *p = x - 2 * static_cast<ptrdiff_t>(k);
+
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(h, _mm_loadu_ps(p)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(h, _mm_loadu_ps(p + 4)));
+      }
+
+      _mm_storeu_ps(out + 2 * n,     acc0);
+      _mm_storeu_ps(out + 2 * n + 4, acc1);
+    }
+
+    if (n < size)
+      firFilterImpl<float>(out + 2 * n, in + 2 * n, taps, order, size - n);
+  }
+
+  //
+  // Four complex samples per iteration. The values are clamped before the
+  // conversion (which would turn out-of-range values into INT32_MIN) and
+  // packs_epi32 does the rest of the saturation.
+  //
+  inline void
+  quantizeInt16Impl(int16_t *out, const float *x, float scale, size_t size)
+  {
+    size_t i = 0;
+    __m128 vScale = _mm_set1_ps(scale);
+    __m128 vMax   = _mm_set1_ps(32767.f);
+    __m128 vMin   = _mm_set1_ps(-32768.f);
+
+    for (; i + 4 <= size; i += 4) {
+      __m128 a = _mm_mul_ps(vScale, _mm_loadu_ps(x + 2 * i));
+      __m128 b = _mm_mul_ps(vScale, _mm_loadu_ps(x + 2 * i + 4));
+
+      a = _mm_max_ps(_mm_min_ps(a, vMax), vMin);
+      b = _mm_max_ps(_mm_min_ps(b, vMax), vMin);
+
+      _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(out + 2 * i),
+            _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+
+    if (i < size)
+      quantizeInt16Impl<float>(out + 2 * i, x + 2 * i, scale, size - i);
+  }
+
+  //
+  // Four complex samples per iteration: the int16 pairs are sign-extended
+  // by unpacking them into the upper half of each lane and shifting back.
+  //
+  inline void
+  dequantizeInt16Impl(float *out, const int16_t *x, float scale, size_t size)
+  {
+    size_t i = 0;
+    __m128 vScale = _mm_set1_ps(scale);
+
+    for (; i + 4 <= size; i += 4) {
+      __m128i v = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(x + 2 * i));
+      __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+      __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+      _mm_storeu_ps(out + 2 * i,     _mm_mul_ps(vScale, _mm_cvtepi32_ps(a)));
+      _mm_storeu_ps(out + 2 * i + 4, _mm_mul_ps(vScale, _mm_cvtepi32_ps(b)));
+    }
+
+    if (i < size)
+      dequantizeInt16Impl<float>(out + 2 * i, x + 2 * i, scale, size - i);
+  }
+
+  inline __m128
+  selectPs(__m128 mask, __m128 a, __m128 b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+
+  //
+  // log2 of positive normal floats: exponent plus the log2 of the mantissa
+  // m in [1, 2), as 2 atanh(s) / ln 2 with s = (m - 1) / (m + 1) <= 1 / 3.
+  // Four terms of the series leave an error below 2e-5.
+  //
+  inline __m128
+  log2Ps(__m128 x)
+  {
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 c1  = _mm_set1_ps(2.8853900817779268f);
+    const __m128 c3  = _mm_set1_ps(2.8853900817779268f / 3);
+    const __m128 c5  = _mm_set1_ps(2.8853900817779268f / 5);
+    const __m128 c7  = _mm_set1_ps(2.8853900817779268f / 7);
+    __m128i bits = _mm_castps_si128(x);
+    __m128  e    = _mm_cvtepi32_ps(
+          _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128  m    = _mm_castsi128_ps(
+          _mm_or_si128(
+            _mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+            _mm_castps_si128(one)));
+    __m128  s    = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128  s2   = _mm_mul_ps(s, s);
+    __m128  p    = c7;
+
+    p = _mm_add_ps(_mm_mul_ps(p, s2), c5);
+    p = _mm_add_ps(_mm_mul_ps(p, s2), c3);
+    p = _mm_add_ps(_mm_mul_ps(p, s2), c1);
+
+    return _mm_add_ps(e, _mm_mul_ps(s, p));
+  }
+
+  //
+  // atan2 reduced to atan(t), t = min / max of |x| and |y| in [0, 1],
+  // with the polynomial of Abramowitz & Stegun 4.4.49 (error below 1e-7)
+  //
+  inline __m128
+  atan2Ps(__m128 y, __m128 x)
+  {
+    const __m128 sign = _mm_set1_ps(-0.f);
+    const __m128 coef[] = {
+      _mm_set1_ps(+0.0028662257f),
+      _mm_set1_ps(-0.0161657367f),
+      _mm_set1_ps(+0.0429096138f),
+      _mm_set1_ps(-0.0752896400f),
+      _mm_set1_ps(+0.1065626393f),
+      _mm_set1_ps(-0.1420889944f),
+      _mm_set1_ps(+0.1999355085f),
+      _mm_set1_ps(-0.3333314528f),
+      _mm_set1_ps(1.f)
+    };
+    __m128 ax   = _mm_andnot_ps(sign, x);
+    __m128 ay   = _mm_andnot_ps(sign, y);
+    __m128 swap = _mm_cmpgt_ps(ay, ax);
+    __m128 t    = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(ax, ay));
+    __m128 t2   = _mm_mul_ps(t, t);
+    __m128 a    = coef[0];
+
+    for (unsigned i = 1; i < sizeof(coef) / sizeof(coef[0]); ++i)
+      a = _mm_add_ps(_mm_mul_ps(a, t2), coef[i]);
+
+    a = _mm_mul_ps(a, t);
+    a = selectPs(swap, _mm_sub_ps(_mm_set1_ps(M_PI / 2), a), a);
+    a = selectPs(
+          _mm_cmplt_ps(x, _mm_setzero_ps()),
+          _mm_sub_ps(_mm_set1_ps(M_PI), a),
+          a);
+
+    // Same sign as y
+    return _mm_xor_ps(a, _mm_and_ps(y, sign));
+  }
+
+  inline void
+  encodePolarImpl(uint32_t *out, const float *x, size_t size)
+  {
+    size_t i = 0;
+    __m128 minNormal  = _mm_set1_ps(std::numeric_limits<float>::min());
+    __m128 levelScale = _mm_set1_ps(256.f);
+    __m128 levelBias  = _mm_set1_ps(32768.f);
+    __m128 levelMin   = _mm_set1_ps(1.f);
+    __m128 levelMax   = _mm_set1_ps(65535.f);
+    __m128 phaseScale = _mm_set1_ps(32768 / M_PI);
+
+    for (; i + 4 <= size; i += 4) {
+      __m128 a     = _mm_loadu_ps(x + 2 * i);
+      __m128 b     = _mm_loadu_ps(x + 2 * i + 4);
+      __m128 re    = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 im    = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      __m128 power = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+      __m128 valid = _mm_cmpge_ps(power, minNormal);
+      __m128 level = _mm_add_ps(
+            _mm_mul_ps(levelScale, log2Ps(power)),
+            levelBias);
+      __m128 phase = _mm_mul_ps(phaseScale, atan2Ps(im, re));
+      __m128i code;
+
+      level = _mm_max_ps(_mm_min_ps(level, levelMax), levelMin);
+      code  = _mm_or_si128(
+            _mm_slli_epi32(_mm_cvtps_epi32(phase), 16),
+            _mm_cvtps_epi32(level));
+
+      _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(out + i),
+            _mm_and_si128(code, _mm_castps_si128(valid)));
+    }
+
+    if (i < size)
+      encodePolarImpl<float>(out + i, x + 2 * i, size - i);
+  }
+
+  //
+  // The magnitude is 2^(level / 512 - 64): the integer part of the
+  // exponent goes straight to the float bits, and 2^f, f in [0, 1), is a
+  // Taylor polynomial. The top two bits of the phase (once rotated by an
+  // eighth of a turn) tell the quadrant, so sin and cos only need to be
+  // approximated in [-pi / 4, pi / 4).
+  //
+  inline void
+  decodePolarImpl(float *out, const uint32_t *x, size_t size)
+  {
+    const float ln2 = static_cast<float>(M_LN2);
+    size_t i = 0;
+    __m128i low16  = _mm_set1_epi32(0xffff);
+    __m128i octant = _mm_set1_epi32(0x2000);
+    __m128  exp2c[] = {
+      _mm_set1_ps(ln2 * ln2 * ln2 * ln2 * ln2 * ln2 / 720),
+      _mm_set1_ps(ln2 * ln2 * ln2 * ln2 * ln2 / 120),
+      _mm_set1_ps(ln2 * ln2 * ln2 * ln2 / 24),
+      _mm_set1_ps(ln2 * ln2 * ln2 / 6),
+      _mm_set1_ps(ln2 * ln2 / 2),
+      _mm_set1_ps(ln2),
+      _mm_set1_ps(1.f)
+    };
+    __m128  sinc[] = {
+      _mm_set1_ps(-1.f / 5040),
+      _mm_set1_ps(1.f / 120),
+      _mm_set1_ps(-1.f / 6),
+      _mm_set1_ps(1.f)
+    };
+    __m128  cosc[] = {
+      _mm_set1_ps(1.f / 40320),
+      _mm_set1_ps(-1.f / 720),
+      _mm_set1_ps(1.f / 24),
+      _mm_set1_ps(-1.f / 2),
+      _mm_set1_ps(1.f)
+    };
+
+    for (; i + 4 <= size; i += 4) {
+      __m128i code  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+      __m128i level = _mm_and_si128(code, low16);
+      __m128i phase = _mm_add_epi32(_mm_srli_epi32(code, 16), octant);
+      __m128i q     = _mm_and_si128(_mm_srli_epi32(phase, 14), _mm_set1_epi32(3));
+      __m128i k     = _mm_sub_epi32(
+            _mm_and_si128(phase, _mm_set1_epi32(0x3fff)),
+            octant);
+      __m128  scale = _mm_castsi128_ps(
+            _mm_slli_epi32(
+              _mm_add_epi32(_mm_srli_epi32(level, 9), _mm_set1_epi32(63)),
+              23));
+      __m128  f     = _mm_mul_ps(
+            _mm_cvtepi32_ps(_mm_and_si128(level, _mm_set1_epi32(511))),
+            _mm_set1_ps(1.f / 512));
+      __m128  t     = _mm_mul_ps(
+            _mm_cvtepi32_ps(k),
+            _mm_set1_ps(M_PI / 32768));
+      __m128  t2    = _mm_mul_ps(t, t);
+      __m128  swap  = _mm_castsi128_ps(
+            _mm_cmpeq_epi32(
+              _mm_and_si128(q, _mm_set1_epi32(1)),
+              _mm_set1_epi32(1)));
+      __m128  mag   = exp2c[0];
+      __m128  s     = sinc[0];
+      __m128  c     = cosc[0];
+      __m128  re, im;
+
+      for (unsigned j = 1; j < sizeof(exp2c) / sizeof(exp2c[0]); ++j)
+        mag = _mm_add_ps(_mm_mul_ps(mag, f), exp2c[j]);
+
+      for (unsigned j = 1; j < sizeof(sinc) / sizeof(sinc[0]); ++j)
+        s = _mm_add_ps(_mm_mul_ps(s, t2), sinc[j]);
+
+      for (unsigned j = 1; j < sizeof(cosc) / sizeof(cosc[0]); ++j)
+        c = _mm_add_ps(_mm_mul_ps(c, t2), cosc[j]);
+
+      s   = _mm_mul_ps(s, t);
+      mag = _mm_andnot_ps(
+            _mm_castsi128_ps(_mm_cmpeq_epi32(level, _mm_setzero_si128())),
+            _mm_mul_ps(mag, scale));
+
+      // Quadrants 0 to 3: (c, s), (-s, c), (-c, -s), (s, -c)
+      re = selectPs(swap, s, c);
+      im = selectPs(swap, c, s);
+      re = _mm_xor_ps(
+            re,
+            _mm_castsi128_ps(
+              _mm_slli_epi32(
+                _mm_and_si128(
+                  _mm_add_epi32(q, _mm_set1_epi32(1)),
+                  _mm_set1_epi32(2)),
+                30)));
+      im = _mm_xor_ps(
+            im,
+            _mm_castsi128_ps(
+              _mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30)));
+      re = _mm_mul_ps(re, mag);
+      im = _mm_mul_ps(im, mag);
+
+      _mm_storeu_ps(out + 2 * i,     _mm_unpacklo_ps(re, im));
+      _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(re, im));
+    }
+
+    if (i < size)
+      decodePolarImpl<float>(out + 2 * i, x + i, size - i);
+  }
+
+  //
+  // Four samples per iteration. Their predecessors are loaded one sample
+  // behind, so only the first one needs prev.
+  //
+  inline void
+  phaseIncrementImpl(
+      float *out,
+      const float *x,
+      float prevRe,
+      float prevIm,
+      size_t size)
+  {
+    size_t i = 1;
+
+    if (size == 0)
+      return;
+
+    phaseIncrementImpl<float>(out, x, prevRe, prevIm, 1);
+
+    for (; i + 4 <= size; i += 4) {
+      __m128 a0  = _mm_loadu_ps(x + 2 * i);
+      __m128 a1  = _mm_loadu_ps(x + 2 * i + 4);
+      __m128 b0  = _mm_loadu_ps(x + 2 * i - 2);
+      __m128 b1  = _mm_loadu_ps(x + 2 * i + 2);
+      __m128 re  = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 im  = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+      __m128 pre = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 pim = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1));
+      __m128 zr  = _mm_add_ps(_mm_mul_ps(re, pre), _mm_mul_ps(im, pim));
+      __m128 zi  = _mm_sub_ps(_mm_mul_ps(im, pre), _mm_mul_ps(re, pim));
+      __m128 a   = atan2Ps(zi, zr);
+
+      // 0 / 0 (or inf / inf) in the reduction
+      _mm_storeu_ps(
+            out + i,
+            selectPs(_mm_cmpord_ps(a, a), a, _mm_set1_ps(M_PI)));
+    }
+
+    if (i < size)
+      phaseIncrementImpl<float>(
+            out + i,
+            x + 2 * i,
+            x[2 * i - 2],
+            x[2 * i - 1],
+            size - i);
+  }
+
+  //
+  // With beta = 1 - alpha, out[i] = beta * out[i - 1] + alpha * x[i].
+  // For four consecutive outputs:
+  //
+  //   out[i + k] = sum(beta^(k - j) alpha x[i + j], j = 0 ... k)
+  //              + beta^(k + 1) out[i - 1]
+  //
+  // The sums are an inclusive scan of alpha * x, weighted by powers of
+  // beta, done in two shift-and-add steps. For long time constants beta
+  // is too close to 1 to be rounded to a float without changing the decay
+  // noticeably, so the last term is computed as out[i - 1] minus
+  // (1 - beta^(k + 1)) out[i - 1], with the factors evaluated in double.
+  //
+  inline float
+  singlePoleFilterImpl(
+      float *out,
+      const float *x,
+      float alpha,
+      float state,
+      size_t size)
+  {
+    size_t i = 0;
+    double logBeta = std::log1p(-static_cast<double>(alpha));
+    float beta = 1 - alpha;
+    __m128 a1 = _mm_set1_ps(beta);
+    __m128 a2 = _mm_set1_ps(beta * beta);
+    __m128 decay = _mm_setr_ps(
+          static_cast<float>(-std::expm1(logBeta)),
+          static_cast<float>(-std::expm1(2 * logBeta)),
+          static_cast<float>(-std::expm1(3 * logBeta)),
+          static_cast<float>(-std::expm1(4 * logBeta)));
+    __m128 y = _mm_set1_ps(state);
+
+    for (; i + 4 <= size; i += 4) {
+      __m128 v = _mm_mul_ps(_mm_set1_ps(alpha), _mm_loadu_ps(x + i));
+
+      v = _mm_add_ps(
+            v,
+            _mm_mul_ps(
+              a1,
+              _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4))));
+      v = _mm_add_ps(
+            v,
+            _mm_mul_ps(
+              a2,
+              _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8))));
+      y = _mm_add_ps(y, _mm_sub_ps(v, _mm_mul_ps(decay, y)));
+
+      _mm_storeu_ps(out + i, y);
+      y = _mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    state = _mm_cvtss_f32(y);
+
+    if (i < size)
+      state = singlePoleFilterImpl<float>(
+            out + i,
+            x + i,
+            alpha,
+            state,
+            size - i);
+
+    return state;
+  }
+#endif // __SSE2__
+}
+
+void
+SigDigger::crossProduct(
+    SUCOMPLEX *out,
+    const SUCOMPLEX *lo,
+    const SUCOMPLEX *hi,
+    size_t size)
+{
+  crossProductImpl(
+        reinterpret_cast<SUFLOAT *>(out),
+        reinterpret_cast<const SUFLOAT *>(lo),
+        reinterpret_cast<const SUFLOAT *>(hi),
+        size);
+}
+
+SUFLOAT
+SigDigger::powerSum(const SUCOMPLEX *x, size_t size)
+{
+  return powerSumImpl(reinterpret_cast<const SUFLOAT *>(x), size);
+}
+
+SUCOMPLEX
+SigDigger::realDotProduct(
+    const SUCOMPLEX *x,
+    const SUFLOAT *taps,
+    size_t size)
+{
+  SUFLOAT re, im;
+
+  realDotProductImpl(
+        &re,
+        &im,
+        reinterpret_cast<const SUFLOAT *>(x),
+        taps,
+        size);
+
+  return SUCOMPLEX(re, im);
+}
+
+void
+SigDigger::firFilter(
+    SUCOMPLEX *out,
+    const SUCOMPLEX *in,
+    const SUFLOAT *taps,
+    size_t order,
+    size_t size)
+{
+  firFilterImpl(
+        reinterpret_cast<SUFLOAT *>(out),
+        reinterpret_cast<const SUFLOAT *>(in),
+        taps,
+        order,
+        size);
+}
+
+void
+SigDigger::quantizeInt16(
+    int16_t *out,
+    const SUCOMPLEX *x,
+    SUFLOAT scale,
+    size_t size)
+{
+  quantizeInt16Impl(out, reinterpret_cast<const SUFLOAT *>(x), scale, size);
+}
+
+void
+SigDigger::quantizeHalf(
+    uint16_t *out,
+    const SUCOMPLEX *x,
+    SUFLOAT scale,
+    size_t size)
+{
+  quantizeHalfImpl(out, reinterpret_cast<const SUFLOAT *>(x), scale, size);
+}
+
+void
+SigDigger::dequantizeInt16(
+    SUCOMPLEX *out,
+    const int16_t *x,
+    SUFLOAT scale,
+    size_t size)
+{
+  dequantizeInt16Impl(reinterpret_cast<SUFLOAT *>(out), x, scale, size);
+}
+
+void
+SigDigger::dequantizeHalf(
+    SUCOMPLEX *out,
+    const uint16_t *x,
+    SUFLOAT scale,
+    size_t size)
+{
+  dequantizeHalfImpl(reinterpret_cast<SUFLOAT *>(out), x, scale, size);
+}
+
+void
+SigDigger::encodePolar(uint32_t *out, const SUCOMPLEX *x, size_t size)
+{
+  encodePolarImpl(out, reinterpret_cast<const SUFLOAT *>(x), size);
+}
+
+void
+SigDigger::decodePolar(SUCOMPLEX *out, const uint32_t *x, size_t size)
+{
+  decodePolarImpl(reinterpret_cast<SUFLOAT *>(out), x, size);
+}
+
+void
+SigDigger::phaseIncrement(
+    SUFLOAT *out,
+    const SUCOMPLEX *x,
+    SUCOMPLEX prev,
+    size_t size)
+{
+  phaseIncrementImpl(
+        out,
+        reinterpret_cast<const SUFLOAT *>(x),
+        SU_C_REAL(prev),
+        SU_C_IMAG(prev),
+        size);
+}
+
+SUFLOAT
+SigDigger::singlePoleFilter(
+    SUFLOAT *out,
+    const SUFLOAT *x,
+    SUFLOAT alpha,
+    SUFLOAT state,
+    size_t size)
+{
+  return singlePoleFilterImpl(out, x, alpha, state, size);
+}
+
+SUCOMPLEX
+SigDigger::crossProductSum(
+    const SUCOMPLEX *lo,
+    const SUCOMPLEX *hi,
+    size_t size)
+{
+  SUFLOAT re, im;
+
+  crossProductSumImpl(
+        &re,
+        &im,
+        reinterpret_cast<const SUFLOAT *>(lo),
+        reinterpret_cast<const SUFLOAT *>(hi),
+        size);
+
+  return SUCOMPLEX(re, im);
+}
+
+////////////////////////// CrossProductIntegrator //////////////////////////////
+void
+CrossProductIntegrator::reset()
+{
+  m_acc   = 0;
+  m_count = 0;
+}
+
+void
+CrossProductIntegrator::setDecimation(unsigned decimation)
+{
+  if (decimation < 1)
+    decimation = 1;
+
+  if (decimation != m_decimation) {
+    m_decimation = decimation;
+    reset();
+  }
+}
+
+unsigned
+CrossProductIntegrator::decimation() const
+{
+  return m_decimation;
+}
+
+unsigned
+CrossProductIntegrator::pending() const
+{
+  return m_count;
+}
+
+size_t
+CrossProductIntegrator::maxOutput(size_t size) const
+{
+  return (m_count + size) / m_decimation;
+}
+
+size_t
+CrossProductIntegrator::feed(
+    SUCOMPLEX *out,
+    const SUCOMPLEX *lo,
+    const SUCOMPLEX *hi,
+    size_t size)
+{
+  size_t p = 0, n = 0, chunk;
+  SUFLOAT k;
+
+  if (m_decimation == 1) {
+    crossProduct(out, lo, hi, size);
+    return size;
+  }
+
+  k = 1.f / static_cast<SUFLOAT>(m_decimation);
+
+  while (p < size) {
+    chunk = m_decimation - m_count;
+    if (chunk > size - p)
+      chunk = size - p;
+
+    m_acc   += crossProductSum(lo + p, hi + p, chunk);
+    m_count += static_cast<unsigned>(chunk);
+    p       += chunk;
+
+    if (m_count == m_decimation) {
+      out[n++] = k * m_acc;
+      m_acc    = 0;
+      m_count  = 0;
+    }
+  }
+
+  return n;
+}
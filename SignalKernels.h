@@ -0,0 +1,166 @@
+//
+//    SignalKernels.h: Vectorized sample processing kernels
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef SIGNALKERNELS_H
+#define SIGNALKERNELS_H
+
+#include <sigutils/types.h>
+#include <cstddef>
+#include <cstdint>
+
+//
+// The kernels below operate on interleaved complex samples. When the
+// library is built in single precision on a target with SSE2 (which is
+// always the case in x86_64) they are implemented with intrinsics. Other
+// targets fall back to plain loops, which are written so the compiler
+// can still vectorize them.
+//
+
+namespace SigDigger {
+  // out[i] = lo[i] * conj(-hi[i])
+  void crossProduct(
+      SUCOMPLEX *out,
+      const SUCOMPLEX *lo,
+      const SUCOMPLEX *hi,
+      size_t size);
+
+  // Returns sum(lo[i] * conj(-hi[i]))
+  SUCOMPLEX crossProductSum(
+      const SUCOMPLEX *lo,
+      const SUCOMPLEX *hi,
+      size_t size);
+
+  // Returns sum(|x[i]|^2)
+  SUFLOAT powerSum(const SUCOMPLEX *x, size_t size);
+
+  // Returns sum(taps[i] * x[i])
+  SUCOMPLEX realDotProduct(
+      const SUCOMPLEX *x,
+      const SUFLOAT *taps,
+      size_t size);
+
+  //
+  // Real-tap FIR over complex samples:
+  //
+  //   out[n] = sum(taps[k] * in[n - k]), k = 0 ... order - 1
+  //
+  // The order - 1 samples preceding in[0] must be readable (history).
+  //
+  void firFilter(
+      SUCOMPLEX *out,
+      const SUCOMPLEX *in,
+      const SUFLOAT *taps,
+      size_t order,
+      size_t size);
+
+  // out[2i] + j out[2i + 1] = scale * x[i], rounded to the nearest integer
+  // and saturated to the int16_t range
+  void quantizeInt16(
+      int16_t *out,
+      const SUCOMPLEX *x,
+      SUFLOAT scale,
+      size_t size);
+
+  // Same as above, as IEEE 754 half precision floats (round to nearest
+  // even, saturating to infinity)
+  void quantizeHalf(
+      uint16_t *out,
+      const SUCOMPLEX *x,
+      SUFLOAT scale,
+      size_t size);
+
+  // Inverse of the above: out[i] = scale * (x[2i] + j x[2i + 1])
+  void dequantizeInt16(
+      SUCOMPLEX *out,
+      const int16_t *x,
+      SUFLOAT scale,
+      size_t size);
+
+  void dequantizeHalf(
+      SUCOMPLEX *out,
+      const uint16_t *x,
+      SUFLOAT scale,
+      size_t size);
+
+  //
+  // Compact polar encoding in 32 bits per sample. The upper half holds the
+  // phase (2^16 steps per turn) and the lower half 512 log2|x| + 32768,
+  // with 0 standing for zero. That spans magnitudes from 2^-64 to 2^64 in
+  // relative steps of 0.14%; smaller ones are stored as zero. Decoding is
+  // accurate to a small fraction of a step.
+  //
+  void encodePolar(uint32_t *out, const SUCOMPLEX *x, size_t size);
+  void decodePolar(SUCOMPLEX *out, const uint32_t *x, size_t size);
+
+  // out[i] = arg(x[i] * conj(x[i - 1])), with x[-1] = prev. Undefined
+  // angles (next to zero or infinite samples) are pi, the least coherent
+  // value. The SSE version is accurate to about 1e-6 rad.
+  void phaseIncrement(
+      SUFLOAT *out,
+      const SUCOMPLEX *x,
+      SUCOMPLEX prev,
+      size_t size);
+
+  //
+  // Single pole low pass filter, as SU_SPLPF_FEED:
+  //
+  //   out[i] = out[i - 1] + alpha * (x[i] - out[i - 1]), out[-1] = state
+  //
+  // Returns the new state (the last output). out and x may be the same.
+  // The SSE version computes four outputs at a time with a prefix scan.
+  //
+  SUFLOAT singlePoleFilter(
+      SUFLOAT *out,
+      const SUFLOAT *x,
+      SUFLOAT alpha,
+      SUFLOAT state,
+      size_t size);
+
+  //
+  // Integrate-and-dump version of the cross product. Every m_decimation
+  // input samples, one averaged phasor is written to the output. Partial
+  // sums are kept between calls, so block boundaries do not matter.
+  //
+  class CrossProductIntegrator
+  {
+    SUCOMPLEX m_acc        = 0;
+    unsigned  m_decimation = 1;
+    unsigned  m_count      = 0;
+
+  public:
+    void     reset();
+    void     setDecimation(unsigned);
+    unsigned decimation() const;
+
+    // Input samples already accumulated into the next output
+    unsigned pending() const;
+
+    // Upper bound of the number of samples produced by feed()
+    size_t   maxOutput(size_t) const;
+
+    // Returns the number of samples written to out
+    size_t   feed(
+        SUCOMPLEX *out,
+        const SUCOMPLEX *lo,
+        const SUCOMPLEX *hi,
+        size_t size);
+  };
+}
+
+#endif // SIGNALKERNELS_H
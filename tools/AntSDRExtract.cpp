@@ -0,0 +1,400 @@
+//
+//    AntSDRExtract.cpp: Batch coherent event extraction from recordings
+//    Copyright (C) 2024 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+//
+// Runs the coherent detector over a set of autosaved recordings (files,
+// or directories searched recursively) and writes every event found to
+// a single event table, sorted by time, optionally with a CSV next to it.
+//
+// All recordings are split in chunks up front (see CoherentReplay), and
+// a pool of threads takes them in order, so many small recordings keep
+// all cores busy as well as a few big ones do. Every chunk maps its file
+// on its own: only the files being scanned are open at any time.
+//
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "CoherentReplay.h"
+#include "EventStore.h"
+#include "SigMFMetadata.h"
+
+#define ANTSDR_EXTRACT_SPEED_OF_LIGHT 2.9979246e+08
+#define ANTSDR_EXTRACT_PROGRESS_MS    500
+
+using namespace SigDigger;
+
+namespace {
+  struct Options {
+    qreal    threshold       = 10;  // degrees
+    qreal    measurementTime = .2;  // s
+    qreal    dipoleSep       = 1.1; // m
+    unsigned jobs            = 0;
+    QString  table;
+    QString  csv;
+  };
+
+  struct Recording {
+    QString        path;
+    qreal          sampRate = 0;
+    SUSCOUNT       size     = 0;
+    std::vector<CoherentReplayChunk> chunks;
+  };
+
+  struct Task {
+    size_t recording;
+    size_t chunk;
+  };
+
+  struct Extracted {
+    EventRecord record;
+    size_t      recording;
+  };
+}
+
+static bool
+parseNumber(QCommandLineParser const &parser, QString const &name, qreal &out)
+{
+  bool ok = true;
+
+  if (parser.isSet(name)) {
+    out = parser.value(name).toDouble(&ok);
+    if (!ok || out <= 0) {
+      fprintf(
+            stderr,
+            "Invalid value for --%s: %s\n",
+            name.toLocal8Bit().data(),
+            parser.value(name).toLocal8Bit().data());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool
+parseOptions(QCoreApplication &app, Options &options, QStringList &inputs)
+{
+  QCommandLineParser parser;
+  qreal jobs = 0;
+
+  parser.setApplicationDescription(
+        "Extract coherent events from phase difference recordings");
+  parser.addHelpOption();
+  parser.addOptions({
+    {{"t", "threshold"},
+     "Maximum phase dispersion, in degrees (default: 10).",
+     "degrees"},
+    {{"m", "measurement-time"},
+     "Measurement interval, in seconds (default: 0.2).",
+     "seconds"},
+    {{"d", "dipole-separation"},
+     "Dipole separation, in meters (default: 1.1).",
+     "meters"},
+    {{"j", "jobs"},
+     "Worker threads (default: one per hardware thread).",
+     "count"},
+    {{"o", "output"},
+     "Event table to write (required).",
+     "path"},
+    {"csv",
+     "Also write the events as CSV, with the recording of each one.",
+     "path"}});
+  parser.addPositionalArgument(
+        "recordings",
+        "Recordings, or directories to search for them.",
+        "recordings...");
+
+  parser.process(app);
+
+  if (!parseNumber(parser, "threshold", options.threshold)
+      || !parseNumber(parser, "measurement-time", options.measurementTime)
+      || !parseNumber(parser, "dipole-separation", options.dipoleSep)
+      || !parseNumber(parser, "jobs", jobs))
+    return false;
+
+  options.jobs  = static_cast<unsigned>(jobs);
+  options.table = parser.value("output");
+  options.csv   = parser.value("csv");
+  inputs        = parser.positionalArguments();
+
+  if (options.table.isEmpty() || inputs.isEmpty()) {
+    fprintf(stderr, "%s", parser.helpText().toLocal8Bit().data());
+    return false;
+  }
+
+  return true;
+}
+
+static QStringList
+findRecordings(QStringList const &inputs)
+{
+  QStringList paths;
+  QStringList filters = {
+    PHASE_RECORDING_PREFIX "*.raw",
+    PHASE_RECORDING_PREFIX "*" PHASE_RECORDING_COMPRESSED_EXTENSION,
+    PHASE_RECORDING_PREFIX "*" SIGMF_DATA_EXTENSION
+  };
+
+  for (auto const &input : inputs) {
+    if (QFileInfo(input).isDir()) {
+      QDirIterator it(
+            input,
+            filters,
+            QDir::Files,
+            QDirIterator::Subdirectories);
+
+      while (it.hasNext())
+        paths.append(it.next());
+    } else {
+      paths.append(input);
+    }
+  }
+
+  // Autosave names start with the capture time
+  paths.sort();
+  paths.removeDuplicates();
+
+  return paths;
+}
+
+static void
+configure(CoherentReplay &replay, Options const &options)
+{
+  PhaseRecording const &recording = replay.recording();
+  SUSCOUNT size = static_cast<SUSCOUNT>(
+        options.measurementTime * recording.sampleRate());
+  SUFLOAT phaseScale = M_PI;
+
+  if (recording.frequency() > 0)
+    phaseScale = static_cast<SUFLOAT>(
+          2 * M_PI * options.dipoleSep * recording.frequency()
+          / ANTSDR_EXTRACT_SPEED_OF_LIGHT);
+
+  replay.setDetector(
+        std::max<SUSCOUNT>(size, 1),
+        size,
+        static_cast<SUFLOAT>(SU_DEG2RAD(options.threshold)),
+        phaseScale);
+}
+
+static bool
+saveCSV(
+    QString const &path,
+    std::vector<Extracted> const &events,
+    std::vector<Recording> const &recordings)
+{
+  QFile file(path);
+
+  if (!file.open(QIODevice::Text | QIODevice::WriteOnly)) {
+    fprintf(
+          stderr,
+          "Cannot write %s: %s\n",
+          path.toLocal8Bit().data(),
+          file.errorString().toLocal8Bit().data());
+    return false;
+  }
+
+  QTextStream out(&file);
+
+  // Same columns as the event list of the phase plot page, plus the file
+  for (auto const &event : events)
+    out << QString::fromStdString(EventStore::csvLine(event.record)) << ","
+        << QFileInfo(recordings[event.recording].path).fileName() << "\n";
+
+  return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  Options options;
+  QStringList inputs;
+  std::vector<Recording> recordings;
+  std::vector<Task> tasks;
+  std::vector<Extracted> events;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> next(0), done(0), failed(0);
+  EventStore store;
+  SUSCOUNT samples = 0;
+  unsigned jobs;
+  auto started = std::chrono::steady_clock::now();
+  qreal elapsed;
+
+  app.setApplicationName("antsdr-extract");
+
+  if (!parseOptions(app, options, inputs))
+    return 1;
+
+  jobs = options.jobs;
+  if (jobs == 0)
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  // Chunk boundaries only depend on the size and the detector settings
+  for (auto const &path : findRecordings(inputs)) {
+    CoherentReplay replay;
+    Recording recording;
+
+    if (!replay.open(path)) {
+      fprintf(
+            stderr,
+            "Skipping %s: %s\n",
+            path.toLocal8Bit().data(),
+            replay.recording().errorString().toLocal8Bit().data());
+      continue;
+    }
+
+    configure(replay, options);
+
+    recording.path     = path;
+    recording.sampRate = replay.recording().sampleRate();
+    recording.size     = replay.recording().size();
+    recording.chunks   = replay.split(jobs);
+
+    for (size_t i = 0; i < recording.chunks.size(); ++i) {
+      Task task;
+
+      task.recording = recordings.size();
+      task.chunk     = i;
+      tasks.push_back(task);
+    }
+
+    samples += recording.size;
+    recordings.push_back(std::move(recording));
+  }
+
+  if (recordings.empty()) {
+    fprintf(stderr, "No recordings to process\n");
+    return 1;
+  }
+
+  fprintf(
+        stderr,
+        "Scanning %zu recordings (%llu samples) in %zu chunks, %u threads\n",
+        recordings.size(),
+        static_cast<unsigned long long>(samples),
+        tasks.size(),
+        jobs);
+
+  for (unsigned i = 0; i < jobs; ++i)
+    workers.push_back(
+          std::thread([&] () {
+            size_t index;
+
+            while ((index = next++) < tasks.size()) {
+              Recording &recording = recordings[tasks[index].recording];
+              CoherentReplay replay;
+
+              if (replay.open(recording.path)) {
+                configure(replay, options);
+                replay.scan(recording.chunks[tasks[index].chunk]);
+              } else {
+                ++failed;
+              }
+
+              ++done;
+            }
+          }));
+
+  while (done < tasks.size()) {
+    std::this_thread::sleep_for(
+          std::chrono::milliseconds(ANTSDR_EXTRACT_PROGRESS_MS));
+    fprintf(stderr, "\r%zu/%zu chunks", done.load(), tasks.size());
+  }
+
+  fprintf(stderr, "\n");
+
+  for (auto &worker : workers)
+    worker.join();
+
+  if (failed > 0)
+    fprintf(stderr, "%zu chunks could not be read\n", failed.load());
+
+  // Chunks hold their events in order, recordings may overlap in time
+  for (size_t i = 0; i < recordings.size(); ++i) {
+    Recording const &recording = recordings[i];
+
+    for (auto const &chunk : recording.chunks)
+      for (auto const &event : chunk.events) {
+        Extracted extracted;
+
+        extracted.recording = i;
+        extracted.record    = EventStore::record(
+              event.event,
+              event.event.timeStamp,
+              event.start,
+              (event.end - event.start) / recording.sampRate);
+
+        events.push_back(extracted);
+      }
+  }
+
+  std::stable_sort(
+        events.begin(),
+        events.end(),
+        [] (Extracted const &a, Extracted const &b) {
+          return a.record.time < b.record.time;
+        });
+
+  if (!store.open()) {
+    perror("Cannot allocate the event store");
+    return 1;
+  }
+
+  for (auto const &event : events)
+    if (!store.append(event.record)) {
+      perror("Cannot store event");
+      return 1;
+    }
+
+  if (!store.exportTable(options.table.toStdString())) {
+    fprintf(
+          stderr,
+          "Cannot write %s: %s\n",
+          options.table.toLocal8Bit().data(),
+          strerror(errno));
+    return 1;
+  }
+
+  if (!options.csv.isEmpty() && !saveCSV(options.csv, events, recordings))
+    return 1;
+
+  elapsed = std::chrono::duration<qreal>(
+        std::chrono::steady_clock::now() - started).count();
+
+  fprintf(
+        stderr,
+        "%zu events in %.1f s (%.3g samples/s)\n",
+        events.size(),
+        elapsed,
+        samples / std::max<qreal>(elapsed, 1e-3));
+
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+TEMPLATE = app
+TARGET = antsdr-extract
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+QT -= gui
+
+isEmpty(PREFIX): PREFIX = /usr/local
+
+target.path = $$PREFIX/bin
+INSTALLS += target
+
+# Shares the detector and file formats with the plugin
+INCLUDEPATH += ..
+
+SOURCES += AntSDRExtract.cpp \
+  ../AutoSaveWriter.cpp \
+  ../CoherentDetector.cpp \
+  ../CoherentReplay.cpp \
+  ../EventStore.cpp \
+  ../PhaseRecording.cpp \
+  ../RecordingIndex.cpp \
+  ../SampleCodec.cpp \
+  ../SigMFMetadata.cpp \
+  ../SignalKernels.cpp
+
+HEADERS += ../AutoSaveWriter.h \
+  ../CoherentDetector.h \
+  ../CoherentReplay.h \
+  ../EventStore.h \
+  ../PhaseRecording.h \
+  ../RecordingIndex.h \
+  ../SampleCodec.h \
+  ../SigMFMetadata.h \
+  ../SignalKernels.h
+
+unix: CONFIG += link_pkgconfig
+unix: PKGCONFIG += sigutils